@@ -0,0 +1,1087 @@
+/*
+ * Copyright (C) 2017 Swift Navigation Inc.
+ * Contact: Jacob McNamee <jacob@swiftnav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <time.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+extern "C"
+{
+  #include <libpiksi/settings.h>
+  #include <libpiksi/settings_protocol.h>
+  #include <libpiksi/sbp_zmq_pubsub.h>
+  #include <libpiksi/util.h>
+  #include <libsbp/settings.h>
+}
+
+/* Messages are forwarded by zmq_router, so its filters apply. The daemon
+ * under test connects to the router ports of the settings daemon, libpiksi
+ * settings clients connect to the settings client ports, the console to the
+ * external ports and a firmware stand-in to the firmware ports */
+#define CONSOLE_PUB_ENDPOINT ">tcp://127.0.0.1:43031"
+#define CONSOLE_SUB_ENDPOINT ">tcp://127.0.0.1:43030"
+#define FIRMWARE_PUB_ENDPOINT ">tcp://127.0.0.1:43011"
+#define FIRMWARE_SUB_ENDPOINT ">tcp://127.0.0.1:43010"
+
+#define CONFIG_FILE SETTINGS_DIR "/config.ini"
+
+#define CLIENT_COUNT 4
+#define SECTIONS_PER_CLIENT 8
+#define SETTINGS_PER_SECTION 128
+#define SETTINGS_PER_CLIENT (SECTIONS_PER_CLIENT * SETTINGS_PER_SECTION)
+#define SETTINGS_COUNT (CLIENT_COUNT * SETTINGS_PER_CLIENT)
+
+/* Snapshot imports are applied to the settings of the import owner. Its
+ * limited setting rejects values above IMPORT_LIMIT. The silent owner never
+ * replies to writes. */
+#define IMPORT_SECTION "import"
+#define IMPORT_SILENT_SECTION "import_silent"
+#define IMPORT_SETTINGS_COUNT 4
+#define IMPORT_LIMIT 100
+#define IMPORT_TRIES 4
+#define IMPORT_TIMEOUT_s 0.5
+#define SNAPSHOT_FILE SETTINGS_DIR "/import.snapshot"
+
+/* The settings of the notify owner share a deferred notify function, which
+ * may be made slow or fail. Failed runs are retried after NOTIFY_RETRY_s. */
+#define NOTIFY_SECTION "notify"
+#define NOTIFY_SETTINGS_COUNT 2
+#define NOTIFY_DEBOUNCE_ms 100
+#define NOTIFY_RETRY_s 1.0
+#define NOTIFY_SLOW_s 0.5
+#define NOTIFY_BURST 20
+#define NOTIFY_POLL_us 10000
+
+#define READ_ALL_ROUNDS 5
+#define SERVE_POLL_ms 50
+#define CONSOLE_POLL_ms 10
+#define PING_INTERVAL_s 0.1
+#define WAIT_TIMEOUT_s 30.0
+
+namespace {
+
+static double now_s()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void latency_report(const char *name, std::vector<double> &samples_s)
+{
+  if (samples_s.empty()) {
+    return;
+  }
+
+  std::sort(samples_s.begin(), samples_s.end());
+  double sum_s = 0.0;
+  for (double s : samples_s) {
+    sum_s += s;
+  }
+  size_t n = samples_s.size();
+  printf("%s: %zu samples, mean %.3f ms, p50 %.3f ms, p99 %.3f ms, "
+         "max %.3f ms\n", name, n, 1e3 * sum_s / n,
+         1e3 * samples_s[n / 2], 1e3 * samples_s[(n * 99) / 100],
+         1e3 * samples_s[n - 1]);
+}
+
+/* Start a process with no arguments */
+static pid_t process_start(const char *path)
+{
+  pid_t pid = fork();
+  if (pid == 0) {
+    execl(path, path, (char *)NULL);
+    _exit(127);
+  }
+  return pid;
+}
+
+static void process_stop(pid_t pid)
+{
+  if (pid > 0) {
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+  }
+}
+
+/* Synthetic settings client. Each client registers its settings from its
+ * own thread, then serves writes until stopped. */
+struct Client {
+  unsigned id;
+  pthread_t thread;
+  settings_ctx_t *ctx;
+  s32 values[SETTINGS_PER_CLIENT];
+  std::vector<double> latencies_s;
+  int errors;
+};
+
+static Client clients[CLIENT_COUNT];
+static unsigned clients_started;
+static pthread_barrier_t start_barrier;
+static pthread_barrier_t registered_barrier;
+static volatile bool clients_stop;
+
+static void setting_name_get(unsigned client, unsigned index, char *section,
+                             char *name)
+{
+  sprintf(section, "bench%u_%u", client, index / SETTINGS_PER_SECTION);
+  sprintf(name, "setting%03u", index % SETTINGS_PER_SECTION);
+}
+
+static void read_all_count(u16 index, const char *section, const char *name,
+                           const char *value, const char *type, void *context)
+{
+  (void)index; (void)section; (void)name; (void)value; (void)type;
+  (*(unsigned *)context)++;
+}
+
+/* Owner of a notify group */
+struct NotifyRun {
+  double time_s;
+  s32 a;
+  s32 b;
+};
+
+struct NotifyOwner {
+  pthread_t thread;
+  bool running;
+  settings_ctx_t *ctx;
+  s32 a;
+  s32 b;
+  s32 a_applied;
+  s32 b_applied;
+  pthread_mutex_t lock;
+  std::vector<NotifyRun> runs;
+  double slow_s;
+  unsigned failures;
+  bool busy;
+};
+
+static NotifyOwner notify_owner;
+
+/* Executed on the notify worker thread */
+static int notify_owner_notify(void *context)
+{
+  NotifyOwner *o = (NotifyOwner *)context;
+
+  pthread_mutex_lock(&o->lock);
+  o->runs.push_back({ now_s(), o->a_applied, o->b_applied });
+  o->busy = true;
+  double slow_s = o->slow_s;
+  bool failed = (o->failures > 0);
+  if (failed) {
+    o->failures--;
+  }
+  pthread_mutex_unlock(&o->lock);
+
+  if (slow_s > 0) {
+    usleep(slow_s * 1e6);
+  }
+
+  pthread_mutex_lock(&o->lock);
+  o->busy = false;
+  pthread_mutex_unlock(&o->lock);
+  return failed ? -1 : 0;
+}
+
+static bool notify_owner_register(NotifyOwner *o)
+{
+  settings_notify_group_t *group =
+    settings_notify_group_create(o->ctx, NOTIFY_DEBOUNCE_ms,
+                                 notify_owner_notify, o);
+  return (group != NULL) &&
+         (settings_register_grouped(o->ctx, NOTIFY_SECTION, "a", &o->a,
+                                    sizeof(o->a), SETTINGS_TYPE_INT,
+                                    NULL, NULL, group, &o->a_applied) == 0) &&
+         (settings_register_grouped(o->ctx, NOTIFY_SECTION, "b", &o->b,
+                                    sizeof(o->b), SETTINGS_TYPE_INT,
+                                    NULL, NULL, group, &o->b_applied) == 0);
+}
+
+static std::vector<NotifyRun> notify_runs_get()
+{
+  pthread_mutex_lock(&notify_owner.lock);
+  std::vector<NotifyRun> runs = notify_owner.runs;
+  pthread_mutex_unlock(&notify_owner.lock);
+  return runs;
+}
+
+static bool notify_busy_get()
+{
+  pthread_mutex_lock(&notify_owner.lock);
+  bool busy = notify_owner.busy;
+  pthread_mutex_unlock(&notify_owner.lock);
+  return busy;
+}
+
+/* Wait until a condition on the notify owner holds or timeout_s elapses */
+template <typename F>
+static bool notify_wait(F condition, double timeout_s)
+{
+  double deadline = now_s() + timeout_s;
+  while (!condition()) {
+    if (now_s() > deadline) {
+      return false;
+    }
+    usleep(NOTIFY_POLL_us);
+  }
+  return true;
+}
+
+/* Serve writes until the clients are stopped */
+static void settings_serve(settings_ctx_t *ctx)
+{
+  zloop_t *zloop = zloop_new();
+  settings_reader_add(ctx, zloop);
+  while (!clients_stop) {
+    zmq_simple_loop_timeout(zloop, SERVE_POLL_ms);
+  }
+  settings_reader_remove(ctx, zloop);
+  zloop_destroy(&zloop);
+}
+
+static void * client_run(void *arg)
+{
+  Client *c = (Client *)arg;
+
+  /* Settle the connections before timing */
+  unsigned count = 0;
+  if (settings_read_all(c->ctx, read_all_count, &count) != 0) {
+    c->errors++;
+  }
+
+  /* Each section is registered as a batch, timed from its first
+   * registration to the last reply */
+  pthread_barrier_wait(&start_barrier);
+  for (unsigned i = 0; i < SETTINGS_PER_CLIENT; i += SETTINGS_PER_SECTION) {
+    double start = now_s();
+    if (settings_register_batch_begin(c->ctx) != 0) {
+      c->errors++;
+    }
+    for (unsigned j = i; j < i + SETTINGS_PER_SECTION; j++) {
+      char section[32];
+      char name[32];
+      setting_name_get(c->id, j, section, name);
+      c->values[j] = j;
+      if (settings_register(c->ctx, section, name, &c->values[j],
+                            sizeof(c->values[j]), SETTINGS_TYPE_INT,
+                            NULL, NULL) != 0) {
+        c->errors++;
+      }
+    }
+    if (settings_register_batch_end(c->ctx, NULL, NULL) != 0) {
+      c->errors++;
+    }
+    c->latencies_s.push_back(now_s() - start);
+  }
+  pthread_barrier_wait(&registered_barrier);
+
+  settings_serve(c->ctx);
+  return NULL;
+}
+
+/* Owner of the settings changed by snapshot imports */
+struct ImportOwner {
+  pthread_t thread;
+  bool running;
+  settings_ctx_t *ctx;
+  settings_ctx_t *silent_ctx;
+  s32 first;
+  s32 second;
+  s32 limited;
+  s32 silent;
+};
+
+static ImportOwner import_owner;
+
+static int import_limited_notify(void *context)
+{
+  return (*(s32 *)context > IMPORT_LIMIT) ? -1 : 0;
+}
+
+static void * import_owner_run(void *arg)
+{
+  settings_serve(((ImportOwner *)arg)->ctx);
+  return NULL;
+}
+
+static void * notify_owner_run(void *arg)
+{
+  settings_serve(((NotifyOwner *)arg)->ctx);
+  return NULL;
+}
+
+static bool import_owner_register(ImportOwner *o)
+{
+  o->first = 1;
+  o->second = 2;
+  o->limited = 3;
+  o->silent = 0;
+  return (settings_register(o->ctx, IMPORT_SECTION, "first", &o->first,
+                            sizeof(o->first), SETTINGS_TYPE_INT,
+                            NULL, NULL) == 0) &&
+         (settings_register(o->ctx, IMPORT_SECTION, "second", &o->second,
+                            sizeof(o->second), SETTINGS_TYPE_INT,
+                            NULL, NULL) == 0) &&
+         (settings_register(o->ctx, IMPORT_SECTION, "limited", &o->limited,
+                            sizeof(o->limited), SETTINGS_TYPE_INT,
+                            import_limited_notify, &o->limited) == 0) &&
+         (settings_register(o->silent_ctx, IMPORT_SILENT_SECTION, "value",
+                            &o->silent, sizeof(o->silent), SETTINGS_TYPE_INT,
+                            NULL, NULL) == 0);
+}
+
+/* Console on the external port, counting the responses it receives */
+struct ConsoleStats {
+  unsigned read_resp_count;
+  unsigned done_count;
+  std::map<std::string, std::string> values;
+  std::map<std::string, unsigned> write_counts;
+  unsigned snapshot_resp_count;
+  settings_snapshot_resp_t snapshot_resp;
+  std::string snapshot_rejected;
+  unsigned typed_resp_count;
+  settings_typed_header_t typed_resp;
+  s32 typed_value;
+};
+
+/* Split a settings message into "section.name" and value */
+static bool setting_message_parse(u8 len, u8 msg[], std::string *key,
+                                  std::string *value)
+{
+  const char *strs[3];
+  u8 pos = 0;
+  for (int i = 0; i < 3; i++) {
+    const u8 *end = (const u8 *)memchr(&msg[pos], '\0', len - pos);
+    if (end == NULL) {
+      return false;
+    }
+    strs[i] = (const char *)&msg[pos];
+    pos = end - msg + 1;
+  }
+  *key = std::string(strs[0]) + "." + strs[1];
+  *value = strs[2];
+  return true;
+}
+
+static void console_read_resp_callback(u16 sender_id, u8 len, u8 msg[],
+                                       void *context)
+{
+  (void)sender_id;
+  ConsoleStats *stats = (ConsoleStats *)context;
+  stats->read_resp_count++;
+
+  std::string key;
+  std::string value;
+  if (setting_message_parse(len, msg, &key, &value)) {
+    stats->values[key] = value;
+  }
+}
+
+/* Writes received by the firmware stand-in, counted with the console */
+static void firmware_write_callback(u16 sender_id, u8 len, u8 msg[],
+                                   void *context)
+{
+  (void)sender_id;
+  std::string key;
+  std::string value;
+  if (setting_message_parse(len, msg, &key, &value)) {
+    ((ConsoleStats *)context)->write_counts[key + "=" + value]++;
+  }
+}
+
+static void console_snapshot_resp_callback(u16 sender_id, u8 len, u8 msg[],
+                                           void *context)
+{
+  (void)sender_id;
+  ConsoleStats *stats = (ConsoleStats *)context;
+  if (len < sizeof(stats->snapshot_resp)) {
+    return;
+  }
+
+  memcpy(&stats->snapshot_resp, msg, sizeof(stats->snapshot_resp));
+
+  /* A rejected setting is named by its section and name */
+  stats->snapshot_rejected.clear();
+  u8 pos = sizeof(stats->snapshot_resp);
+  for (int i = 0; i < 2; i++) {
+    const u8 *end = (const u8 *)memchr(&msg[pos], '\0', len - pos);
+    if (end == NULL) {
+      break;
+    }
+    if (i > 0) {
+      stats->snapshot_rejected += ".";
+    }
+    stats->snapshot_rejected += (const char *)&msg[pos];
+    pos = end - msg + 1;
+  }
+  stats->snapshot_resp_count++;
+}
+
+/* Typed read responses to the console hold a 32 bit value */
+static void console_typed_resp_callback(u16 sender_id, u8 len, u8 msg[],
+                                        void *context)
+{
+  (void)sender_id;
+  ConsoleStats *stats = (ConsoleStats *)context;
+  if (len < sizeof(stats->typed_resp) + sizeof(stats->typed_value)) {
+    return;
+  }
+
+  memcpy(&stats->typed_resp, msg, sizeof(stats->typed_resp));
+  memcpy(&stats->typed_value, &msg[sizeof(stats->typed_resp)],
+         sizeof(stats->typed_value));
+  stats->typed_resp_count++;
+}
+
+static void console_done_callback(u16 sender_id, u8 len, u8 msg[],
+                                  void *context)
+{
+  (void)sender_id; (void)len; (void)msg;
+  ((ConsoleStats *)context)->done_count++;
+}
+
+static sbp_zmq_pubsub_ctx_t *console;
+static sbp_zmq_pubsub_ctx_t *firmware;
+static ConsoleStats console_stats;
+
+static void console_send(u16 msg_type, u8 len, u8 *payload)
+{
+  sbp_zmq_tx_send_from(sbp_zmq_pubsub_tx_ctx_get(console), msg_type, len,
+                       payload, SBP_SENDER_ID);
+}
+
+/* Process console and firmware messages until a condition holds or
+ * timeout_s elapses */
+template <typename F>
+static bool console_wait(F condition, double timeout_s)
+{
+  sbp_zmq_rx_ctx_t *rx_ctxs[] = {
+    sbp_zmq_pubsub_rx_ctx_get(console),
+    sbp_zmq_pubsub_rx_ctx_get(firmware),
+  };
+  zmq_pollitem_t items[2];
+  for (int i = 0; i < 2; i++) {
+    sbp_zmq_rx_pollitem_init(rx_ctxs[i], &items[i]);
+  }
+
+  double deadline = now_s() + timeout_s;
+  while (!condition()) {
+    if (now_s() > deadline) {
+      return false;
+    }
+    if (zmq_poll(items, 2, CONSOLE_POLL_ms) > 0) {
+      for (int i = 0; i < 2; i++) {
+        sbp_zmq_rx_pollitem_check(rx_ctxs[i], &items[i]);
+      }
+    }
+  }
+  return true;
+}
+
+/* A read by index past the end is answered with DONE once the daemon is
+ * connected */
+static bool daemon_ping()
+{
+  u16 index = 0xFFFF;
+  double deadline = now_s() + WAIT_TIMEOUT_s;
+  while (now_s() < deadline) {
+    unsigned done_count = console_stats.done_count;
+    console_send(SBP_MSG_SETTINGS_READ_BY_INDEX_REQ, sizeof(index),
+                 (u8 *)&index);
+    if (console_wait([&] { return console_stats.done_count > done_count; },
+                     PING_INTERVAL_s)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void console_write(const char *section, const char *name,
+                          const char *value)
+{
+  u8 buf[256];
+  int len = sprintf((char *)buf, "%s", section) + 1;
+  len += sprintf((char *)buf + len, "%s", name) + 1;
+  len += sprintf((char *)buf + len, "%s", value) + 1;
+  console_send(SBP_MSG_SETTINGS_WRITE, len, buf);
+}
+
+/* Write a setting and wait for its owner to reply with the new value */
+static bool console_write_wait(const char *section, const char *name,
+                               const char *value)
+{
+  std::string key = std::string(section) + "." + name;
+  console_stats.values.erase(key);
+  console_write(section, name, value);
+  return console_wait([&] {
+    auto it = console_stats.values.find(key);
+    return (it != console_stats.values.end()) && (it->second == value);
+  }, WAIT_TIMEOUT_s);
+}
+
+/* Read a setting from the daemon until it has the expected value */
+static bool setting_value_wait(const char *section, const char *name,
+                               const char *value)
+{
+  u8 req[64];
+  int len = sprintf((char *)req, "%s", section) + 1;
+  len += sprintf((char *)req + len, "%s", name) + 1;
+  std::string key = std::string(section) + "." + name;
+
+  double deadline = now_s() + WAIT_TIMEOUT_s;
+  while (now_s() < deadline) {
+    console_stats.values.erase(key);
+    console_send(SBP_MSG_SETTINGS_READ_REQ, len, req);
+    if (console_wait([&] {
+          auto it = console_stats.values.find(key);
+          return (it != console_stats.values.end()) && (it->second == value);
+        }, PING_INTERVAL_s)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Send a typed request for a setting and wait for the response. A 32 bit
+ * value is written if value is not NULL, otherwise the setting is read. */
+static bool console_typed_request(const char *section, const char *name,
+                                  const s32 *value)
+{
+  u8 req[64];
+  int len = 0;
+  u16 msg_type = SBP_MSG_SETTINGS_TYPED_READ_REQ;
+  if (value != NULL) {
+    settings_typed_header_t header = { SETTINGS_TYPED_S32, 0 };
+    memcpy(&req[len], &header, sizeof(header));
+    len += sizeof(header);
+    memcpy(&req[len], value, sizeof(*value));
+    len += sizeof(*value);
+    msg_type = SBP_MSG_SETTINGS_TYPED_WRITE;
+  }
+  len += sprintf((char *)req + len, "%s", section) + 1;
+  len += sprintf((char *)req + len, "%s", name) + 1;
+
+  unsigned typed_resp_count = console_stats.typed_resp_count;
+  console_send(msg_type, len, req);
+  return console_wait([&] {
+    return console_stats.typed_resp_count > typed_resp_count;
+  }, WAIT_TIMEOUT_s);
+}
+
+struct SnapshotEntry {
+  const char *section;
+  const char *name;
+  const char *value;
+};
+
+/* Write a snapshot file holding the given entries. An invalid hash is
+ * written if hash_valid is false. */
+static bool snapshot_file_write(std::vector<SnapshotEntry> entries,
+                                bool hash_valid)
+{
+  std::sort(entries.begin(), entries.end(),
+            [](const SnapshotEntry &a, const SnapshotEntry &b) {
+              int order = strcmp(a.section, b.section);
+              return (order != 0) ? (order < 0) : (strcmp(a.name, b.name) < 0);
+            });
+
+  std::string data;
+  for (const SnapshotEntry &e : entries) {
+    data.append(e.section).push_back('\0');
+    data.append(e.name).push_back('\0');
+    data.append(e.value).push_back('\0');
+  }
+
+  settings_snapshot_header_t header;
+  header.magic = SETTINGS_SNAPSHOT_MAGIC;
+  header.version = SETTINGS_SNAPSHOT_VERSION;
+  header.count = entries.size();
+  header.hash = fnv1a_64_update(FNV1A_64_INIT, data.data(), data.size());
+  if (!hash_valid) {
+    header.hash ^= 1;
+  }
+
+  FILE *f = fopen(SNAPSHOT_FILE, "w");
+  if (f == NULL) {
+    return false;
+  }
+  bool ok = (fwrite(&header, sizeof(header), 1, f) == 1) &&
+            (fwrite(data.data(), 1, data.size(), f) == data.size());
+  return (fclose(f) == 0) && ok;
+}
+
+/* Import the snapshot file and wait for the response */
+static bool snapshot_import(u8 flags, double timeout_s)
+{
+  u8 req[128];
+  req[0] = flags;
+  int len = 1 + sprintf((char *)req + 1, "%s", SNAPSHOT_FILE) + 1;
+
+  unsigned snapshot_resp_count = console_stats.snapshot_resp_count;
+  console_send(SBP_MSG_SETTINGS_SNAPSHOT_IMPORT_REQ, len, req);
+  return console_wait([&] {
+    return console_stats.snapshot_resp_count > snapshot_resp_count;
+  }, timeout_s);
+}
+
+/* Hash of the current configuration */
+static bool snapshot_hash_get(u64 *hash)
+{
+  unsigned snapshot_resp_count = console_stats.snapshot_resp_count;
+  console_send(SBP_MSG_SETTINGS_SNAPSHOT_EXPORT_REQ, 0, NULL);
+  if (!console_wait([&] {
+        return console_stats.snapshot_resp_count > snapshot_resp_count;
+      }, WAIT_TIMEOUT_s)) {
+    return false;
+  }
+  *hash = console_stats.snapshot_resp.hash;
+  return true;
+}
+
+static pid_t router_pid;
+static pid_t daemon_pid;
+static settings_ctx_t *reader;
+static double registration_s;
+
+class SbpSettingsDaemonBench : public ::testing::Test {
+ protected:
+
+  static void SetUpTestCase()
+  {
+    /* Prevent czmq from catching signals */
+    zsys_handler_set(NULL);
+
+    mkdir(SETTINGS_DIR, 0755);
+    unlink(CONFIG_FILE);
+
+    router_pid = process_start(ROUTER_PATH);
+    ASSERT_GT(router_pid, 0);
+    daemon_pid = process_start(SETTINGS_DAEMON_PATH);
+    ASSERT_GT(daemon_pid, 0);
+
+    console = sbp_zmq_pubsub_create(CONSOLE_PUB_ENDPOINT, CONSOLE_SUB_ENDPOINT);
+    ASSERT_TRUE(console != NULL);
+    sbp_zmq_rx_ctx_t *rx_ctx = sbp_zmq_pubsub_rx_ctx_get(console);
+    sbp_zmq_rx_callback_register(rx_ctx, SBP_MSG_SETTINGS_READ_RESP,
+                                 console_read_resp_callback, &console_stats,
+                                 NULL);
+    sbp_zmq_rx_callback_register(rx_ctx, SBP_MSG_SETTINGS_READ_BY_INDEX_DONE,
+                                 console_done_callback, &console_stats, NULL);
+    sbp_zmq_rx_callback_register(rx_ctx, SBP_MSG_SETTINGS_SNAPSHOT_RESP,
+                                 console_snapshot_resp_callback,
+                                 &console_stats, NULL);
+    sbp_zmq_rx_callback_register(rx_ctx, SBP_MSG_SETTINGS_TYPED_READ_RESP,
+                                 console_typed_resp_callback, &console_stats,
+                                 NULL);
+
+    /* The router forwards writes of the daemon to the firmware only */
+    firmware = sbp_zmq_pubsub_create(FIRMWARE_PUB_ENDPOINT,
+                                     FIRMWARE_SUB_ENDPOINT);
+    ASSERT_TRUE(firmware != NULL);
+    sbp_zmq_rx_callback_register(sbp_zmq_pubsub_rx_ctx_get(firmware),
+                                 SBP_MSG_SETTINGS_WRITE,
+                                 firmware_write_callback, &console_stats,
+                                 NULL);
+    ASSERT_TRUE(daemon_ping());
+
+    /* Contexts are created here since czmq setup is not thread safe */
+    for (unsigned i = 0; i < CLIENT_COUNT; i++) {
+      clients[i].id = i;
+      clients[i].ctx = settings_create();
+      ASSERT_TRUE(clients[i].ctx != NULL);
+    }
+    reader = settings_create();
+    ASSERT_TRUE(reader != NULL);
+    import_owner.ctx = settings_create();
+    ASSERT_TRUE(import_owner.ctx != NULL);
+    import_owner.silent_ctx = settings_create();
+    ASSERT_TRUE(import_owner.silent_ctx != NULL);
+    pthread_mutex_init(&notify_owner.lock, NULL);
+    notify_owner.ctx = settings_create();
+    ASSERT_TRUE(notify_owner.ctx != NULL);
+
+    clients_stop = false;
+    pthread_barrier_init(&start_barrier, NULL, CLIENT_COUNT + 1);
+    pthread_barrier_init(&registered_barrier, NULL, CLIENT_COUNT + 1);
+    for (unsigned i = 0; i < CLIENT_COUNT; i++) {
+      ASSERT_EQ(pthread_create(&clients[i].thread, NULL, client_run,
+                               &clients[i]), 0);
+      clients_started++;
+    }
+
+    pthread_barrier_wait(&start_barrier);
+    double start = now_s();
+    pthread_barrier_wait(&registered_barrier);
+    registration_s = now_s() - start;
+
+    ASSERT_TRUE(import_owner_register(&import_owner));
+    import_owner.running = (pthread_create(&import_owner.thread, NULL,
+                                           import_owner_run,
+                                           &import_owner) == 0);
+    ASSERT_TRUE(import_owner.running);
+
+    ASSERT_TRUE(notify_owner_register(&notify_owner));
+    notify_owner.running = (pthread_create(&notify_owner.thread, NULL,
+                                           notify_owner_run,
+                                           &notify_owner) == 0);
+    ASSERT_TRUE(notify_owner.running);
+  }
+
+  static void TearDownTestCase()
+  {
+    /* Setup may have stopped part way */
+    clients_stop = true;
+    for (unsigned i = 0; i < clients_started; i++) {
+      pthread_join(clients[i].thread, NULL);
+    }
+    if (import_owner.running) {
+      pthread_join(import_owner.thread, NULL);
+      import_owner.running = false;
+    }
+    if (notify_owner.running) {
+      pthread_join(notify_owner.thread, NULL);
+      notify_owner.running = false;
+    }
+    for (unsigned i = 0; i < CLIENT_COUNT; i++) {
+      if (clients[i].ctx != NULL) {
+        settings_destroy(&clients[i].ctx);
+      }
+    }
+    if (reader != NULL) {
+      settings_destroy(&reader);
+    }
+    if (import_owner.ctx != NULL) {
+      settings_destroy(&import_owner.ctx);
+    }
+    if (import_owner.silent_ctx != NULL) {
+      settings_destroy(&import_owner.silent_ctx);
+    }
+    if (notify_owner.ctx != NULL) {
+      settings_destroy(&notify_owner.ctx);
+    }
+    unlink(SNAPSHOT_FILE);
+    if (console != NULL) {
+      sbp_zmq_pubsub_destroy(&console);
+    }
+    if (firmware != NULL) {
+      sbp_zmq_pubsub_destroy(&firmware);
+    }
+
+    process_stop(daemon_pid);
+    process_stop(router_pid);
+  }
+};
+
+TEST_F(SbpSettingsDaemonBench, Registration)
+{
+  std::vector<double> latencies_s;
+  for (unsigned i = 0; i < CLIENT_COUNT; i++) {
+    EXPECT_EQ(clients[i].errors, 0);
+    latencies_s.insert(latencies_s.end(), clients[i].latencies_s.begin(),
+                       clients[i].latencies_s.end());
+  }
+
+  printf("registration: %u settings from %u clients in %.3f s, "
+         "%.0f settings/s\n", SETTINGS_COUNT, CLIENT_COUNT, registration_s,
+         SETTINGS_COUNT / registration_s);
+  latency_report("registration batch latency", latencies_s);
+  EXPECT_EQ(latencies_s.size(), (size_t)(CLIENT_COUNT * SECTIONS_PER_CLIENT));
+}
+
+TEST_F(SbpSettingsDaemonBench, ReadByIndex)
+{
+  std::vector<double> durations_s;
+  for (int i = 0; i < READ_ALL_ROUNDS; i++) {
+    unsigned count = 0;
+    double start = now_s();
+    EXPECT_EQ(settings_read_all(reader, read_all_count, &count), 0);
+    durations_s.push_back(now_s() - start);
+    EXPECT_EQ(count, (unsigned)(SETTINGS_COUNT + IMPORT_SETTINGS_COUNT +
+                                NOTIFY_SETTINGS_COUNT));
+  }
+
+  std::sort(durations_s.begin(), durations_s.end());
+  printf("read by index: %u settings in %.3f s (best of %d), "
+         "%.0f settings/s\n", SETTINGS_COUNT, durations_s[0], READ_ALL_ROUNDS,
+         SETTINGS_COUNT / durations_s[0]);
+}
+
+TEST_F(SbpSettingsDaemonBench, Save)
+{
+  /* Change the settings of one client so that they are saved */
+  unsigned read_resp_count = console_stats.read_resp_count;
+  double start = now_s();
+  for (unsigned i = 0; i < SETTINGS_PER_CLIENT; i++) {
+    char section[32];
+    char name[32];
+    setting_name_get(0, i, section, name);
+
+    u8 buf[256];
+    int len = sprintf((char *)buf, "%s", section) + 1;
+    len += sprintf((char *)buf + len, "%s", name) + 1;
+    len += sprintf((char *)buf + len, "%u", i + 1) + 1;
+    console_send(SBP_MSG_SETTINGS_WRITE, len, buf);
+  }
+  ASSERT_TRUE(console_wait([&] {
+    return console_stats.read_resp_count - read_resp_count >=
+           SETTINGS_PER_CLIENT;
+  }, WAIT_TIMEOUT_s));
+  double write_s = now_s() - start;
+  printf("write: %u settings in %.3f s, %.0f settings/s\n",
+         SETTINGS_PER_CLIENT, write_s, SETTINGS_PER_CLIENT / write_s);
+
+  /* The save is not acknowledged. The daemon handles messages in order, so
+   * the response to a read sent after the save marks its completion. All
+   * writes have been answered, so the next read response is the daemon's. */
+  u8 req[32];
+  int len = sprintf((char *)req, "bench0_0") + 1;
+  len += sprintf((char *)req + len, "setting000") + 1;
+  read_resp_count = console_stats.read_resp_count;
+  start = now_s();
+  console_send(SBP_MSG_SETTINGS_SAVE, 0, NULL);
+  console_send(SBP_MSG_SETTINGS_READ_REQ, len, req);
+  ASSERT_TRUE(console_wait([&] {
+    return console_stats.read_resp_count > read_resp_count;
+  }, WAIT_TIMEOUT_s));
+  double save_s = now_s() - start;
+  printf("save: %u changed of %u settings in %.3f ms\n",
+         SETTINGS_PER_CLIENT, SETTINGS_COUNT, 1e3 * save_s);
+
+  FILE *f = fopen(CONFIG_FILE, "r");
+  ASSERT_TRUE(f != NULL);
+  unsigned lines = 0;
+  char line[256];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (strncmp(line, "setting", strlen("setting")) == 0) {
+      lines++;
+    }
+  }
+  fclose(f);
+  EXPECT_EQ(lines, (unsigned)SETTINGS_PER_CLIENT);
+}
+
+TEST_F(SbpSettingsDaemonBench, Typed)
+{
+  /* Typed messages are exchanged between the console and the owner */
+  ASSERT_TRUE(console_typed_request("bench1_0", "setting005", NULL));
+  EXPECT_EQ(console_stats.typed_resp.type, SETTINGS_TYPED_S32);
+  EXPECT_EQ(console_stats.typed_resp.status, SETTINGS_TYPED_STATUS_OK);
+  EXPECT_EQ(console_stats.typed_value, 5);
+
+  s32 value = 1005;
+  ASSERT_TRUE(console_typed_request("bench1_0", "setting005", &value));
+  EXPECT_EQ(console_stats.typed_resp.status, SETTINGS_TYPED_STATUS_OK);
+  EXPECT_EQ(console_stats.typed_value, 1005);
+
+  /* The daemon stores the value written */
+  EXPECT_TRUE(setting_value_wait("bench1_0", "setting005", "1005"));
+}
+
+TEST_F(SbpSettingsDaemonBench, ImportHashMismatch)
+{
+  u64 hash;
+  ASSERT_TRUE(snapshot_hash_get(&hash));
+
+  ASSERT_TRUE(snapshot_file_write({
+    { IMPORT_SECTION, "first", "11" },
+  }, false));
+  ASSERT_TRUE(snapshot_import(0, WAIT_TIMEOUT_s));
+  EXPECT_EQ(console_stats.snapshot_resp.status,
+            SETTINGS_SNAPSHOT_STATUS_INVALID);
+  EXPECT_EQ(console_stats.snapshot_resp.changed, 0);
+  EXPECT_EQ(console_stats.snapshot_resp.hash, hash);
+  EXPECT_EQ(console_stats.write_counts[IMPORT_SECTION ".first=11"], 0u);
+  EXPECT_TRUE(setting_value_wait(IMPORT_SECTION, "first", "1"));
+}
+
+TEST_F(SbpSettingsDaemonBench, ImportUnknownSetting)
+{
+  u64 hash;
+  ASSERT_TRUE(snapshot_hash_get(&hash));
+
+  ASSERT_TRUE(snapshot_file_write({
+    { IMPORT_SECTION, "first", "12" },
+    { IMPORT_SECTION, "unknown", "12" },
+  }, true));
+  ASSERT_TRUE(snapshot_import(0, WAIT_TIMEOUT_s));
+  EXPECT_EQ(console_stats.snapshot_resp.status,
+            SETTINGS_SNAPSHOT_STATUS_UNKNOWN_SETTING);
+  EXPECT_EQ(console_stats.snapshot_resp.changed, 0);
+  EXPECT_EQ(console_stats.snapshot_resp.hash, hash);
+  EXPECT_EQ(console_stats.snapshot_rejected, IMPORT_SECTION ".unknown");
+  EXPECT_EQ(console_stats.write_counts[IMPORT_SECTION ".first=12"], 0u);
+  EXPECT_TRUE(setting_value_wait(IMPORT_SECTION, "first", "1"));
+}
+
+TEST_F(SbpSettingsDaemonBench, ImportRejectedRollback)
+{
+  ASSERT_TRUE(snapshot_file_write({
+    { IMPORT_SECTION, "first", "13" },
+    { IMPORT_SECTION, "second", "14" },
+    { IMPORT_SECTION, "limited", "1000" },
+  }, true));
+  ASSERT_TRUE(snapshot_import(0, WAIT_TIMEOUT_s));
+  EXPECT_EQ(console_stats.snapshot_resp.status,
+            SETTINGS_SNAPSHOT_STATUS_REJECTED);
+  EXPECT_EQ(console_stats.snapshot_resp.changed, 0);
+  EXPECT_EQ(console_stats.snapshot_resp.rejected, 1);
+  EXPECT_EQ(console_stats.snapshot_rejected, IMPORT_SECTION ".limited");
+
+  /* Accepted values are restored */
+  EXPECT_TRUE(setting_value_wait(IMPORT_SECTION, "first", "1"));
+  EXPECT_TRUE(setting_value_wait(IMPORT_SECTION, "second", "2"));
+  EXPECT_TRUE(setting_value_wait(IMPORT_SECTION, "limited", "3"));
+}
+
+TEST_F(SbpSettingsDaemonBench, ImportRejectedPartial)
+{
+  ASSERT_TRUE(snapshot_file_write({
+    { IMPORT_SECTION, "first", "15" },
+    { IMPORT_SECTION, "second", "16" },
+    { IMPORT_SECTION, "limited", "1001" },
+  }, true));
+  ASSERT_TRUE(snapshot_import(SETTINGS_SNAPSHOT_IMPORT_PARTIAL,
+                              WAIT_TIMEOUT_s));
+  EXPECT_EQ(console_stats.snapshot_resp.status,
+            SETTINGS_SNAPSHOT_STATUS_REJECTED);
+  EXPECT_EQ(console_stats.snapshot_resp.changed, 2);
+  EXPECT_EQ(console_stats.snapshot_resp.rejected, 1);
+  EXPECT_EQ(console_stats.snapshot_rejected, IMPORT_SECTION ".limited");
+
+  /* Accepted values are kept */
+  EXPECT_TRUE(setting_value_wait(IMPORT_SECTION, "first", "15"));
+  EXPECT_TRUE(setting_value_wait(IMPORT_SECTION, "second", "16"));
+  EXPECT_TRUE(setting_value_wait(IMPORT_SECTION, "limited", "3"));
+}
+
+TEST_F(SbpSettingsDaemonBench, ImportTimeout)
+{
+  ASSERT_TRUE(snapshot_file_write({
+    { IMPORT_SILENT_SECTION, "value", "7" },
+  }, true));
+  double start = now_s();
+  ASSERT_TRUE(snapshot_import(0, WAIT_TIMEOUT_s));
+  double import_s = now_s() - start;
+  printf("import timeout: %d tries in %.3f s\n", IMPORT_TRIES, import_s);
+
+  EXPECT_EQ(console_stats.snapshot_resp.status,
+            SETTINGS_SNAPSHOT_STATUS_TIMEOUT);
+  EXPECT_EQ(console_stats.snapshot_resp.changed, 0);
+  EXPECT_EQ(console_stats.snapshot_resp.rejected, 1);
+  EXPECT_EQ(console_stats.snapshot_rejected, IMPORT_SILENT_SECTION ".value");
+
+  /* The write is sent once per try, then the previous value is restored */
+  EXPECT_GE(import_s, (IMPORT_TRIES - 1) * IMPORT_TIMEOUT_s);
+  EXPECT_EQ(console_stats.write_counts[IMPORT_SILENT_SECTION ".value=7"],
+            (unsigned)IMPORT_TRIES);
+  EXPECT_EQ(console_stats.write_counts[IMPORT_SILENT_SECTION ".value=0"], 1u);
+  EXPECT_TRUE(setting_value_wait(IMPORT_SILENT_SECTION, "value", "0"));
+}
+
+TEST_F(SbpSettingsDaemonBench, NotifyGroupDebounce)
+{
+  /* Registration runs the notify function once */
+  ASSERT_TRUE(notify_wait([] { return !notify_runs_get().empty(); },
+                          WAIT_TIMEOUT_s));
+  usleep(2 * NOTIFY_DEBOUNCE_ms * 1000);
+  size_t runs_count = notify_runs_get().size();
+
+  char value[16];
+  for (int i = 1; i <= NOTIFY_BURST; i++) {
+    sprintf(value, "%d", i);
+    console_write(NOTIFY_SECTION, "a", value);
+    sprintf(value, "%d", 1000 + i);
+    console_write(NOTIFY_SECTION, "b", value);
+  }
+  ASSERT_TRUE(setting_value_wait(NOTIFY_SECTION, "b", value));
+
+  /* The burst is coalesced and the last run sees the last values. A single
+   * run is expected, but a slow host may spread the burst over more than
+   * one debounce period. */
+  ASSERT_TRUE(notify_wait([&] {
+    std::vector<NotifyRun> runs = notify_runs_get();
+    return (runs.size() > runs_count) &&
+           (runs.back().a == NOTIFY_BURST) &&
+           (runs.back().b == 1000 + NOTIFY_BURST);
+  }, WAIT_TIMEOUT_s));
+  usleep(3 * NOTIFY_DEBOUNCE_ms * 1000);
+  size_t burst_runs = notify_runs_get().size() - runs_count;
+  printf("notify burst: %d writes, %zu runs\n", 2 * NOTIFY_BURST, burst_runs);
+  EXPECT_LT(burst_runs, (size_t)NOTIFY_BURST);
+}
+
+TEST_F(SbpSettingsDaemonBench, NotifyGroupSlow)
+{
+  pthread_mutex_lock(&notify_owner.lock);
+  notify_owner.slow_s = NOTIFY_SLOW_s;
+  pthread_mutex_unlock(&notify_owner.lock);
+
+  ASSERT_TRUE(console_write_wait(NOTIFY_SECTION, "a", "100"));
+  ASSERT_TRUE(notify_wait(notify_busy_get, WAIT_TIMEOUT_s));
+
+  /* Writes are answered while the notify function runs. The reply time
+   * depends on the load of the host, so it is reported, not checked. */
+  double start = now_s();
+  ASSERT_TRUE(console_write_wait(NOTIFY_SECTION, "a", "101"));
+  double write_s = now_s() - start;
+  printf("write during slow notify: %.3f ms, notify runs for %.3f ms\n",
+         1e3 * write_s, 1e3 * NOTIFY_SLOW_s);
+
+  /* The write is applied by a later run */
+  ASSERT_TRUE(notify_wait([] {
+    return !notify_busy_get() && (notify_runs_get().back().a == 101);
+  }, WAIT_TIMEOUT_s));
+
+  pthread_mutex_lock(&notify_owner.lock);
+  notify_owner.slow_s = 0;
+  pthread_mutex_unlock(&notify_owner.lock);
+  ASSERT_TRUE(notify_wait([] { return !notify_busy_get(); }, WAIT_TIMEOUT_s));
+}
+
+TEST_F(SbpSettingsDaemonBench, NotifyGroupRetry)
+{
+  pthread_mutex_lock(&notify_owner.lock);
+  notify_owner.failures = 1;
+  size_t runs_count = notify_owner.runs.size();
+  pthread_mutex_unlock(&notify_owner.lock);
+
+  ASSERT_TRUE(console_write_wait(NOTIFY_SECTION, "a", "200"));
+
+  /* A failed run is retried without further writes */
+  ASSERT_TRUE(notify_wait([&] {
+    return notify_runs_get().size() >= runs_count + 2;
+  }, WAIT_TIMEOUT_s));
+  std::vector<NotifyRun> runs = notify_runs_get();
+  EXPECT_EQ(runs[runs_count].a, 200);
+  EXPECT_EQ(runs[runs_count + 1].a, 200);
+  double retry_s = runs[runs_count + 1].time_s - runs[runs_count].time_s;
+  printf("notify retry after %.3f s\n", retry_s);
+  EXPECT_GE(retry_s, 0.9 * NOTIFY_RETRY_s);
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2017 Swift Navigation Inc.
+ * Contact: Jacob McNamee <jacob@swiftnav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <time.h>
+#include <string.h>
+#include <gtest/gtest.h>
+
+extern "C"
+{
+  #include <libpiksi/sbp_zmq_rx.h>
+  #include <libsbp/edc.h>
+}
+
+#define ENDPOINT "inproc://sbp_zmq_rx_bench"
+
+#define MSG_TYPE   0x4A
+#define SENDER_ID  0x42
+#define MSG_LEN    200
+
+#define BATCH_SIZE 500
+#define BATCH_COUNT 200
+
+namespace {
+
+struct CallbackStats {
+  unsigned count;
+  bool payload_ok;
+};
+
+static void bench_callback(u16 sender_id, u8 len, u8 msg[], void *context)
+{
+  CallbackStats *stats = (CallbackStats *)context;
+  stats->count++;
+  if ((sender_id != SENDER_ID) || (len != MSG_LEN) ||
+      (msg[0] != 0xA5) || (msg[len - 1] != (u8)(len - 1))) {
+    stats->payload_ok = false;
+  }
+}
+
+static double now_s()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+class SbpZmqRxBench : public ::testing::Test {
+ protected:
+
+  SbpZmqRxBench()
+  {
+    rx_sock = zsock_new_pair("@" ENDPOINT);
+    tx_sock = zsock_new_pair(">" ENDPOINT);
+    rx_ctx = sbp_zmq_rx_create(rx_sock);
+    stats = { 0, true };
+    sbp_zmq_rx_callback_register(rx_ctx, MSG_TYPE, bench_callback, &stats,
+                                 NULL);
+
+    /* Build a single valid SBP frame */
+    u8 payload_start = 6;
+    frame[0] = SBP_PREAMBLE;
+    frame[1] = MSG_TYPE & 0xFF;
+    frame[2] = MSG_TYPE >> 8;
+    frame[3] = SENDER_ID & 0xFF;
+    frame[4] = SENDER_ID >> 8;
+    frame[5] = MSG_LEN;
+    for (int i = 0; i < MSG_LEN; i++) {
+      frame[payload_start + i] = i;
+    }
+    frame[payload_start] = 0xA5;
+    u16 crc = crc16_ccitt(&frame[1], 5 + MSG_LEN, 0);
+    frame[payload_start + MSG_LEN] = crc & 0xFF;
+    frame[payload_start + MSG_LEN + 1] = crc >> 8;
+  }
+
+  ~SbpZmqRxBench() override
+  {
+    sbp_zmq_rx_destroy(&rx_ctx);
+    zsock_destroy(&tx_sock);
+    zsock_destroy(&rx_sock);
+  }
+
+  /* Send the frame split into split_count ZMQ frames */
+  void send_frame(int split_count)
+  {
+    zmsg_t *msg = zmsg_new();
+    u32 offset = 0;
+    u32 part = sizeof(frame) / split_count;
+    for (int i = 0; i < split_count; i++) {
+      u32 len = (i == split_count - 1) ? sizeof(frame) - offset : part;
+      zmsg_addmem(msg, &frame[offset], len);
+      offset += len;
+    }
+    zmsg_send(&msg, tx_sock);
+  }
+
+  /* Returns callbacks per second spent in sbp_zmq_rx_read() */
+  double run(int split_count)
+  {
+    double elapsed = 0.0;
+    for (int b = 0; b < BATCH_COUNT; b++) {
+      for (int i = 0; i < BATCH_SIZE; i++) {
+        send_frame(split_count);
+      }
+      double start = now_s();
+      for (int i = 0; i < BATCH_SIZE; i++) {
+        sbp_zmq_rx_read(rx_ctx);
+      }
+      elapsed += now_s() - start;
+    }
+    return stats.count / elapsed;
+  }
+
+  zsock_t *rx_sock;
+  zsock_t *tx_sock;
+  sbp_zmq_rx_ctx_t *rx_ctx;
+  CallbackStats stats;
+  u8 frame[6 + MSG_LEN + 2];
+};
+
+TEST_F(SbpZmqRxBench, FramePath)
+{
+  double rate = run(1);
+  printf("frame path: %.0f callbacks/s\n", rate);
+  EXPECT_EQ(stats.count, (unsigned)(BATCH_SIZE * BATCH_COUNT));
+  EXPECT_TRUE(stats.payload_ok);
+}
+
+TEST_F(SbpZmqRxBench, StreamPath)
+{
+  /* A frame split across ZMQ frames goes through the libsbp stream parser */
+  double rate = run(2);
+  printf("stream path: %.0f callbacks/s\n", rate);
+  EXPECT_EQ(stats.count, (unsigned)(BATCH_SIZE * BATCH_COUNT));
+  EXPECT_TRUE(stats.payload_ok);
+}
+
+TEST_F(SbpZmqRxBench, BadCrcDropped)
+{
+  frame[6] ^= 0xFF;
+  send_frame(1);
+  sbp_zmq_rx_read(rx_ctx);
+  EXPECT_EQ(stats.count, 0u);
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2017 Swift Navigation Inc.
+ * Contact: Jacob McNamee <jacob@swiftnav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include <gtest/gtest.h>
+
+extern "C"
+{
+  #include <libpiksi/timer_wheel.h>
+  #include <libpiksi/util.h>
+}
+
+/* Number of slots of the wheel in timer_wheel.c */
+#define WHEEL_SLOTS 256
+
+#define LOOP_POLL_ms 5
+#define WAIT_TIMEOUT_s 5.0
+
+namespace {
+
+static double now_s()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+class TimerWheelTest;
+
+struct Expiry {
+  int id;
+  double time_s;
+};
+
+/* Context of a test timer. The handler may stop or restart the timer after
+ * a number of expiries. */
+struct TestTimer {
+  TimerWheelTest *test;
+  int id;
+  timer_wheel_timer_t *timer;
+  unsigned count;
+  unsigned restart_after;
+  u32 restart_delay_ms;
+  u32 restart_period_ms;
+  u32 block_ms;
+};
+
+class TimerWheelTest : public ::testing::Test {
+ protected:
+
+  TimerWheelTest()
+  {
+    /* Prevent czmq from catching signals */
+    zsys_handler_set(NULL);
+    zloop = zloop_new();
+    wheel = NULL;
+  }
+
+  ~TimerWheelTest() override
+  {
+    for (TestTimer &t : timers) {
+      if (t.timer != NULL) {
+        timer_wheel_timer_destroy(&t.timer);
+      }
+    }
+    if (wheel != NULL) {
+      timer_wheel_destroy(&wheel);
+    }
+    zloop_destroy(&zloop);
+  }
+
+  static void handler(timer_wheel_timer_t *timer, void *context)
+  {
+    TestTimer *t = (TestTimer *)context;
+    t->test->expiries.push_back({ t->id, now_s() - t->test->start_s });
+    t->count++;
+
+    if (t->block_ms > 0) {
+      usleep(t->block_ms * 1000);
+    }
+    if (t->count == t->restart_after) {
+      timer_wheel_timer_start(timer, t->restart_delay_ms,
+                              t->restart_period_ms);
+    }
+  }
+
+  void wheel_create(u32 resolution_ms, unsigned timer_count)
+  {
+    wheel = timer_wheel_create(zloop, resolution_ms);
+    ASSERT_TRUE(wheel != NULL);
+
+    /* Handler contexts must not move once timers are created */
+    timers.resize(timer_count);
+    for (unsigned i = 0; i < timer_count; i++) {
+      timers[i] = { this, (int)i, NULL, 0, 0, 0, 0, 0 };
+      timers[i].timer = timer_wheel_timer_create(wheel, handler, &timers[i]);
+      ASSERT_TRUE(timers[i].timer != NULL);
+    }
+    start_s = now_s();
+  }
+
+  /* Run the loop until count expiries have been recorded and for a further
+   * linger_s, or until WAIT_TIMEOUT_s elapses */
+  bool run(size_t count, double linger_s)
+  {
+    double deadline = now_s() + WAIT_TIMEOUT_s;
+    while (expiries.size() < count) {
+      if (now_s() > deadline) {
+        return false;
+      }
+      zmq_simple_loop_timeout(zloop, LOOP_POLL_ms);
+    }
+
+    double end = now_s() + linger_s;
+    while (now_s() < end) {
+      zmq_simple_loop_timeout(zloop, LOOP_POLL_ms);
+    }
+    return true;
+  }
+
+  zloop_t *zloop;
+  timer_wheel_t *wheel;
+  std::vector<TestTimer> timers;
+  std::vector<Expiry> expiries;
+  double start_s;
+};
+
+TEST_F(TimerWheelTest, ExpiryOrder)
+{
+  const u32 resolution_ms = 10;
+  const u32 delays_ms[] = { 120, 30, 200, 60, 30 };
+  const int order[] = { 1, 4, 3, 0, 2 };
+  const unsigned count = sizeof(delays_ms) / sizeof(delays_ms[0]);
+
+  wheel_create(resolution_ms, count);
+  for (unsigned i = 0; i < count; i++) {
+    timer_wheel_timer_start(timers[i].timer, delays_ms[i], 0);
+  }
+
+  /* One-shot timers expire once, in order of their delays */
+  ASSERT_TRUE(run(count, 0.1));
+  ASSERT_EQ(expiries.size(), (size_t)count);
+  for (unsigned i = 0; i < count; i++) {
+    int id = expiries[i].id;
+    if ((i > 0) && (delays_ms[id] == delays_ms[expiries[i - 1].id])) {
+      /* Timers expiring in the same slot may fire in either order */
+      EXPECT_NE(id, expiries[i - 1].id);
+    } else {
+      EXPECT_EQ(delays_ms[id], delays_ms[order[i]]);
+    }
+
+    /* Never before the deadline */
+    EXPECT_GE(1e3 * expiries[i].time_s, (double)delays_ms[id]);
+  }
+}
+
+TEST_F(TimerWheelTest, SlotWrapAround)
+{
+  /* Timers one and two revolutions after the first share its slot */
+  const u32 resolution_ms = 1;
+  const u32 delays_ms[] = {
+    40 + 2 * WHEEL_SLOTS * resolution_ms,
+    40 + WHEEL_SLOTS * resolution_ms,
+    40,
+  };
+  const unsigned count = sizeof(delays_ms) / sizeof(delays_ms[0]);
+
+  wheel_create(resolution_ms, count);
+  for (unsigned i = 0; i < count; i++) {
+    timer_wheel_timer_start(timers[i].timer, delays_ms[i], 0);
+  }
+
+  /* Later revolutions do not expire when the slot is first reached */
+  ASSERT_TRUE(run(count, 0.05));
+  ASSERT_EQ(expiries.size(), (size_t)count);
+  for (unsigned i = 0; i < count; i++) {
+    int id = count - 1 - i;
+    EXPECT_EQ(expiries[i].id, id);
+    EXPECT_GE(1e3 * expiries[i].time_s, (double)delays_ms[id]);
+  }
+}
+
+TEST_F(TimerWheelTest, PeriodicRestart)
+{
+  const u32 resolution_ms = 10;
+  const u32 period_ms = 50;
+  const u32 restart_delay_ms = 150;
+
+  /* After three periods, the handler restarts the timer as a one-shot */
+  wheel_create(resolution_ms, 1);
+  timers[0].restart_after = 3;
+  timers[0].restart_delay_ms = restart_delay_ms;
+  timers[0].restart_period_ms = 0;
+  timer_wheel_timer_start(timers[0].timer, period_ms, period_ms);
+
+  ASSERT_TRUE(run(4, 2.0 * restart_delay_ms / 1e3));
+  ASSERT_EQ(expiries.size(), 4u);
+  for (unsigned i = 0; i < 3; i++) {
+    EXPECT_GE(1e3 * expiries[i].time_s, (double)(i + 1) * period_ms);
+  }
+  EXPECT_GE(1e3 * (expiries[3].time_s - expiries[2].time_s),
+            (double)restart_delay_ms);
+  EXPECT_EQ(timer_wheel_timer_missed_get(timers[0].timer), 0u);
+}
+
+TEST_F(TimerWheelTest, PeriodicMissed)
+{
+  const u32 resolution_ms = 10;
+  const u32 period_ms = 20;
+  const u32 block_ms = 110;
+
+  /* A slow handler skips the deadlines it misses instead of catching up */
+  wheel_create(resolution_ms, 1);
+  timers[0].block_ms = block_ms;
+  timer_wheel_timer_start(timers[0].timer, period_ms, period_ms);
+
+  ASSERT_TRUE(run(1, 0.0));
+  timers[0].block_ms = 0;
+  ASSERT_TRUE(run(2, 0.0));
+  EXPECT_GE(timer_wheel_timer_missed_get(timers[0].timer),
+            block_ms / period_ms - 1);
+  EXPECT_GE(1e3 * (expiries[1].time_s - expiries[0].time_s), (double)block_ms);
+
+  timer_wheel_timer_stop(timers[0].timer);
+  size_t count = expiries.size();
+  ASSERT_TRUE(run(count, 3.0 * period_ms / 1e3));
+  EXPECT_EQ(expiries.size(), count);
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
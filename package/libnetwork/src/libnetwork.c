@@ -17,6 +17,10 @@
 
 #include "libnetwork.h"
 
+/* Debug logging is called for every transfer chunk */
+#define DEBUG_LOG_WINDOW_ms 1000
+#define DEBUG_LOG_BURST 10
+
 typedef struct {
   int fd;
   bool debug;
@@ -39,7 +43,8 @@ static size_t network_download_write(char *buf, size_t size, size_t n, void *dat
     }
 
     if (transfer->debug) {
-      piksi_log(LOG_DEBUG, "write bytes (%d) %d", size * n, ret);
+      piksi_log_ratelimited(DEBUG_LOG_WINDOW_ms, DEBUG_LOG_BURST, LOG_DEBUG,
+                            "write bytes (%d) %d", size * n, ret);
     }
 
     return ret;
@@ -59,7 +64,8 @@ static size_t network_upload_read(char *buf, size_t size, size_t n, void *data)
     }
 
     if (transfer->debug) {
-      piksi_log(LOG_DEBUG, "read bytes %d", ret);
+      piksi_log_ratelimited(DEBUG_LOG_WINDOW_ms, DEBUG_LOG_BURST, LOG_DEBUG,
+                            "read bytes %d", ret);
     }
 
     if (ret < 0) {
@@ -93,7 +99,9 @@ static int network_download_progress(void *data, curl_off_t dltot, curl_off_t dl
   network_progress_t *progress = data;
 
   if (progress->debug) {
-    piksi_log(LOG_DEBUG, "down bytes (%lld) %lld count %lld", dlnow, progress->bytes, progress->count);
+    piksi_log_ratelimited(DEBUG_LOG_WINDOW_ms, DEBUG_LOG_BURST, LOG_DEBUG,
+                          "down bytes (%lld) %lld count %lld",
+                          dlnow, progress->bytes, progress->count);
   }
 
   return network_progress(progress, dlnow);
@@ -108,7 +116,9 @@ static int network_upload_progress(void *data, curl_off_t dltot, curl_off_t dlno
   network_progress_t *progress = data;
 
   if (progress->debug) {
-    piksi_log(LOG_DEBUG, "up bytes (%lld) %lld count %lld", ulnow, progress->bytes, progress->count);
+    piksi_log_ratelimited(DEBUG_LOG_WINDOW_ms, DEBUG_LOG_BURST, LOG_DEBUG,
+                          "up bytes (%lld) %lld count %lld",
+                          ulnow, progress->bytes, progress->count);
   }
 
   return network_progress(progress, ulnow);
@@ -23,13 +23,69 @@
 #define LIBPIKSI_LOGGING_H
 
 #include <libpiksi/common.h>
+#include <libpiksi/sbp_zmq_tx.h>
 #include <syslog.h>
 
+/**
+ * @struct  logging_record_header_t
+ *
+ * @brief   Header of a binary log record.
+ * @details Binary log records consist of this header followed by
+ *          @p length bytes of message text without null termination.
+ */
+typedef struct __attribute__((packed)) {
+  u64 timestamp_us;   /**< CLOCK_REALTIME time of the call in microseconds. */
+  u32 pid;            /**< Process ID. */
+  u8 priority;        /**< Priority level as defined in <syslog.h>. */
+  u8 length;          /**< Length of the message text. */
+} logging_record_header_t;
+
+/**
+ * @struct  piksi_log_ratelimit_t
+ *
+ * @brief   Per call site rate limit state.
+ * @details Use piksi_log_ratelimited() rather than accessing this directly.
+ */
+typedef struct {
+  u32 interval_ms;
+  u32 burst;
+  u64 window_start_ms;
+  u32 count;
+  u32 suppressed;
+} piksi_log_ratelimit_t;
+
+/**
+ * @brief   Log a message, rate limited per call site.
+ * @details Log a message with piksi_log(), allowing at most @p burst_count
+ *          messages from this call site in each @p window_ms window. The
+ *          number of suppressed messages is logged when the next window
+ *          opens.
+ *
+ * @param[in] window_ms     Rate limit window in milliseconds.
+ * @param[in] burst_count   Maximum number of messages per window.
+ * @param[in] priority      Priority level as defined in <syslog.h>.
+ * @param[in] ...           Format string and arguments as defined by printf().
+ */
+#define piksi_log_ratelimited(window_ms, burst_count, priority, ...)          \
+  do {                                                                        \
+    static piksi_log_ratelimit_t piksi_log_ratelimit_ = {                     \
+      .interval_ms = (window_ms), .burst = (burst_count)                      \
+    };                                                                        \
+    if (piksi_log_ratelimit_check(&piksi_log_ratelimit_, (priority))) {       \
+      piksi_log((priority), __VA_ARGS__);                                     \
+    }                                                                         \
+  } while (0)
+
 /**
  * @brief   Initialize logging.
- * @details Initialize the global logging state for the process.
+ * @details Initialize the global logging state for the process. Messages are
+ *          formatted by the caller into a lock-free queue and written to the
+ *          system log by a background thread.
  * @note    This function should be called before using other API functions
- *          so that logging is properly initialized.
+ *          so that logging is properly initialized. Messages logged before
+ *          initialization, or in a forked child, are written synchronously.
+ * @note    If the queue is full, messages are dropped and the number of
+ *          dropped messages is logged once space is available.
  *
  * @param[in] identity      String identifying the process.
  */
@@ -37,10 +93,38 @@ int logging_init(const char *identity);
 
 /**
  * @brief   Deinitialize logging.
- * @details Deinitialize the global logging state for the process.
+ * @details Write all queued messages, stop the background thread and
+ *          deinitialize the global logging state for the process. This is
+ *          also done at process exit.
  */
 void logging_deinit(void);
 
+/**
+ * @brief   Write binary log records.
+ * @details Write queued messages to the specified file or FIFO as binary
+ *          records, see logging_record_header_t, instead of the system log.
+ *          Each record is written with a single call to write().
+ *
+ * @param[in] path          Path to write records to, or NULL to revert to
+ *                          the system log.
+ *
+ * @return                  The operation result.
+ * @retval 0                The output was set successfully.
+ * @retval -1               An error occurred.
+ */
+int logging_binary_output_set(const char *path);
+
+/**
+ * @brief   Check a call site rate limit.
+ * @details Used by piksi_log_ratelimited().
+ *
+ * @param[inout] rl         Pointer to the rate limit state of the call site.
+ * @param[in] priority      Priority level of the message.
+ *
+ * @return                  Whether the message should be logged.
+ */
+bool piksi_log_ratelimit_check(piksi_log_ratelimit_t *rl, int priority);
+
 /**
  * @brief   Log a message.
  * @details Write a message to the system log.
@@ -60,6 +144,37 @@ void piksi_log(int priority, const char *format, ...);
  */
 void piksi_vlog(int priority, const char *format, va_list ap);
 
+/**
+ * @brief   Send a log message over SBP.
+ * @details Format a message and send it as SBP_MSG_LOG using the specified
+ *          TX context. Messages longer than the SBP payload are truncated.
+ *
+ * @param[in] tx_ctx        Pointer to the SBP ZMQ TX context to use.
+ * @param[in] priority      Priority level as defined in <syslog.h>.
+ * @param[in] format        Format string and arguments as defined by printf().
+ *
+ * @return                  The operation result.
+ * @retval 0                The message was sent successfully.
+ * @retval -1               An error occurred.
+ */
+int sbp_log(sbp_zmq_tx_ctx_t *tx_ctx, int priority, const char *format, ...);
+
+/**
+ * @brief   Send a log message over SBP with variable argument list.
+ * @details See sbp_log().
+ *
+ * @param[in] tx_ctx        Pointer to the SBP ZMQ TX context to use.
+ * @param[in] priority      Priority level as defined in <syslog.h>.
+ * @param[in] format        Format string as defined by printf().
+ * @param[in] ap            Variable argument list for printf().
+ *
+ * @return                  The operation result.
+ * @retval 0                The message was sent successfully.
+ * @retval -1               An error occurred.
+ */
+int sbp_vlog(sbp_zmq_tx_ctx_t *tx_ctx, int priority, const char *format,
+             va_list ap);
+
 #endif /* LIBPIKSI_LOGGING_H */
 
 /** @} */
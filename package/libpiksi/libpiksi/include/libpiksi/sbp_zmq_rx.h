@@ -31,11 +31,89 @@
  */
 typedef struct sbp_zmq_rx_ctx_s sbp_zmq_rx_ctx_t;
 
+/**
+ * @struct  sbp_zmq_rx_any_node_t
+ *
+ * @brief   Opaque node for a callback registered for all message types.
+ */
+typedef struct sbp_zmq_rx_any_node_s sbp_zmq_rx_any_node_t;
+
+/**
+ * @brief   Callback for all SBP message types.
+ * @details Same as @c sbp_msg_callback_t, with the message type added.
+ */
+typedef void (*sbp_zmq_rx_any_callback_t)(u16 msg_type, u16 sender_id,
+                                          u8 len, u8 msg[], void *context);
+
+/**
+ * @brief   Generic function pointer for typed view callbacks.
+ */
+typedef void (*sbp_zmq_rx_view_fn_t)(void);
+
+/**
+ * @brief   Trampoline converting a view to a typed callback.
+ * @details Generated by SBP_ZMQ_RX_VIEW_DEFINE().
+ */
+typedef void (*sbp_zmq_rx_view_trampoline_t)(u16 sender_id, u8 len,
+                                             const void *msg,
+                                             sbp_zmq_rx_view_fn_t cb,
+                                             void *context);
+
+/**
+ * @brief   Define a typed view callback API for an SBP message.
+ * @details Defines the callback type @c sbp_zmq_rx_<name>_cb_t, taking a
+ *          const pointer to @p msg_struct, and the function
+ *          @c sbp_zmq_rx_<name>_register() with the same arguments as
+ *          sbp_zmq_rx_callback_register(). The callback is only executed if
+ *          the payload holds at least @c sizeof(msg_struct) bytes, and
+ *          receives a view of the payload in place. SBP message structs are
+ *          packed, so accessing fields through the view is safe regardless
+ *          of alignment. For messages with a variable length tail, @p len
+ *          bounds the tail.
+ *
+ *          Nodes are removed with sbp_zmq_rx_callback_remove().
+ *
+ * @see     libpiksi/sbp_zmq_rx_views.h for the definitions provided.
+ *
+ * @param   name            Name used in the generated identifiers.
+ * @param   msg_type        SBP message type.
+ * @param   msg_struct      SBP message struct type.
+ */
+#define SBP_ZMQ_RX_VIEW_DEFINE(name, msg_type, msg_struct)                    \
+  typedef void (*sbp_zmq_rx_##name##_cb_t)(u16 sender_id, u8 len,            \
+                                           const msg_struct *msg,             \
+                                           void *context);                    \
+                                                                              \
+  static inline void sbp_zmq_rx_##name##_trampoline(u16 sender_id, u8 len,   \
+                                                    const void *msg,          \
+                                                    sbp_zmq_rx_view_fn_t cb,  \
+                                                    void *context)            \
+  {                                                                           \
+    ((sbp_zmq_rx_##name##_cb_t)cb)(sender_id, len,                            \
+                                   (const msg_struct *)msg, context);         \
+  }                                                                           \
+                                                                              \
+  static inline int sbp_zmq_rx_##name##_register(                             \
+      sbp_zmq_rx_ctx_t *ctx, sbp_zmq_rx_##name##_cb_t cb, void *context,      \
+      sbp_msg_callbacks_node_t **node)                                        \
+  {                                                                           \
+    return sbp_zmq_rx_view_callback_register(ctx, msg_type,                   \
+                                             sizeof(msg_struct),              \
+                                             sbp_zmq_rx_##name##_trampoline,  \
+                                             (sbp_zmq_rx_view_fn_t)cb,        \
+                                             context, node);                  \
+  }
+
 /**
  * @brief   Create an SBP ZMQ RX context.
  * @details Create and initialize an SBP ZMQ RX context used to receive SBP
  *          messages.
  *
+ * @note    If @p zsock is a SUB socket, the context subscribes to the
+ *          message types which have callbacks registered, and to
+ *          everything while an all-types callback is registered. The socket
+ *          should be created without any other subscription.
+ *
  * @param[in] zsock         Pointer to the ZMQ socket to use.
  *
  * @return                  Pointer to the created context, or NULL if the
@@ -56,7 +134,13 @@ void sbp_zmq_rx_destroy(sbp_zmq_rx_ctx_t **ctx);
 /**
  * @brief   Register an SBP message callback.
  * @details Register a callback function to be executed when an SBP message of
- *          the specified type has been received.
+ *          the specified type has been received. Several callbacks may be
+ *          registered for the same type, they are executed in registration
+ *          order.
+ *
+ * @note    The payload passed to the callback is only valid for the duration
+ *          of the callback. It may point directly into the received ZMQ
+ *          frame.
  *
  * @see     libsbp, @c <libsbp/sbp.h>.
  *
@@ -81,6 +165,9 @@ int sbp_zmq_rx_callback_register(sbp_zmq_rx_ctx_t *ctx, u16 msg_type,
  * @brief   Remove an SBP message callback.
  * @details Remove a registered SBP message callback.
  *
+ * @note    May be called from any callback of the context, for any node. A
+ *          callback removed while a message is dispatched is not executed
+ *          for that message if it has not been already.
  * @note    The node pointer will be set to NULL by this function on success.
  *
  * @see     libsbp, @c <libsbp/sbp.h>.
@@ -95,6 +182,78 @@ int sbp_zmq_rx_callback_register(sbp_zmq_rx_ctx_t *ctx, u16 msg_type,
 int sbp_zmq_rx_callback_remove(sbp_zmq_rx_ctx_t *ctx,
                                sbp_msg_callbacks_node_t **node);
 
+/**
+ * @brief   Register a view callback for an SBP message.
+ * @details Register a callback which is executed through @p trampoline with
+ *          a const view of the payload if it is at least @p min_len bytes.
+ *          Shorter messages are dropped.
+ *
+ * @note    Use the functions generated by SBP_ZMQ_RX_VIEW_DEFINE() rather
+ *          than calling this directly.
+ *
+ * @param[in] ctx           Pointer to the context to use.
+ * @param[in] msg_type      Type of SBP message to listen for.
+ * @param[in] min_len       Minimum payload length.
+ * @param[in] trampoline    Function converting the view for @p cb.
+ * @param[in] cb            Typed callback function to execute.
+ * @param[in] context       Callback context.
+ * @param[out] node         Double pointer to be set to the allocated SBP
+ *                          callback node. Required to remove the callback
+ *                          using sbp_zmq_rx_callback_remove(). May be
+ *                          NULL if unused.
+ *
+ * @return                  The operation result.
+ * @retval 0                The callback was registered successfully.
+ * @retval -1               An error occurred.
+ */
+int sbp_zmq_rx_view_callback_register(sbp_zmq_rx_ctx_t *ctx, u16 msg_type,
+                                      u8 min_len,
+                                      sbp_zmq_rx_view_trampoline_t trampoline,
+                                      sbp_zmq_rx_view_fn_t cb, void *context,
+                                      sbp_msg_callbacks_node_t **node);
+
+/**
+ * @brief   Register an SBP message callback for all message types.
+ * @details Register a callback function to be executed when any SBP message
+ *          has been received. These callbacks are executed after those
+ *          registered for the specific message type.
+ *
+ * @param[in] ctx           Pointer to the context to use.
+ * @param[in] cb            Callback function to execute.
+ * @param[in] context       Callback context.
+ * @param[out] node         Double pointer to be set to the allocated
+ *                          callback node. Required to remove the callback
+ *                          using sbp_zmq_rx_any_callback_remove(). May be
+ *                          NULL if unused.
+ *
+ * @return                  The operation result.
+ * @retval 0                The callback was registered successfully.
+ * @retval -1               An error occurred.
+ */
+int sbp_zmq_rx_any_callback_register(sbp_zmq_rx_ctx_t *ctx,
+                                     sbp_zmq_rx_any_callback_t cb,
+                                     void *context,
+                                     sbp_zmq_rx_any_node_t **node);
+
+/**
+ * @brief   Remove an SBP message callback for all message types.
+ * @details Remove a callback registered with
+ *          sbp_zmq_rx_any_callback_register().
+ *
+ * @note    May be called from any callback of the context, as with
+ *          sbp_zmq_rx_callback_remove().
+ * @note    The node pointer will be set to NULL by this function on success.
+ *
+ * @param[in] ctx           Pointer to the context to use.
+ * @param[inout] node       Double pointer to the callback node to remove.
+ *
+ * @return                  The operation result.
+ * @retval 0                The callback was removed successfully.
+ * @retval -1               An error occurred.
+ */
+int sbp_zmq_rx_any_callback_remove(sbp_zmq_rx_ctx_t *ctx,
+                                   sbp_zmq_rx_any_node_t **node);
+
 /**
  * @brief   Read and process incoming data.
  * @details Read and process a single incoming ZMQ message.
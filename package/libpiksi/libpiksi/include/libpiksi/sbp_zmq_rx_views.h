@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2017 Swift Navigation Inc.
+ * Contact: Jacob McNamee <jacob@swiftnav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/**
+ * @file    sbp_zmq_rx_views.h
+ * @brief   Typed SBP ZMQ RX view callbacks.
+ *
+ * @defgroup    sbp_zmq_rx_views SBP ZMQ RX Views
+ * @addtogroup  sbp_zmq_rx_views
+ * @{
+ */
+
+#ifndef LIBPIKSI_SBP_ZMQ_RX_VIEWS_H
+#define LIBPIKSI_SBP_ZMQ_RX_VIEWS_H
+
+#include <libpiksi/sbp_zmq_rx.h>
+#include <libpiksi/settings_protocol.h>
+#include <libsbp/navigation.h>
+#include <libsbp/observation.h>
+#include <libsbp/piksi.h>
+#include <libsbp/settings.h>
+
+/* Add further message types here as daemons need them. Messages carrying
+ * only null terminated strings have zero sized structs, the callback then
+ * checks termination against len. */
+
+SBP_ZMQ_RX_VIEW_DEFINE(gps_time, SBP_MSG_GPS_TIME, msg_gps_time_t)
+
+SBP_ZMQ_RX_VIEW_DEFINE(obs, SBP_MSG_OBS, msg_obs_t)
+SBP_ZMQ_RX_VIEW_DEFINE(ephemeris_gps, SBP_MSG_EPHEMERIS_GPS,
+                       msg_ephemeris_gps_t)
+SBP_ZMQ_RX_VIEW_DEFINE(ephemeris_glo, SBP_MSG_EPHEMERIS_GLO,
+                       msg_ephemeris_glo_t)
+
+SBP_ZMQ_RX_VIEW_DEFINE(command_req, SBP_MSG_COMMAND_REQ, msg_command_req_t)
+
+SBP_ZMQ_RX_VIEW_DEFINE(settings_write, SBP_MSG_SETTINGS_WRITE,
+                       msg_settings_write_t)
+SBP_ZMQ_RX_VIEW_DEFINE(settings_read_req, SBP_MSG_SETTINGS_READ_REQ,
+                       msg_settings_read_req_t)
+SBP_ZMQ_RX_VIEW_DEFINE(settings_read_resp, SBP_MSG_SETTINGS_READ_RESP,
+                       msg_settings_read_resp_t)
+SBP_ZMQ_RX_VIEW_DEFINE(settings_read_by_index_req,
+                       SBP_MSG_SETTINGS_READ_BY_INDEX_REQ,
+                       msg_settings_read_by_index_req_t)
+SBP_ZMQ_RX_VIEW_DEFINE(settings_read_by_index_resp,
+                       SBP_MSG_SETTINGS_READ_BY_INDEX_RESP,
+                       msg_settings_read_by_index_resp_t)
+SBP_ZMQ_RX_VIEW_DEFINE(settings_register, SBP_MSG_SETTINGS_REGISTER,
+                       msg_settings_register_t)
+SBP_ZMQ_RX_VIEW_DEFINE(settings_typed_write, SBP_MSG_SETTINGS_TYPED_WRITE,
+                       settings_typed_header_t)
+
+#endif /* LIBPIKSI_SBP_ZMQ_RX_VIEWS_H */
+
+/** @} */
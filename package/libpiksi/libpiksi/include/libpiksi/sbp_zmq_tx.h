@@ -85,6 +85,75 @@ int sbp_zmq_tx_send(sbp_zmq_tx_ctx_t *ctx, u16 msg_type, u8 len, u8 *payload);
 int sbp_zmq_tx_send_from(sbp_zmq_tx_ctx_t *ctx, u16 msg_type, u8 len,
                          u8 *payload, u16 sbp_sender_id);
 
+/**
+ * @brief   Begin a batch of SBP messages.
+ * @details Begin collecting SBP messages to be sent together by
+ *          sbp_zmq_tx_batch_flush(). Each SBP message is still sent as a
+ *          separate ZMQ message.
+ *
+ * @note    Messages sent with sbp_zmq_tx_send() while a batch is active are
+ *          sent immediately, ahead of the batch.
+ *
+ * @param[in] ctx           Pointer to the context to use.
+ *
+ * @return                  The operation result.
+ * @retval 0                The batch was started successfully.
+ * @retval -1               An error occurred.
+ */
+int sbp_zmq_tx_batch_begin(sbp_zmq_tx_ctx_t *ctx);
+
+/**
+ * @brief   Append an SBP message to the active batch.
+ * @details Encode an SBP message into the batch buffer using the default SBP
+ *          sender ID. The payload is copied and may be reused immediately.
+ *
+ * @note    If the batch buffer is full, the messages collected so far are
+ *          sent first.
+ *
+ * @param[in] ctx           Pointer to the context to use.
+ * @param[in] msg_type      Type of SBP message to send.
+ * @param[in] len           Length of the data in @p payload.
+ * @param[in] payload       Pointer to the SBP payload to send.
+ *
+ * @return                  The operation result.
+ * @retval 0                The SBP message was appended successfully.
+ * @retval -1               An error occurred.
+ */
+int sbp_zmq_tx_batch_append(sbp_zmq_tx_ctx_t *ctx, u16 msg_type, u8 len,
+                            u8 *payload);
+
+/**
+ * @brief   Append an SBP message with non-default SBP sender ID to the
+ *          active batch.
+ * @details See sbp_zmq_tx_batch_append().
+ *
+ * @param[in] ctx           Pointer to the context to use.
+ * @param[in] msg_type      Type of SBP message to send.
+ * @param[in] len           Length of the data in @p payload.
+ * @param[in] payload       Pointer to the SBP payload to send.
+ * @param[in] sbp_sender_id SBP sender ID to use.
+ *
+ * @return                  The operation result.
+ * @retval 0                The SBP message was appended successfully.
+ * @retval -1               An error occurred.
+ */
+int sbp_zmq_tx_batch_append_from(sbp_zmq_tx_ctx_t *ctx, u16 msg_type, u8 len,
+                                 u8 *payload, u16 sbp_sender_id);
+
+/**
+ * @brief   Send the active batch of SBP messages.
+ * @details Send all SBP messages appended since sbp_zmq_tx_batch_begin() and
+ *          end the batch.
+ *
+ * @param[in] ctx           Pointer to the context to use.
+ *
+ * @return                  The operation result.
+ * @retval 0                The SBP messages were sent successfully.
+ * @retval -1               An error occurred. Messages not yet sent are
+ *                          discarded.
+ */
+int sbp_zmq_tx_batch_flush(sbp_zmq_tx_ctx_t *ctx);
+
 #endif /* LIBPIKSI_SBP_ZMQ_TX_H */
 
 /** @} */
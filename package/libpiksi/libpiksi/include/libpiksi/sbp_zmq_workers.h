@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2017 Swift Navigation Inc.
+ * Contact: Jacob McNamee <jacob@swiftnav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/**
+ * @file    sbp_zmq_workers.h
+ * @brief   SBP ZMQ worker pool API.
+ *
+ * @defgroup    sbp_zmq_workers SBP ZMQ Workers
+ * @addtogroup  sbp_zmq_workers
+ * @{
+ */
+
+#ifndef LIBPIKSI_SBP_ZMQ_WORKERS_H
+#define LIBPIKSI_SBP_ZMQ_WORKERS_H
+
+#include <libpiksi/common.h>
+
+#include <libpiksi/sbp_zmq_rx.h>
+#include <libpiksi/sbp_zmq_tx.h>
+
+/**
+ * @struct  sbp_zmq_workers_ctx_t
+ *
+ * @brief   Opaque context for SBP ZMQ workers.
+ */
+typedef struct sbp_zmq_workers_ctx_s sbp_zmq_workers_ctx_t;
+
+/**
+ * @brief   Worker callback.
+ * @details Callback executed on a worker thread with a copy of the SBP
+ *          message payload and the TX context owned by that worker.
+ *
+ * @param[in] sender_id     SBP sender ID of the message.
+ * @param[in] len           Length of the data in @p msg.
+ * @param[in] msg           Copy of the SBP payload.
+ * @param[in] tx_ctx        TX context of the executing worker thread.
+ * @param[in] context       Callback context.
+ */
+typedef void (*sbp_zmq_workers_callback_t)(u16 sender_id, u8 len, u8 msg[],
+                                           sbp_zmq_tx_ctx_t *tx_ctx,
+                                           void *context);
+
+/**
+ * @brief   Trampoline converting a view to a typed worker callback.
+ * @details Generated by SBP_ZMQ_WORKERS_VIEW_DEFINE().
+ */
+typedef void (*sbp_zmq_workers_view_trampoline_t)(u16 sender_id, u8 len,
+                                                  const void *msg,
+                                                  sbp_zmq_rx_view_fn_t cb,
+                                                  sbp_zmq_tx_ctx_t *tx_ctx,
+                                                  void *context);
+
+/**
+ * @brief   Define a typed view worker callback API for an SBP message.
+ * @details Same as SBP_ZMQ_RX_VIEW_DEFINE() for the worker pool. Defines the
+ *          callback type @c sbp_zmq_workers_<name>_cb_t, taking a const
+ *          pointer to @p msg_struct and the TX context of the worker, and
+ *          the function @c sbp_zmq_workers_<name>_register() with the same
+ *          arguments as sbp_zmq_workers_callback_register(). Messages
+ *          shorter than @p msg_struct are dropped before they are queued.
+ *
+ * @see     libpiksi/sbp_zmq_workers_views.h for the definitions provided.
+ *
+ * @param   name            Name used in the generated identifiers.
+ * @param   msg_type        SBP message type.
+ * @param   msg_struct      SBP message struct type.
+ */
+#define SBP_ZMQ_WORKERS_VIEW_DEFINE(name, msg_type, msg_struct)               \
+  typedef void (*sbp_zmq_workers_##name##_cb_t)(u16 sender_id, u8 len,       \
+                                                const msg_struct *msg,        \
+                                                sbp_zmq_tx_ctx_t *tx_ctx,     \
+                                                void *context);               \
+                                                                              \
+  static inline void sbp_zmq_workers_##name##_trampoline(                     \
+      u16 sender_id, u8 len, const void *msg, sbp_zmq_rx_view_fn_t cb,        \
+      sbp_zmq_tx_ctx_t *tx_ctx, void *context)                                \
+  {                                                                           \
+    ((sbp_zmq_workers_##name##_cb_t)cb)(sender_id, len,                       \
+                                        (const msg_struct *)msg, tx_ctx,      \
+                                        context);                             \
+  }                                                                           \
+                                                                              \
+  static inline int sbp_zmq_workers_##name##_register(                        \
+      sbp_zmq_workers_ctx_t *ctx, sbp_zmq_workers_##name##_cb_t cb,           \
+      void *context)                                                          \
+  {                                                                           \
+    return sbp_zmq_workers_view_callback_register(                            \
+        ctx, msg_type, sizeof(msg_struct),                                    \
+        sbp_zmq_workers_##name##_trampoline, (sbp_zmq_rx_view_fn_t)cb,        \
+        context);                                                             \
+  }
+
+/**
+ * @brief   Create an SBP ZMQ worker pool.
+ * @details Create a pool of worker threads used to execute SBP message
+ *          callbacks which may block, such as file or process I/O, without
+ *          stalling the thread running the ZMQ loop. Each worker has its own
+ *          ZMQ PUB socket and SBP ZMQ TX context.
+ *
+ * @note    Messages are handed to the workers through an inproc queue. If the
+ *          queue is full, messages are dropped.
+ *
+ * @param[in] rx_ctx        Pointer to the RX context used to receive messages.
+ * @param[in] pub_ept       String describing the ZMQ PUB endpoint to use for
+ *                          the workers.
+ * @param[in] threads       Number of worker threads.
+ *
+ * @return                  Pointer to the created context, or NULL if the
+ *                          operation failed.
+ */
+sbp_zmq_workers_ctx_t * sbp_zmq_workers_create(sbp_zmq_rx_ctx_t *rx_ctx,
+                                               const char *pub_ept,
+                                               u32 threads);
+
+/**
+ * @brief   Destroy an SBP ZMQ worker pool.
+ * @details Stop and join the worker threads, then deinitialize and destroy
+ *          the worker pool. Callbacks registered through the pool are
+ *          removed from the RX context.
+ *
+ * @note    The RX context must still exist when this function is called.
+ * @note    The context pointer will be set to NULL by this function.
+ *
+ * @param[inout] ctx        Double pointer to the context to destroy.
+ */
+void sbp_zmq_workers_destroy(sbp_zmq_workers_ctx_t **ctx);
+
+/**
+ * @brief   Register a worker callback for an SBP message.
+ * @details Register a callback which is executed on one of the worker
+ *          threads when the specified SBP message is received.
+ *
+ * @note    Callbacks may run concurrently with each other and with the
+ *          thread running the ZMQ loop. Responses sent from different
+ *          workers are not ordered with respect to each other.
+ *
+ * @param[in] ctx           Pointer to the context to use.
+ * @param[in] msg_type      Type of SBP message to listen for.
+ * @param[in] cb            Callback function to execute.
+ * @param[in] context       Callback context.
+ *
+ * @return                  The operation result.
+ * @retval 0                The callback was registered successfully.
+ * @retval -1               An error occurred.
+ */
+int sbp_zmq_workers_callback_register(sbp_zmq_workers_ctx_t *ctx,
+                                      u16 msg_type,
+                                      sbp_zmq_workers_callback_t cb,
+                                      void *context);
+
+/**
+ * @brief   Register a view worker callback for an SBP message.
+ * @details Register a callback which is executed on one of the worker
+ *          threads through @p trampoline with a const view of the copied
+ *          payload if it is at least @p min_len bytes. Shorter messages are
+ *          dropped.
+ *
+ * @note    Use the functions generated by SBP_ZMQ_WORKERS_VIEW_DEFINE()
+ *          rather than calling this directly.
+ *
+ * @param[in] ctx           Pointer to the context to use.
+ * @param[in] msg_type      Type of SBP message to listen for.
+ * @param[in] min_len       Minimum payload length.
+ * @param[in] trampoline    Function converting the view for @p cb.
+ * @param[in] cb            Typed callback function to execute.
+ * @param[in] context       Callback context.
+ *
+ * @return                  The operation result.
+ * @retval 0                The callback was registered successfully.
+ * @retval -1               An error occurred.
+ */
+int sbp_zmq_workers_view_callback_register(
+    sbp_zmq_workers_ctx_t *ctx, u16 msg_type, u8 min_len,
+    sbp_zmq_workers_view_trampoline_t trampoline, sbp_zmq_rx_view_fn_t cb,
+    void *context);
+
+#endif /* LIBPIKSI_SBP_ZMQ_WORKERS_H */
+
+/** @} */
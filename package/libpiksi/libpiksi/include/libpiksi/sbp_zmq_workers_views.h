@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2017 Swift Navigation Inc.
+ * Contact: Jacob McNamee <jacob@swiftnav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/**
+ * @file    sbp_zmq_workers_views.h
+ * @brief   Typed SBP ZMQ worker view callbacks.
+ *
+ * @defgroup    sbp_zmq_workers_views SBP ZMQ Worker Views
+ * @addtogroup  sbp_zmq_workers_views
+ * @{
+ */
+
+#ifndef LIBPIKSI_SBP_ZMQ_WORKERS_VIEWS_H
+#define LIBPIKSI_SBP_ZMQ_WORKERS_VIEWS_H
+
+#include <libpiksi/sbp_zmq_workers.h>
+#include <libsbp/file_io.h>
+
+/* Add further message types here as daemons need them. */
+
+SBP_ZMQ_WORKERS_VIEW_DEFINE(fileio_read_req, SBP_MSG_FILEIO_READ_REQ,
+                            msg_fileio_read_req_t)
+SBP_ZMQ_WORKERS_VIEW_DEFINE(fileio_read_dir_req, SBP_MSG_FILEIO_READ_DIR_REQ,
+                            msg_fileio_read_dir_req_t)
+SBP_ZMQ_WORKERS_VIEW_DEFINE(fileio_remove, SBP_MSG_FILEIO_REMOVE,
+                            msg_fileio_remove_t)
+SBP_ZMQ_WORKERS_VIEW_DEFINE(fileio_write_req, SBP_MSG_FILEIO_WRITE_REQ,
+                            msg_fileio_write_req_t)
+
+#endif /* LIBPIKSI_SBP_ZMQ_WORKERS_VIEWS_H */
+
+/** @} */
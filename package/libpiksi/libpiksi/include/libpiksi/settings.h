@@ -56,6 +56,64 @@ enum {
  */
 typedef int (*settings_notify_fn)(void *context);
 
+/**
+ * @brief   Settings registration complete callback.
+ * @details Signature of a user-provided callback function to be executed
+ *          when all registrations of a batch have completed.
+ *
+ * @param[in] result        0 if all settings were registered successfully,
+ *                          -1 otherwise.
+ * @param[in] context       Pointer to the user-provided context.
+ */
+typedef void (*settings_register_complete_fn)(int result, void *context);
+
+/**
+ * @brief   Settings read callback.
+ * @details Signature of a user-provided callback function to be executed
+ *          for each setting returned by settings_read_all().
+ *
+ * @param[in] index         Index of the setting.
+ * @param[in] section       String describing the setting section.
+ * @param[in] name          String describing the setting name.
+ * @param[in] value         String describing the setting value.
+ * @param[in] type          String describing the setting type, or NULL.
+ * @param[in] context       Pointer to the user-provided context.
+ */
+typedef void (*settings_read_fn)(u16 index, const char *section,
+                                 const char *name, const char *value,
+                                 const char *type, void *context);
+
+/**
+ * @brief   Settings watch callback.
+ * @details Signature of a user-provided callback function to be executed
+ *          when the value of a watched setting changes.
+ *
+ * @param[in] section       String describing the setting section.
+ * @param[in] name          String describing the setting name.
+ * @param[in] value         String describing the new setting value.
+ * @param[in] context       Pointer to the user-provided context.
+ */
+typedef void (*settings_watch_fn)(const char *section, const char *name,
+                                  const char *value, void *context);
+
+/**
+ * @brief   Settings deferred notify callback.
+ * @details Signature of a user-provided callback function to be executed
+ *          once after a burst of writes to the settings of a notify group.
+ *
+ * @note    The callback is executed on the notify worker thread of the
+ *          settings context, not on the thread processing settings messages.
+ *
+ * @param[in] context       Pointer to the user-provided context.
+ *
+ * @return                  The operation result. A failed callback is
+ *                          executed again after a delay, unless a write to
+ *                          the group schedules it sooner.
+ * @retval 0                The settings were applied successfully.
+ * @retval -1               An error occurred.
+ */
+typedef int (*settings_deferred_notify_fn)(void *context);
+
 /**
  * @struct  settings_ctx_t
  *
@@ -63,6 +121,13 @@ typedef int (*settings_notify_fn)(void *context);
  */
 typedef struct settings_ctx_s settings_ctx_t;
 
+/**
+ * @struct  settings_notify_group_t
+ *
+ * @brief   Opaque group of settings sharing a deferred notify callback.
+ */
+typedef struct settings_notify_group_s settings_notify_group_t;
+
 /**
  * @brief   Create a settings context.
  * @details Create and initialize a settings context.
@@ -146,9 +211,175 @@ int settings_register_readonly(settings_ctx_t *ctx, const char *section,
                                const char *name, const void *var,
                                size_t var_len, settings_type_t type);
 
+/**
+ * @brief   Create a notify group.
+ * @details Create a group of settings sharing a deferred notify callback.
+ *          Each accepted write to a setting of the group restarts a timer of
+ *          @p debounce_ms. When it expires, @p notify is executed once on the
+ *          notify worker thread of the settings context, so a burst of
+ *          related writes results in a single, possibly slow, update which
+ *          does not stall the processing of other settings messages.
+ *
+ * @note    Before @p notify is executed, the values of the settings of the
+ *          group are copied to their applied copies, see
+ *          settings_register_grouped(). Writes to the group only wait for
+ *          this copy, not for @p notify. @p notify must read the applied
+ *          copies, not the setting variables, and must not access other
+ *          settings.
+ * @note    Groups are destroyed together with the settings context.
+ *
+ * @param[in] ctx           Pointer to the context to use.
+ * @param[in] debounce_ms   Time without writes to the group after which
+ *                          @p notify is executed, in milliseconds.
+ * @param[in] notify        Deferred notify function.
+ * @param[in] notify_context Context passed to the deferred notify function.
+ *
+ * @return                  Pointer to the created group, or NULL if the
+ *                          operation failed.
+ */
+settings_notify_group_t * settings_notify_group_create(settings_ctx_t *ctx,
+                                                       u32 debounce_ms,
+                                                       settings_deferred_notify_fn notify,
+                                                       void *notify_context);
+
+/**
+ * @brief   Register a setting in a notify group.
+ * @details Register a persistent, user-facing setting as with
+ *          settings_register(), whose writes also schedule the deferred
+ *          notify function of @p group.
+ *
+ * @note    @p notify is still executed synchronously for each write and may
+ *          be used to validate the new value. The deferred notify function
+ *          is only scheduled if the value is accepted, including the initial
+ *          value received during registration.
+ *
+ * @param[in] ctx           Pointer to the context to use.
+ * @param[in] section       String describing the setting section.
+ * @param[in] name          String describing the setting name.
+ * @param[in] var           Address of the setting variable. This location will
+ *                          be written directly by the settings module.
+ * @param[in] var_len       Size of the setting variable.
+ * @param[in] type          Type of the setting.
+ * @param[in] notify        Notify function to be executed when the setting is
+ *                          written. May be NULL if unused.
+ * @param[in] notify_context Context passed to the notify function.
+ * @param[in] group         Notify group of the setting.
+ * @param[in] var_applied   Address of a copy of the setting variable of
+ *                          @p var_len bytes. It is updated from @p var on the
+ *                          notify worker thread before the deferred notify
+ *                          function of @p group is executed.
+ *
+ * @return                  The operation result.
+ * @retval 0                The setting was registered successfully.
+ * @retval -1               An error occurred.
+ */
+int settings_register_grouped(settings_ctx_t *ctx, const char *section,
+                              const char *name, void *var, size_t var_len,
+                              settings_type_t type, settings_notify_fn notify,
+                              void *notify_context,
+                              settings_notify_group_t *group,
+                              void *var_applied);
+
+/**
+ * @brief   Begin a batch of setting registrations.
+ * @details Registrations made with settings_register() and
+ *          settings_register_readonly() after this call are sent to the
+ *          settings daemon immediately, without waiting for its reply.
+ *          Replies are collected after settings_register_batch_end().
+ *
+ * @note    Notify functions of batched settings are executed when the reply
+ *          from the daemon is processed, not during registration.
+ *
+ * @param[in] ctx           Pointer to the context to use.
+ *
+ * @return                  The operation result.
+ * @retval 0                The batch was started successfully.
+ * @retval -1               An error occurred.
+ */
+int settings_register_batch_begin(settings_ctx_t *ctx);
+
+/**
+ * @brief   End a batch of setting registrations.
+ * @details End the active batch and collect the replies of the settings
+ *          daemon, resending registrations which have not been replied to.
+ *          If a reader has been added to a ZMQ loop with
+ *          settings_reader_add(), this function returns immediately and
+ *          replies are processed by that loop. Otherwise this function
+ *          blocks until all replies have been received or retries are
+ *          exhausted.
+ *
+ * @note    @p complete may be executed from this function.
+ *
+ * @param[in] ctx           Pointer to the context to use.
+ * @param[in] complete      Callback to execute when all registrations have
+ *                          completed. May be NULL if unused.
+ * @param[in] context       Context passed to @p complete.
+ *
+ * @return                  The operation result.
+ * @retval 0                The batch was ended successfully. When blocking,
+ *                          all settings were registered successfully.
+ * @retval -1               An error occurred.
+ */
+int settings_register_batch_end(settings_ctx_t *ctx,
+                                settings_register_complete_fn complete,
+                                void *context);
+
+/**
+ * @brief   Read all settings.
+ * @details Read every setting registered with the settings daemon, in index
+ *          order. Settings are requested in ranges which the daemon streams
+ *          back to back, rather than one request per setting.
+ *
+ * @note    This function blocks until all settings have been read or the
+ *          daemon stops responding. @p read_fn is executed from this
+ *          function.
+ *
+ * @param[in] ctx           Pointer to the context to use.
+ * @param[in] read_fn       Callback to execute for each setting.
+ * @param[in] context       Context passed to @p read_fn.
+ *
+ * @return                  The operation result.
+ * @retval 0                All settings were read successfully.
+ * @retval -1               An error occurred.
+ */
+int settings_read_all(settings_ctx_t *ctx, settings_read_fn read_fn,
+                      void *context);
+
+/**
+ * @brief   Watch settings for changes.
+ * @details Register a callback to be executed when the value of any setting
+ *          in @p section whose name starts with @p name_prefix changes.
+ *          Change events are published by the settings daemon on a separate
+ *          socket and filtered by ZMQ, so messages for other settings are
+ *          not received or parsed. Several changes to a setting in quick
+ *          succession are coalesced into one event with the latest value.
+ *
+ * @note    Events are processed by the ZMQ loop passed to
+ *          settings_reader_add(). The blocking and pollitem APIs do not
+ *          process events.
+ *
+ * @param[in] ctx           Pointer to the context to use.
+ * @param[in] section       String describing the setting section.
+ * @param[in] name_prefix   Prefix of the setting names to watch, or NULL to
+ *                          watch the whole section.
+ * @param[in] watch_fn      Callback to execute when a watched setting
+ *                          changes.
+ * @param[in] context       Context passed to @p watch_fn.
+ *
+ * @return                  The operation result.
+ * @retval 0                The watch was added successfully.
+ * @retval -1               An error occurred.
+ */
+int settings_watch_add(settings_ctx_t *ctx, const char *section,
+                       const char *name_prefix, settings_watch_fn watch_fn,
+                       void *context);
+
 /**
  * @brief   Read and process incoming data.
- * @details Read and process a single incoming ZMQ message.
+ * @details Read and process a single incoming ZMQ message. Write requests
+ *          for the sections of the registered settings are received from
+ *          the settings daemon on a separate socket, see
+ *          @c SETTINGS_WRITE_SUB_ENDPOINT, and are also processed.
  *
  * @note    This function will block until a ZMQ message is received. For
  *          nonblocking operation, use the pollitem or reader APIs.
@@ -166,6 +397,10 @@ int settings_read(settings_ctx_t *ctx);
  * @details Initialize a ZMQ pollitem to be used to poll the associated ZMQ
  *          socket for pending messages.
  *
+ * @note    The pollitem does not cover write requests, which are processed
+ *          by settings_pollitem_check(). Check the pollitem periodically,
+ *          or use the reader API.
+ *
  * @see     czmq, @c zmq_poll().
  *
  * @param[in] ctx           Pointer to the context to use.
@@ -181,6 +416,7 @@ int settings_pollitem_init(settings_ctx_t *ctx, zmq_pollitem_t *pollitem);
  * @brief   Check a ZMQ pollitem.
  * @details Check a ZMQ pollitem for pending messages and read a single
  *          incoming ZMQ message from the associated socket if available.
+ *          Pending write requests are processed first.
  *
  * @see     czmq, @c zmq_poll().
  *
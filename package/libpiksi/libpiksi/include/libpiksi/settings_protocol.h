@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2017 Swift Navigation Inc.
+ * Contact: Jacob McNamee <jacob@swiftnav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/**
+ * @file    settings_protocol.h
+ * @brief   Settings protocol extensions.
+ *
+ * @defgroup    settings_protocol Settings Protocol
+ * @addtogroup  settings_protocol
+ * @{
+ */
+
+#ifndef LIBPIKSI_SETTINGS_PROTOCOL_H
+#define LIBPIKSI_SETTINGS_PROTOCOL_H
+
+#include <libpiksi/common.h>
+
+/**
+ * @brief   Maximum number of settings returned for a ranged read by index.
+ */
+#define SETTINGS_READ_BY_INDEX_COUNT_MAX 64
+
+/**
+ * @brief   Ranged read by index request.
+ * @details Payload of an @c SBP_MSG_SETTINGS_READ_BY_INDEX_REQ requesting
+ *          @p count settings starting at @p index. The settings daemon
+ *          replies with an @c SBP_MSG_SETTINGS_READ_BY_INDEX_RESP for each
+ *          setting in the range, in order, followed by
+ *          @c SBP_MSG_SETTINGS_READ_BY_INDEX_DONE if the range reaches the
+ *          last setting. @p count is limited to
+ *          @c SETTINGS_READ_BY_INDEX_COUNT_MAX.
+ *
+ * @note    A request holding only @p index is answered with a single
+ *          response, or with @c SBP_MSG_SETTINGS_READ_BY_INDEX_DONE if
+ *          @p index is past the last setting.
+ */
+typedef struct __attribute__((packed)) {
+  u16 index;              /**< Index of the first setting.                   */
+  u16 count;              /**< Number of settings to read.                   */
+} settings_read_by_index_range_t;
+
+/**
+ * @brief   Read by index done.
+ * @details Payload of an @c SBP_MSG_SETTINGS_READ_BY_INDEX_DONE sent by the
+ *          settings daemon. Responses and DONE are sent to every reader, so
+ *          a reader compares @p count with the settings it has read to tell
+ *          whether a DONE ends its own read.
+ *
+ * @note    Older daemons send DONE without payload.
+ */
+typedef struct __attribute__((packed)) {
+  u16 count;              /**< Number of registered settings.                */
+} settings_read_by_index_done_t;
+
+/**
+ * @brief   Settings change events.
+ * @details The settings daemon publishes an event on this endpoint when the
+ *          value of a setting changes. Each event is a single ZMQ frame
+ *          holding three null terminated strings: section, name and value.
+ *          Changes to a setting within a short window are coalesced into a
+ *          single event carrying the latest value.
+ *
+ * @note    Subscribe to "<section>\0" for all settings of a section, or to
+ *          "<section>\0<prefix>" for settings whose name starts with
+ *          @c prefix. Filtering is done by ZMQ, so unrelated events are never
+ *          delivered.
+ */
+#define SETTINGS_WATCH_PUB_ENDPOINT "@tcp://127.0.0.1:43090"
+#define SETTINGS_WATCH_SUB_ENDPOINT ">tcp://127.0.0.1:43090"
+
+/**
+ * @brief   Settings write requests.
+ * @details The settings daemon forwards each @c SBP_MSG_SETTINGS_WRITE sent
+ *          by the console, and each write it sends itself in reply to a
+ *          registration or during a snapshot import, on this endpoint. Each
+ *          request is a single ZMQ frame holding the write payload: section,
+ *          name and value as null terminated strings. Requests are not
+ *          coalesced.
+ *
+ * @note    libpiksi settings clients subscribe to "<section>\0" for each
+ *          section they own and no longer receive @c SBP_MSG_SETTINGS_WRITE,
+ *          so writes to the settings of other processes are never
+ *          delivered to them. The firmware still receives writes over SBP.
+ */
+#define SETTINGS_WRITE_PUB_ENDPOINT "@tcp://127.0.0.1:43091"
+#define SETTINGS_WRITE_SUB_ENDPOINT ">tcp://127.0.0.1:43091"
+
+/**
+ * @brief   Typed settings messages.
+ * @details Read and write numeric settings in their binary representation,
+ *          without formatting or parsing strings. Messages are exchanged
+ *          directly with the process owning the setting:
+ *          - @c SBP_MSG_SETTINGS_TYPED_WRITE: a settings_typed_header_t with
+ *            @c status set to zero, the value, then two null terminated
+ *            strings: section and name.
+ *          - @c SBP_MSG_SETTINGS_TYPED_READ_REQ: two null terminated strings:
+ *            section and name.
+ *          - @c SBP_MSG_SETTINGS_TYPED_READ_RESP: sent in reply to both, in
+ *            the same layout as a write. Holds the current value and a
+ *            @c SETTINGS_TYPED_STATUS_* result. Settings which have no binary
+ *            representation are reported as @c SETTINGS_TYPED_NONE without
+ *            a value.
+ *
+ * @note    Values are little endian and their size is given by the type,
+ *          see settings_typed_size(). Tools are expected to read the type of
+ *          each setting once and cache it for subsequent writes. No type
+ *          cache is kept by libpiksi or the settings daemon.
+ * @note    Only settings registered through libpiksi answer typed messages.
+ *          The router forwards them to the firmware along with other
+ *          external traffic, but the firmware does not implement them, so
+ *          requests for settings it owns go unanswered. Tools should fall
+ *          back to the string messages when no response arrives, and use
+ *          @c SBP_MSG_SETTINGS_READ_BY_INDEX_REQ to learn which settings
+ *          exist.
+ * @note    Accepted writes are also reported with
+ *          @c SBP_MSG_SETTINGS_READ_RESP, so the settings daemon stores the
+ *          new value.
+ */
+#define SBP_MSG_SETTINGS_TYPED_WRITE     0x02A0
+#define SBP_MSG_SETTINGS_TYPED_READ_REQ  0x02A4
+#define SBP_MSG_SETTINGS_TYPED_READ_RESP 0x02A5
+
+/**
+ * @brief   Typed settings value types.
+ */
+enum {
+  SETTINGS_TYPED_NONE,    /**< No binary representation.                     */
+  SETTINGS_TYPED_S8,      /**< 8 bit signed integer.                         */
+  SETTINGS_TYPED_S16,     /**< 16 bit signed integer.                        */
+  SETTINGS_TYPED_S32,     /**< 32 bit signed integer.                        */
+  SETTINGS_TYPED_FLOAT,   /**< Single precision float.                       */
+  SETTINGS_TYPED_DOUBLE,  /**< Double precision float.                       */
+  SETTINGS_TYPED_ENUM     /**< 8 bit index of an enum or boolean value.      */
+};
+
+/**
+ * @brief   Typed settings results.
+ */
+enum {
+  SETTINGS_TYPED_STATUS_OK,         /**< Value read or written.              */
+  SETTINGS_TYPED_STATUS_REJECTED,   /**< Written value was rejected.         */
+  SETTINGS_TYPED_STATUS_TYPE_MISMATCH, /**< Type differs from the setting.   */
+  SETTINGS_TYPED_STATUS_READONLY    /**< Setting is read-only.               */
+};
+
+/**
+ * @brief   Typed settings message header.
+ */
+typedef struct __attribute__((packed)) {
+  u8 type;                /**< Value type, SETTINGS_TYPED_*.                 */
+  u8 status;              /**< Result, SETTINGS_TYPED_STATUS_*.              */
+} settings_typed_header_t;
+
+/**
+ * @brief   Get the size of a typed settings value.
+ *
+ * @param[in] type          Value type, SETTINGS_TYPED_*.
+ *
+ * @return                  The size of the value in bytes, or 0 if the type
+ *                          has no binary representation.
+ */
+static inline u8 settings_typed_size(u8 type)
+{
+  switch (type) {
+  case SETTINGS_TYPED_S8:     return 1;
+  case SETTINGS_TYPED_S16:    return 2;
+  case SETTINGS_TYPED_S32:    return 4;
+  case SETTINGS_TYPED_FLOAT:  return 4;
+  case SETTINGS_TYPED_DOUBLE: return 8;
+  case SETTINGS_TYPED_ENUM:   return 1;
+  default:                    return 0;
+  }
+}
+
+/**
+ * @brief   Settings snapshots.
+ * @details A snapshot holds the values of all registered settings in a
+ *          single file, which is transferred with the SBP file I/O messages.
+ *          - @c SBP_MSG_SETTINGS_SNAPSHOT_EXPORT_REQ: null terminated path of
+ *            the file to write. With an empty payload, only the hash of the
+ *            current configuration is returned.
+ *          - @c SBP_MSG_SETTINGS_SNAPSHOT_IMPORT_REQ: a
+ *            @c SETTINGS_SNAPSHOT_IMPORT_* flags byte followed by the null
+ *            terminated path of the snapshot to apply.
+ *          - @c SBP_MSG_SETTINGS_SNAPSHOT_RESP: a settings_snapshot_resp_t,
+ *            followed by the section and name of the first rejected setting
+ *            if an import was rejected.
+ *
+ *          The file holds a settings_snapshot_header_t followed by @c count
+ *          entries of three null terminated strings: section, name and
+ *          value. Entries are sorted by section, then name, so that equal
+ *          configurations give identical files and hashes. The hash is the
+ *          64 bit FNV-1a hash of the entries.
+ *
+ * @note    An import is checked as a whole before any value is written: an
+ *          invalid file, a hash mismatch or an unknown setting rejects it
+ *          without changes. Only values which differ from the current ones
+ *          are written, so only the notify functions of those settings are
+ *          executed. If the owner of a setting rejects its new value, all
+ *          values written by the import are restored unless
+ *          @c SETTINGS_SNAPSHOT_IMPORT_PARTIAL is set.
+ * @note    Read-only settings are included in snapshots. Their owners reject
+ *          any other value, so remove them from snapshots applied to other
+ *          devices, or use @c SETTINGS_SNAPSHOT_IMPORT_PARTIAL.
+ */
+#define SBP_MSG_SETTINGS_SNAPSHOT_EXPORT_REQ 0x02A1
+#define SBP_MSG_SETTINGS_SNAPSHOT_IMPORT_REQ 0x02A2
+#define SBP_MSG_SETTINGS_SNAPSHOT_RESP       0x02A3
+
+#define SETTINGS_SNAPSHOT_MAGIC   0x53535350  /**< "PSSS", little endian     */
+#define SETTINGS_SNAPSHOT_VERSION 1
+
+/**
+ * @brief   Settings snapshot import flags.
+ */
+enum {
+  SETTINGS_SNAPSHOT_IMPORT_PARTIAL = 0x01 /**< Keep accepted values when a
+                                               value is rejected.            */
+};
+
+/**
+ * @brief   Settings snapshot results.
+ */
+enum {
+  SETTINGS_SNAPSHOT_STATUS_OK,              /**< Operation completed.        */
+  SETTINGS_SNAPSHOT_STATUS_BUSY,            /**< An import is in progress.   */
+  SETTINGS_SNAPSHOT_STATUS_IO_ERROR,        /**< File could not be accessed. */
+  SETTINGS_SNAPSHOT_STATUS_INVALID,         /**< Malformed file or hash
+                                                 mismatch.                   */
+  SETTINGS_SNAPSHOT_STATUS_UNKNOWN_SETTING, /**< Setting is not registered.  */
+  SETTINGS_SNAPSHOT_STATUS_REJECTED,        /**< Value rejected by its owner.*/
+  SETTINGS_SNAPSHOT_STATUS_TIMEOUT          /**< Owner did not reply.        */
+};
+
+/**
+ * @brief   Settings snapshot file header.
+ */
+typedef struct __attribute__((packed)) {
+  u32 magic;              /**< SETTINGS_SNAPSHOT_MAGIC.                      */
+  u16 version;            /**< SETTINGS_SNAPSHOT_VERSION.                    */
+  u16 count;              /**< Number of entries.                            */
+  u64 hash;               /**< FNV-1a hash of the entries.                   */
+} settings_snapshot_header_t;
+
+/**
+ * @brief   Settings snapshot response.
+ */
+typedef struct __attribute__((packed)) {
+  u8 status;              /**< Result, SETTINGS_SNAPSHOT_STATUS_*.           */
+  u16 count;              /**< Number of registered settings.                */
+  u16 changed;            /**< Number of values written by an import.        */
+  u16 rejected;           /**< Number of values rejected during an import.   */
+  u64 hash;               /**< Hash of the current configuration.            */
+} settings_snapshot_resp_t;
+
+#endif /* LIBPIKSI_SETTINGS_PROTOCOL_H */
+
+/** @} */
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2017 Swift Navigation Inc.
+ * Contact: Jacob McNamee <jacob@swiftnav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+/**
+ * @file    timer_wheel.h
+ * @brief   Timer wheel API.
+ *
+ * @defgroup    timer_wheel Timer Wheel
+ * @addtogroup  timer_wheel
+ * @{
+ */
+
+#ifndef LIBPIKSI_TIMER_WHEEL_H
+#define LIBPIKSI_TIMER_WHEEL_H
+
+#include <libpiksi/common.h>
+
+/**
+ * @struct  timer_wheel_t
+ *
+ * @brief   Opaque context for a timer wheel.
+ */
+typedef struct timer_wheel_s timer_wheel_t;
+
+/**
+ * @struct  timer_wheel_timer_t
+ *
+ * @brief   Opaque timer belonging to a timer wheel.
+ */
+typedef struct timer_wheel_timer_s timer_wheel_timer_t;
+
+/**
+ * @brief   Timer handler.
+ * @details Handler executed from the ZMQ loop when a timer expires.
+ *
+ * @note    The handler may start, stop or destroy any timer, including
+ *          @p timer. It must not destroy the timer wheel.
+ *
+ * @param[in] timer         Pointer to the expired timer.
+ * @param[in] context       Timer context.
+ */
+typedef void (*timer_wheel_handler_t)(timer_wheel_timer_t *timer,
+                                      void *context);
+
+/**
+ * @brief   Create a timer wheel.
+ * @details Create a timer wheel driven by the specified ZMQ loop. Timers are
+ *          kept in a hashed wheel with slots of @p resolution_ms, giving
+ *          constant time start and stop. The ZMQ loop is only woken when a
+ *          slot holding a timer is reached, not on every tick.
+ *
+ * @param[in] zloop         Pointer to the ZMQ loop to use.
+ * @param[in] resolution_ms Timer resolution in milliseconds.
+ *
+ * @return                  Pointer to the created context, or NULL if the
+ *                          operation failed.
+ */
+timer_wheel_t * timer_wheel_create(zloop_t *zloop, u32 resolution_ms);
+
+/**
+ * @brief   Destroy a timer wheel.
+ * @details Deinitialize and destroy a timer wheel. Active timers are
+ *          stopped.
+ *
+ * @note    Timers are not destroyed and must still be destroyed using
+ *          timer_wheel_timer_destroy().
+ * @note    The context pointer will be set to NULL by this function.
+ *
+ * @param[inout] wheel      Double pointer to the context to destroy.
+ */
+void timer_wheel_destroy(timer_wheel_t **wheel);
+
+/**
+ * @brief   Create a timer.
+ * @details Create a stopped timer on the specified timer wheel.
+ *
+ * @param[in] wheel         Pointer to the timer wheel to use.
+ * @param[in] handler       Handler to execute when the timer expires.
+ * @param[in] context       Timer context.
+ *
+ * @return                  Pointer to the created timer, or NULL if the
+ *                          operation failed.
+ */
+timer_wheel_timer_t * timer_wheel_timer_create(timer_wheel_t *wheel,
+                                               timer_wheel_handler_t handler,
+                                               void *context);
+
+/**
+ * @brief   Destroy a timer.
+ * @details Stop and destroy a timer.
+ *
+ * @note    The timer pointer will be set to NULL by this function.
+ *
+ * @param[inout] timer      Double pointer to the timer to destroy.
+ */
+void timer_wheel_timer_destroy(timer_wheel_timer_t **timer);
+
+/**
+ * @brief   Start a timer.
+ * @details Start or restart a timer to expire after @p delay_ms, then every
+ *          @p period_ms if @p period_ms is nonzero. Periodic timers are
+ *          scheduled relative to their previous deadline, so handler latency
+ *          does not accumulate. Deadlines missed entirely are skipped.
+ *
+ * @param[in] timer         Pointer to the timer to start.
+ * @param[in] delay_ms      Delay until the first expiry in milliseconds.
+ * @param[in] period_ms     Period in milliseconds, or 0 for a one-shot timer.
+ */
+void timer_wheel_timer_start(timer_wheel_timer_t *timer, u32 delay_ms,
+                             u32 period_ms);
+
+/**
+ * @brief   Stop a timer.
+ * @details Stop a timer if it is running.
+ *
+ * @param[in] timer         Pointer to the timer to stop.
+ */
+void timer_wheel_timer_stop(timer_wheel_timer_t *timer);
+
+/**
+ * @brief   Get the number of missed periods of a timer.
+ * @details Returns the number of deadlines of a periodic timer which were
+ *          skipped because the loop was late by more than one period.
+ *
+ * @param[in] timer         Pointer to the timer to use.
+ *
+ * @return                  The number of missed periods.
+ */
+u32 timer_wheel_timer_missed_get(timer_wheel_timer_t *timer);
+
+/**
+ * @brief   Get the loop lag.
+ * @details Returns how late the ZMQ loop serviced the timer wheel, i.e. the
+ *          time between a deadline and the execution of its handlers. This is
+ *          a measure of the time spent in other handlers on the same loop.
+ *
+ * @param[in] wheel         Pointer to the timer wheel to use.
+ * @param[out] last_us      Lag of the most recent wakeup in microseconds.
+ *                          May be NULL if unused.
+ * @param[out] max_us       Maximum lag since the previous call in
+ *                          microseconds. May be NULL if unused.
+ */
+void timer_wheel_lag_get(timer_wheel_t *wheel, u32 *last_us, u32 *max_us);
+
+#endif /* LIBPIKSI_TIMER_WHEEL_H */
+
+/** @} */
@@ -24,6 +24,16 @@
 
 #include <libpiksi/common.h>
 
+/**
+ * @brief   Initial value of a 32 bit FNV-1a hash.
+ */
+#define FNV1A_32_INIT 2166136261u
+
+/**
+ * @brief   Initial value of a 64 bit FNV-1a hash.
+ */
+#define FNV1A_64_INIT 14695981039346656037ULL
+
 /**
  * @brief   Get the SBP sender ID for the system.
  * @details Returns the board-specific SBP sender ID.
@@ -69,6 +79,32 @@ int zmq_simple_loop(zloop_t *zloop);
  */
 int zmq_simple_loop_timeout(zloop_t *zloop, u32 timeout_ms);
 
+/**
+ * @brief   Update a 32 bit FNV-1a hash.
+ * @details Hashes @p len bytes at @p data into @p hash. Start from
+ *          FNV1A_32_INIT. Data split over several calls hashes the same as
+ *          in a single call.
+ *
+ * @param[in] hash          Hash value to update.
+ * @param[in] data          Pointer to the data to hash.
+ * @param[in] len           Number of bytes to hash.
+ *
+ * @return                  The updated hash value.
+ */
+u32 fnv1a_32_update(u32 hash, const void *data, size_t len);
+
+/**
+ * @brief   Update a 64 bit FNV-1a hash.
+ * @details Like fnv1a_32_update(), starting from FNV1A_64_INIT.
+ *
+ * @param[in] hash          Hash value to update.
+ * @param[in] data          Pointer to the data to hash.
+ * @param[in] len           Number of bytes to hash.
+ *
+ * @return                  The updated hash value.
+ */
+u64 fnv1a_64_update(u64 hash, const void *data, size_t len);
+
 #endif /* LIBPIKSI_UTIL_H */
 
 /** @} */
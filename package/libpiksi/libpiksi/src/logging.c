@@ -11,31 +11,367 @@
  */
 
 #include <libpiksi/logging.h>
+#include <libsbp/logging.h>
 #include <syslog.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <assert.h>
 
 #define FACILITY LOG_LOCAL0
 #define OPTIONS (LOG_CONS | LOG_PID | LOG_NDELAY)
 
+#define QUEUE_SIZE 128
+#define QUEUE_MASK (QUEUE_SIZE - 1)
+#define TEXT_SIZE 256
+
+#define SBP_PAYLOAD_SIZE_MAX 255
+
+/* Bounded multi-producer queue. Each entry holds a sequence number which
+ * tells producers and the consumer whose turn it is, so no lock is taken on
+ * the logging path. The consumer is woken through a semaphore, which only
+ * enters the kernel when the consumer is waiting. Producers are counted
+ * while they use the queue so that stopping the consumer can wait for
+ * them. */
+typedef struct {
+  u32 seq;
+  u8 priority;
+  u8 length;
+  u64 timestamp_us;
+  char text[TEXT_SIZE];
+} entry_t;
+
+static struct {
+  entry_t entries[QUEUE_SIZE];
+  u32 enqueue_pos;
+  u32 dequeue_pos;
+  u32 dropped;
+  u32 producers;
+  sem_t sem;
+  bool sem_initialized;
+  pthread_t thread;
+  bool running;
+  bool stop;
+  int binary_fd;
+  pthread_mutex_t binary_fd_lock;
+  pid_t pid;
+} queue = {
+  .binary_fd = -1,
+  .binary_fd_lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static u64 timestamp_us_get(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (u64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static u64 monotonic_ms_get(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static bool enqueue(int priority, const char *format, va_list ap)
+{
+  u32 pos = __atomic_load_n(&queue.enqueue_pos, __ATOMIC_RELAXED);
+  entry_t *e;
+
+  while (1) {
+    e = &queue.entries[pos & QUEUE_MASK];
+    u32 seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+    s32 diff = (s32)(seq - pos);
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&queue.enqueue_pos, &pos, pos + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (diff < 0) {
+      /* Full */
+      return false;
+    } else {
+      pos = __atomic_load_n(&queue.enqueue_pos, __ATOMIC_RELAXED);
+    }
+  }
+
+  int length = vsnprintf(e->text, sizeof(e->text), format, ap);
+  if (length < 0) {
+    length = 0;
+  } else if (length > TEXT_SIZE - 1) {
+    length = TEXT_SIZE - 1;
+  }
+  e->priority = priority;
+  e->length = length;
+  e->timestamp_us = timestamp_us_get();
+
+  __atomic_store_n(&e->seq, pos + 1, __ATOMIC_RELEASE);
+  sem_post(&queue.sem);
+  return true;
+}
+
+/* Only called from the logging thread, or once it has been joined */
+static void entry_write(int priority, u64 timestamp_us, const char *text,
+                        u8 length)
+{
+  pthread_mutex_lock(&queue.binary_fd_lock);
+  int fd = queue.binary_fd;
+  if (fd < 0) {
+    pthread_mutex_unlock(&queue.binary_fd_lock);
+    syslog(priority, "%.*s", (int)length, text);
+    return;
+  }
+
+  struct {
+    logging_record_header_t header;
+    char text[TEXT_SIZE];
+  } __attribute__((packed)) record = {
+    .header = {
+      .timestamp_us = timestamp_us,
+      .pid = queue.pid,
+      .priority = priority,
+      .length = length
+    }
+  };
+  memcpy(record.text, text, length);
+  ssize_t ret = write(fd, &record, sizeof(record.header) + length);
+  pthread_mutex_unlock(&queue.binary_fd_lock);
+
+  if (ret < 0) {
+    syslog(priority, "%.*s", (int)length, text);
+  }
+}
+
+static bool dequeue(void)
+{
+  entry_t *e = &queue.entries[queue.dequeue_pos & QUEUE_MASK];
+  u32 seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+  if (seq != queue.dequeue_pos + 1) {
+    return false;
+  }
+
+  entry_write(e->priority, e->timestamp_us, e->text, e->length);
+
+  __atomic_store_n(&e->seq, queue.dequeue_pos + QUEUE_SIZE, __ATOMIC_RELEASE);
+  queue.dequeue_pos++;
+  return true;
+}
+
+static void dropped_report(void)
+{
+  u32 dropped = __atomic_exchange_n(&queue.dropped, 0, __ATOMIC_RELAXED);
+  if (dropped > 0) {
+    char text[64];
+    int length = snprintf(text, sizeof(text),
+                          "%u log messages dropped", dropped);
+    entry_write(LOG_WARNING, timestamp_us_get(), text, length);
+  }
+}
+
+static void * logging_thread(void *arg)
+{
+  (void)arg;
+
+  while (1) {
+    while (sem_wait(&queue.sem) != 0) {
+      /* Interrupted */
+    }
+
+    while (dequeue()) {
+      /* Drain */
+    }
+    dropped_report();
+
+    if (__atomic_load_n(&queue.stop, __ATOMIC_ACQUIRE)) {
+      return NULL;
+    }
+  }
+}
+
+static void logging_thread_stop(void)
+{
+  if (!queue.running || (getpid() != queue.pid)) {
+    return;
+  }
+
+  /* Log synchronously from now on and wait for producers which still saw
+   * the thread running. They do not block, so this is short. */
+  __atomic_store_n(&queue.running, false, __ATOMIC_SEQ_CST);
+  while (__atomic_load_n(&queue.producers, __ATOMIC_SEQ_CST) != 0) {
+    sched_yield();
+  }
+
+  __atomic_store_n(&queue.stop, true, __ATOMIC_RELEASE);
+  sem_post(&queue.sem);
+  pthread_join(queue.thread, NULL);
+
+  /* The thread may have checked for entries before the last producers
+   * published theirs. The semaphore is not destroyed, other threads may
+   * still be running while the process exits. */
+  while (dequeue()) {
+    /* Drain */
+  }
+  dropped_report();
+}
+
+static void atfork_child(void)
+{
+  /* The logging thread and the other producers do not exist in the child */
+  queue.running = false;
+  queue.producers = 0;
+}
+
 int logging_init(const char *identity)
 {
   openlog(identity, OPTIONS, FACILITY);
+
+  if (queue.running) {
+    return 0;
+  }
+
+  for (u32 i = 0; i < QUEUE_SIZE; i++) {
+    queue.entries[i].seq = i;
+  }
+  queue.enqueue_pos = 0;
+  queue.dequeue_pos = 0;
+  queue.dropped = 0;
+  queue.stop = false;
+  queue.pid = getpid();
+
+  if (!queue.sem_initialized) {
+    if (sem_init(&queue.sem, 0, 0) != 0) {
+      syslog(LOG_ERR, "error initializing logging semaphore");
+      return 0;
+    }
+    queue.sem_initialized = true;
+  }
+
+  if (pthread_create(&queue.thread, NULL, logging_thread, NULL) != 0) {
+    syslog(LOG_ERR, "error creating logging thread");
+    return 0;
+  }
+
+  static bool registered = false;
+  if (!registered) {
+    pthread_atfork(NULL, NULL, atfork_child);
+    atexit(logging_thread_stop);
+    registered = true;
+  }
+
+  __atomic_store_n(&queue.running, true, __ATOMIC_RELEASE);
   return 0;
 }
 
 void logging_deinit(void)
 {
+  logging_thread_stop();
+  logging_binary_output_set(NULL);
   closelog();
 }
 
+int logging_binary_output_set(const char *path)
+{
+  int fd = -1;
+  if (path != NULL) {
+    fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_NONBLOCK | O_CLOEXEC,
+              0644);
+    if (fd < 0) {
+      syslog(LOG_ERR, "error opening %s", path);
+      return -1;
+    }
+  }
+
+  /* The previous descriptor may be in use by the logging thread */
+  pthread_mutex_lock(&queue.binary_fd_lock);
+  int old_fd = queue.binary_fd;
+  queue.binary_fd = fd;
+  pthread_mutex_unlock(&queue.binary_fd_lock);
+
+  if (old_fd >= 0) {
+    close(old_fd);
+  }
+
+  return 0;
+}
+
+bool piksi_log_ratelimit_check(piksi_log_ratelimit_t *rl, int priority)
+{
+  u64 now_ms = monotonic_ms_get();
+  u64 window_start_ms = __atomic_load_n(&rl->window_start_ms,
+                                        __ATOMIC_RELAXED);
+
+  /* Races between threads may let a few extra messages through */
+  if ((window_start_ms == 0) || (now_ms - window_start_ms >= rl->interval_ms)) {
+    __atomic_store_n(&rl->window_start_ms, now_ms, __ATOMIC_RELAXED);
+    __atomic_store_n(&rl->count, 0, __ATOMIC_RELAXED);
+    u32 suppressed = __atomic_exchange_n(&rl->suppressed, 0, __ATOMIC_RELAXED);
+    if (suppressed > 0) {
+      piksi_log(priority, "%u similar messages suppressed", suppressed);
+    }
+  }
+
+  if (__atomic_fetch_add(&rl->count, 1, __ATOMIC_RELAXED) < rl->burst) {
+    return true;
+  }
+
+  __atomic_fetch_add(&rl->suppressed, 1, __ATOMIC_RELAXED);
+  return false;
+}
+
 void piksi_log(int priority, const char *format, ...)
 {
   va_list ap;
   va_start(ap, format);
-  vsyslog(priority, format, ap);
+  piksi_vlog(priority, format, ap);
   va_end(ap);
 }
 
 void piksi_vlog(int priority, const char *format, va_list ap)
 {
-  vsyslog(priority, format, ap);
+  /* Counted before checking for the thread, see logging_thread_stop() */
+  __atomic_fetch_add(&queue.producers, 1, __ATOMIC_SEQ_CST);
+  if (!__atomic_load_n(&queue.running, __ATOMIC_SEQ_CST)) {
+    __atomic_fetch_sub(&queue.producers, 1, __ATOMIC_RELEASE);
+    vsyslog(priority, format, ap);
+    return;
+  }
+
+  if (!enqueue(priority, format, ap)) {
+    __atomic_fetch_add(&queue.dropped, 1, __ATOMIC_RELAXED);
+  }
+  __atomic_fetch_sub(&queue.producers, 1, __ATOMIC_RELEASE);
+}
+
+int sbp_log(sbp_zmq_tx_ctx_t *tx_ctx, int priority, const char *format, ...)
+{
+  va_list ap;
+  va_start(ap, format);
+  int ret = sbp_vlog(tx_ctx, priority, format, ap);
+  va_end(ap);
+  return ret;
+}
+
+int sbp_vlog(sbp_zmq_tx_ctx_t *tx_ctx, int priority, const char *format,
+             va_list ap)
+{
+  assert(tx_ctx != NULL);
+
+  u8 buf[SBP_PAYLOAD_SIZE_MAX + 1];
+  msg_log_t *msg = (msg_log_t *)buf;
+  msg->level = priority;
+
+  /* Text is not null terminated in the message */
+  size_t text_size_max = SBP_PAYLOAD_SIZE_MAX - sizeof(*msg);
+  int length = vsnprintf(msg->text, text_size_max + 1, format, ap);
+  if (length < 0) {
+    return -1;
+  } else if ((size_t)length > text_size_max) {
+    length = text_size_max;
+  }
+
+  return sbp_zmq_tx_send(tx_ctx, SBP_MSG_LOG, sizeof(*msg) + length, buf);
 }
@@ -78,7 +78,8 @@ sbp_zmq_pubsub_ctx_t * sbp_zmq_pubsub_create(const char *pub_ept,
     return ctx;
   }
 
-  ctx->zsock_sub = zsock_new_sub(sub_ept, "");
+  /* Subscriptions are managed by the RX context */
+  ctx->zsock_sub = zsock_new_sub(sub_ept, NULL);
   if (ctx->zsock_sub == NULL) {
     piksi_log(LOG_ERR, "error creating SUB socket");
     destroy(&ctx);
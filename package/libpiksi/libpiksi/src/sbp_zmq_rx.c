@@ -13,16 +13,173 @@
 #include <libpiksi/sbp_zmq_rx.h>
 #include <libpiksi/util.h>
 #include <libpiksi/logging.h>
+#include <libsbp/edc.h>
 #include <assert.h>
 
+#define SBP_HEADER_SIZE   6
+#define SBP_CRC_SIZE      2
+
+#define DISPATCH_BUCKETS_INIT 16
+
+struct sbp_zmq_rx_any_node_s {
+  sbp_zmq_rx_any_callback_t cb;
+  void *context;
+  struct sbp_zmq_rx_any_node_s *next;
+};
+
+/* View callbacks are dispatched through a regular node which is the first
+ * member, so that removal and cleanup free the whole allocation. */
+typedef struct {
+  sbp_msg_callbacks_node_t node;
+  sbp_zmq_rx_view_trampoline_t trampoline;
+  sbp_zmq_rx_view_fn_t cb;
+  void *context;
+  u8 min_len;
+} view_node_t;
+
 struct sbp_zmq_rx_ctx_s {
   zsock_t *zsock;
   sbp_state_t sbp_state;
   const u8 *receive_buffer;
   u32 receive_buffer_length;
   bool reader_interrupt;
+  /* Callbacks are chained per hash bucket in registration order. The
+   * bucket count is kept at least the callback count. */
+  sbp_msg_callbacks_node_t **dispatch;
+  u32 dispatch_mask;
+  u32 callbacks_count;
+  sbp_zmq_rx_any_node_t *any_callbacks;
+  /* Callbacks removed while dispatching stay linked with a NULL cb until
+   * the outermost dispatch returns, so that the lists can be walked safely
+   * whichever nodes a callback removes */
+  u32 dispatch_depth;
+  bool removed_pending;
 };
 
+static u32 dispatch_hash(const sbp_zmq_rx_ctx_t *ctx, u16 msg_type)
+{
+  /* Message types are allocated in small clusters, so mix the bits */
+  u32 h = (u32)msg_type * 2654435769u;
+  return (h ^ (h >> 16)) & ctx->dispatch_mask;
+}
+
+static void dispatch_append(sbp_msg_callbacks_node_t **head,
+                            sbp_msg_callbacks_node_t *node)
+{
+  while (*head != NULL) {
+    head = &(*head)->next;
+  }
+  node->next = NULL;
+  *head = node;
+}
+
+static int dispatch_grow(sbp_zmq_rx_ctx_t *ctx)
+{
+  u32 buckets_count = 2 * (ctx->dispatch_mask + 1);
+  sbp_msg_callbacks_node_t **dispatch =
+      (sbp_msg_callbacks_node_t **)calloc(buckets_count, sizeof(*dispatch));
+  if (dispatch == NULL) {
+    piksi_log(LOG_ERR, "error allocating dispatch table");
+    return -1;
+  }
+
+  sbp_msg_callbacks_node_t **old_dispatch = ctx->dispatch;
+  u32 old_buckets_count = ctx->dispatch_mask + 1;
+  ctx->dispatch = dispatch;
+  ctx->dispatch_mask = buckets_count - 1;
+
+  /* Rehash, preserving the order of callbacks for each type */
+  for (u32 i = 0; i < old_buckets_count; i++) {
+    sbp_msg_callbacks_node_t *n = old_dispatch[i];
+    while (n != NULL) {
+      sbp_msg_callbacks_node_t *next = n->next;
+      dispatch_append(&ctx->dispatch[dispatch_hash(ctx, n->msg_type)], n);
+      n = next;
+    }
+  }
+
+  free(old_dispatch);
+  return 0;
+}
+
+/* Let the publisher drop messages nobody has registered a callback for.
+ * libzmq counts identical subscriptions, so each callback node holds one. */
+static void subscription_update(sbp_zmq_rx_ctx_t *ctx, bool subscribe,
+                                const u8 *prefix, size_t prefix_len)
+{
+  if (zsock_type(ctx->zsock) != ZMQ_SUB) {
+    return;
+  }
+
+  if (zmq_setsockopt(zsock_resolve(ctx->zsock),
+                     subscribe ? ZMQ_SUBSCRIBE : ZMQ_UNSUBSCRIBE,
+                     prefix, prefix_len) != 0) {
+    piksi_log(LOG_WARNING, "error updating subscription");
+  }
+}
+
+static void subscription_update_type(sbp_zmq_rx_ctx_t *ctx, bool subscribe,
+                                     u16 msg_type)
+{
+  u8 prefix[3] = { SBP_PREAMBLE, msg_type & 0xFF, msg_type >> 8 };
+  subscription_update(ctx, subscribe, prefix, sizeof(prefix));
+}
+
+/* Free the callbacks removed during dispatch */
+static void removed_free(sbp_zmq_rx_ctx_t *ctx)
+{
+  for (u32 i = 0; i <= ctx->dispatch_mask; i++) {
+    sbp_msg_callbacks_node_t **p = &ctx->dispatch[i];
+    while (*p != NULL) {
+      sbp_msg_callbacks_node_t *n = *p;
+      if (n->cb == NULL) {
+        *p = n->next;
+        free(n);
+      } else {
+        p = &n->next;
+      }
+    }
+  }
+
+  sbp_zmq_rx_any_node_t **p = &ctx->any_callbacks;
+  while (*p != NULL) {
+    sbp_zmq_rx_any_node_t *a = *p;
+    if (a->cb == NULL) {
+      *p = a->next;
+      free(a);
+    } else {
+      p = &a->next;
+    }
+  }
+
+  ctx->removed_pending = false;
+}
+
+static void dispatch(sbp_zmq_rx_ctx_t *ctx, u16 sender_id, u16 msg_type,
+                     u8 msg_len, u8 *payload)
+{
+  ctx->dispatch_depth++;
+
+  /* Callbacks may register or remove any callback, including themselves */
+  sbp_msg_callbacks_node_t *n = ctx->dispatch[dispatch_hash(ctx, msg_type)];
+  for (; n != NULL; n = n->next) {
+    if ((n->cb != NULL) && (n->msg_type == msg_type)) {
+      n->cb(sender_id, msg_len, payload, n->context);
+    }
+  }
+
+  sbp_zmq_rx_any_node_t *a = ctx->any_callbacks;
+  for (; a != NULL; a = a->next) {
+    if (a->cb != NULL) {
+      a->cb(msg_type, sender_id, msg_len, payload, a->context);
+    }
+  }
+
+  if ((--ctx->dispatch_depth == 0) && ctx->removed_pending) {
+    removed_free(ctx);
+  }
+}
+
 static u32 receive_buffer_read(u8 *buff, u32 n, void *context)
 {
   sbp_zmq_rx_ctx_t *ctx = (sbp_zmq_rx_ctx_t *)context;
@@ -39,10 +196,47 @@ static void receive_process(sbp_zmq_rx_ctx_t *ctx, const u8 *buff, u32 length)
   ctx->receive_buffer_length = length;
 
   while (ctx->receive_buffer_length > 0) {
-    sbp_process(&ctx->sbp_state, receive_buffer_read);
+    /* No callbacks are registered with libsbp, so a complete message is
+     * reported as undefined and left in the parser state */
+    s8 ret = sbp_process(&ctx->sbp_state, receive_buffer_read);
+    if (ret == SBP_OK_CALLBACK_UNDEFINED) {
+      dispatch(ctx, ctx->sbp_state.sender_id, ctx->sbp_state.msg_type,
+               ctx->sbp_state.msg_len, ctx->sbp_state.msg_buff);
+    }
   }
 }
 
+/* Dispatch a ZMQ frame holding exactly one complete SBP frame directly to
+ * the registered callbacks without copying it through the libsbp stream
+ * parser. The callback payload points into the ZMQ frame.
+ * Returns false if the frame must go through the stream parser instead. */
+static bool frame_process(sbp_zmq_rx_ctx_t *ctx, u8 *buff, u32 length)
+{
+  /* Don't interleave with a message the stream parser has partially read */
+  if (ctx->sbp_state.state != WAITING) {
+    return false;
+  }
+
+  if ((length < SBP_HEADER_SIZE + SBP_CRC_SIZE) ||
+      (buff[0] != SBP_PREAMBLE) ||
+      (buff[5] != length - SBP_HEADER_SIZE - SBP_CRC_SIZE)) {
+    return false;
+  }
+
+  u8 msg_len = buff[5];
+  u16 crc = buff[SBP_HEADER_SIZE + msg_len] |
+            (buff[SBP_HEADER_SIZE + msg_len + 1] << 8);
+  if (crc16_ccitt(&buff[1], SBP_HEADER_SIZE - 1 + msg_len, 0) != crc) {
+    /* Drop the frame, as the stream parser would */
+    return true;
+  }
+
+  u16 msg_type = buff[1] | (buff[2] << 8);
+  u16 sender_id = buff[3] | (buff[4] << 8);
+  dispatch(ctx, sender_id, msg_type, msg_len, &buff[SBP_HEADER_SIZE]);
+  return true;
+}
+
 static int message_receive(sbp_zmq_rx_ctx_t *ctx)
 {
   zmsg_t *msg;
@@ -63,7 +257,9 @@ static int message_receive(sbp_zmq_rx_ctx_t *ctx)
 
   zframe_t *frame;
   for (frame = zmsg_first(msg); frame != NULL; frame = zmsg_next(msg)) {
-    receive_process(ctx, zframe_data(frame), zframe_size(frame));
+    if (!frame_process(ctx, zframe_data(frame), zframe_size(frame))) {
+      receive_process(ctx, zframe_data(frame), zframe_size(frame));
+    }
   }
 
   zmsg_destroy(&msg);
@@ -98,6 +294,18 @@ sbp_zmq_rx_ctx_t * sbp_zmq_rx_create(zsock_t *zsock)
 
   ctx->zsock = zsock;
   ctx->reader_interrupt = false;
+  ctx->callbacks_count = 0;
+  ctx->any_callbacks = NULL;
+  ctx->dispatch_depth = 0;
+  ctx->removed_pending = false;
+  ctx->dispatch_mask = DISPATCH_BUCKETS_INIT - 1;
+  ctx->dispatch = (sbp_msg_callbacks_node_t **)
+      calloc(DISPATCH_BUCKETS_INIT, sizeof(*ctx->dispatch));
+  if (ctx->dispatch == NULL) {
+    piksi_log(LOG_ERR, "error allocating dispatch table");
+    free(ctx);
+    return NULL;
+  }
 
   sbp_state_init(&ctx->sbp_state);
   sbp_state_set_io_context(&ctx->sbp_state, ctx);
@@ -110,10 +318,61 @@ void sbp_zmq_rx_destroy(sbp_zmq_rx_ctx_t **ctx)
   assert(ctx != NULL);
   assert(*ctx != NULL);
 
-  free(*ctx);
+  sbp_zmq_rx_ctx_t *c = *ctx;
+  for (u32 i = 0; i <= c->dispatch_mask; i++) {
+    sbp_msg_callbacks_node_t *n = c->dispatch[i];
+    while (n != NULL) {
+      sbp_msg_callbacks_node_t *next = n->next;
+      free(n);
+      n = next;
+    }
+  }
+  free(c->dispatch);
+
+  sbp_zmq_rx_any_node_t *a = c->any_callbacks;
+  while (a != NULL) {
+    sbp_zmq_rx_any_node_t *next = a->next;
+    free(a);
+    a = next;
+  }
+
+  free(c);
   *ctx = NULL;
 }
 
+static int callback_node_add(sbp_zmq_rx_ctx_t *ctx,
+                             sbp_msg_callbacks_node_t *n, u16 msg_type,
+                             sbp_msg_callback_t cb, void *context)
+{
+  /* Rehashing would reorder the lists being dispatched, so the table only
+   * grows outside of dispatch */
+  if ((ctx->callbacks_count >= ctx->dispatch_mask + 1) &&
+      (ctx->dispatch_depth == 0) && (dispatch_grow(ctx) != 0)) {
+    return -1;
+  }
+
+  n->msg_type = msg_type;
+  n->cb = cb;
+  n->context = context;
+  dispatch_append(&ctx->dispatch[dispatch_hash(ctx, msg_type)], n);
+  ctx->callbacks_count++;
+  subscription_update_type(ctx, true, msg_type);
+  return 0;
+}
+
+static void view_callback(u16 sender_id, u8 len, u8 msg[], void *context)
+{
+  view_node_t *v = (view_node_t *)context;
+
+  if (len < v->min_len) {
+    piksi_log(LOG_WARNING, "dropping short SBP message type 0x%04x",
+              v->node.msg_type);
+    return;
+  }
+
+  v->trampoline(sender_id, len, msg, v->cb, v->context);
+}
+
 int sbp_zmq_rx_callback_register(sbp_zmq_rx_ctx_t *ctx, u16 msg_type,
                                  sbp_msg_callback_t cb, void *context,
                                  sbp_msg_callbacks_node_t **node)
@@ -126,9 +385,7 @@ int sbp_zmq_rx_callback_register(sbp_zmq_rx_ctx_t *ctx, u16 msg_type,
     return -1;
   }
 
-  if (sbp_register_callback(&ctx->sbp_state, msg_type,
-                            cb, context, n) != SBP_OK) {
-    piksi_log(LOG_ERR, "error registering SBP callback");
+  if (callback_node_add(ctx, n, msg_type, cb, context) != 0) {
     free(n);
     return -1;
   }
@@ -140,6 +397,39 @@ int sbp_zmq_rx_callback_register(sbp_zmq_rx_ctx_t *ctx, u16 msg_type,
   return 0;
 }
 
+int sbp_zmq_rx_view_callback_register(sbp_zmq_rx_ctx_t *ctx, u16 msg_type,
+                                      u8 min_len,
+                                      sbp_zmq_rx_view_trampoline_t trampoline,
+                                      sbp_zmq_rx_view_fn_t cb, void *context,
+                                      sbp_msg_callbacks_node_t **node)
+{
+  assert(ctx != NULL);
+  assert(trampoline != NULL);
+  assert(cb != NULL);
+
+  view_node_t *v = (view_node_t *)malloc(sizeof(*v));
+  if (v == NULL) {
+    piksi_log(LOG_ERR, "error allocating callback node");
+    return -1;
+  }
+
+  v->trampoline = trampoline;
+  v->cb = cb;
+  v->context = context;
+  v->min_len = min_len;
+
+  if (callback_node_add(ctx, &v->node, msg_type, view_callback, v) != 0) {
+    free(v);
+    return -1;
+  }
+
+  if (node != NULL) {
+    *node = &v->node;
+  }
+
+  return 0;
+}
+
 int sbp_zmq_rx_callback_remove(sbp_zmq_rx_ctx_t *ctx,
                                sbp_msg_callbacks_node_t **node)
 {
@@ -147,12 +437,88 @@ int sbp_zmq_rx_callback_remove(sbp_zmq_rx_ctx_t *ctx,
   assert(node != NULL);
   assert(*node != NULL);
 
-  if (sbp_remove_callback(&ctx->sbp_state, *node) != SBP_OK) {
+  sbp_msg_callbacks_node_t **p =
+      &ctx->dispatch[dispatch_hash(ctx, (*node)->msg_type)];
+  while ((*p != NULL) && (*p != *node)) {
+    p = &(*p)->next;
+  }
+
+  if (*p == NULL) {
     piksi_log(LOG_ERR, "error removing SBP callback");
     return -1;
   }
 
-  free(*node);
+  ctx->callbacks_count--;
+  subscription_update_type(ctx, false, (*node)->msg_type);
+
+  if (ctx->dispatch_depth > 0) {
+    (*node)->cb = NULL;
+    ctx->removed_pending = true;
+  } else {
+    *p = (*node)->next;
+    free(*node);
+  }
+  *node = NULL;
+  return 0;
+}
+
+int sbp_zmq_rx_any_callback_register(sbp_zmq_rx_ctx_t *ctx,
+                                     sbp_zmq_rx_any_callback_t cb,
+                                     void *context,
+                                     sbp_zmq_rx_any_node_t **node)
+{
+  assert(ctx != NULL);
+
+  sbp_zmq_rx_any_node_t *n = (sbp_zmq_rx_any_node_t *)malloc(sizeof(*n));
+  if (n == NULL) {
+    piksi_log(LOG_ERR, "error allocating callback node");
+    return -1;
+  }
+
+  n->cb = cb;
+  n->context = context;
+  n->next = NULL;
+
+  sbp_zmq_rx_any_node_t **p = &ctx->any_callbacks;
+  while (*p != NULL) {
+    p = &(*p)->next;
+  }
+  *p = n;
+  subscription_update(ctx, true, NULL, 0);
+
+  if (node != NULL) {
+    *node = n;
+  }
+
+  return 0;
+}
+
+int sbp_zmq_rx_any_callback_remove(sbp_zmq_rx_ctx_t *ctx,
+                                   sbp_zmq_rx_any_node_t **node)
+{
+  assert(ctx != NULL);
+  assert(node != NULL);
+  assert(*node != NULL);
+
+  sbp_zmq_rx_any_node_t **p = &ctx->any_callbacks;
+  while ((*p != NULL) && (*p != *node)) {
+    p = &(*p)->next;
+  }
+
+  if (*p == NULL) {
+    piksi_log(LOG_ERR, "error removing SBP callback");
+    return -1;
+  }
+
+  subscription_update(ctx, false, NULL, 0);
+
+  if (ctx->dispatch_depth > 0) {
+    (*node)->cb = NULL;
+    ctx->removed_pending = true;
+  } else {
+    *p = (*node)->next;
+    free(*node);
+  }
   *node = NULL;
   return 0;
 }
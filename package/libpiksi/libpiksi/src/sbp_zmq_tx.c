@@ -13,63 +13,239 @@
 #include <libpiksi/sbp_zmq_tx.h>
 #include <libpiksi/util.h>
 #include <libpiksi/logging.h>
+#include <libsbp/edc.h>
+#include <pthread.h>
 #include <assert.h>
 
+#define SBP_HEADER_SIZE 6
+#define SBP_CRC_SIZE 2
 #define SBP_FRAME_SIZE_MAX 264
 
+#define BATCH_FRAMES_MAX 16
+
+#define POOL_BUFFERS_INIT 16
+
+/* Largest message libzmq stores inside zmq_msg_t itself (max_vsm_size of
+ * libzmq 4.1 on 64 bit targets, smaller than on 32 bit ones) */
+#define ZMQ_VSM_SIZE_MAX 29
+
+/* Frames are encoded into pooled buffers which are handed to libzmq without
+ * copying. libzmq returns a buffer through pool_buffer_release() once it is
+ * done with it, possibly from its I/O thread, so the pool is locked. The
+ * pool grows on demand and is freed when the context has been destroyed
+ * and the last buffer has been returned.
+ *
+ * libzmq still allocates a reference counted header for each message
+ * created with zmq_msg_init_data(). Frames small enough to be stored in
+ * zmq_msg_t are therefore copied instead, which needs no allocation at all,
+ * and their buffer goes straight back to the pool. */
+struct pool_s;
+
+typedef struct pool_buffer_s {
+  struct pool_s *pool;
+  struct pool_buffer_s *next;
+  u8 data[SBP_FRAME_SIZE_MAX];
+} pool_buffer_t;
+
+typedef struct pool_s {
+  pthread_mutex_t lock;
+  pool_buffer_t *free_list;
+  u32 outstanding;
+  bool closed;
+} pool_t;
+
+typedef struct {
+  u16 length;
+  pool_buffer_t *buffer;
+} batch_frame_t;
+
 struct sbp_zmq_tx_ctx_s {
   zsock_t *zsock;
   u16 sender_id;
-  sbp_state_t sbp_state;
-  u8 send_buffer[SBP_FRAME_SIZE_MAX];
-  u32 send_buffer_length;
+  pool_t *pool;
+  batch_frame_t batch_frames[BATCH_FRAMES_MAX];
+  u32 batch_frames_count;
+  bool batch_active;
 };
 
-static void send_buffer_reset(sbp_zmq_tx_ctx_t *ctx)
+static void pool_free(pool_t *pool)
 {
-  ctx->send_buffer_length = 0;
+  pool_buffer_t *b = pool->free_list;
+  while (b != NULL) {
+    pool_buffer_t *next = b->next;
+    free(b);
+    b = next;
+  }
+  pthread_mutex_destroy(&pool->lock);
+  free(pool);
 }
 
-static u32 send_buffer_write(u8 *buff, u32 n, void *context)
+static pool_t * pool_create(void)
 {
-  sbp_zmq_tx_ctx_t *ctx = (sbp_zmq_tx_ctx_t *)context;
-  u32 len = MIN(sizeof(ctx->send_buffer) - ctx->send_buffer_length, n);
-  memcpy(&ctx->send_buffer[ctx->send_buffer_length], buff, len);
-  ctx->send_buffer_length += len;
-  return len;
+  pool_t *pool = (pool_t *)malloc(sizeof(*pool));
+  if (pool == NULL) {
+    return NULL;
+  }
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pool->free_list = NULL;
+  pool->outstanding = 0;
+  pool->closed = false;
+
+  for (int i = 0; i < POOL_BUFFERS_INIT; i++) {
+    pool_buffer_t *b = (pool_buffer_t *)malloc(sizeof(*b));
+    if (b == NULL) {
+      pool_free(pool);
+      return NULL;
+    }
+    b->pool = pool;
+    b->next = pool->free_list;
+    pool->free_list = b;
+  }
+
+  return pool;
 }
 
-static int send_buffer_flush(sbp_zmq_tx_ctx_t *ctx)
+static void pool_destroy(pool_t *pool)
 {
-  zmsg_t *msg = zmsg_new();
-  if (msg == NULL) {
-    piksi_log(LOG_ERR, "error in zmsg_new()");
-    return -1;
+  pthread_mutex_lock(&pool->lock);
+  pool->closed = true;
+  bool done = (pool->outstanding == 0);
+  pthread_mutex_unlock(&pool->lock);
+
+  if (done) {
+    pool_free(pool);
+  }
+}
+
+static pool_buffer_t * pool_buffer_get(pool_t *pool)
+{
+  pthread_mutex_lock(&pool->lock);
+  pool_buffer_t *b = pool->free_list;
+  if (b != NULL) {
+    pool->free_list = b->next;
+    pool->outstanding++;
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  if (b != NULL) {
+    return b;
   }
 
-  if (zmsg_addmem(msg, ctx->send_buffer, ctx->send_buffer_length) != 0) {
-    piksi_log(LOG_ERR, "error in zmsg_addmem()");
-    zmsg_destroy(&msg);
+  /* Grow the pool */
+  b = (pool_buffer_t *)malloc(sizeof(*b));
+  if (b == NULL) {
+    piksi_log(LOG_ERR, "error allocating send buffer");
+    return NULL;
+  }
+  b->pool = pool;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->outstanding++;
+  pthread_mutex_unlock(&pool->lock);
+
+  return b;
+}
+
+static void pool_buffer_release(void *data, void *hint)
+{
+  pool_buffer_t *b = (pool_buffer_t *)hint;
+  pool_t *pool = b->pool;
+  (void)data;
+
+  pthread_mutex_lock(&pool->lock);
+  b->next = pool->free_list;
+  pool->free_list = b;
+  pool->outstanding--;
+  bool done = pool->closed && (pool->outstanding == 0);
+  pthread_mutex_unlock(&pool->lock);
+
+  if (done) {
+    pool_free(pool);
+  }
+}
+
+static u32 frame_encode(u8 *buff, u16 msg_type, u16 sender_id, u8 len,
+                        const u8 *payload)
+{
+  buff[0] = SBP_PREAMBLE;
+  buff[1] = msg_type & 0xFF;
+  buff[2] = msg_type >> 8;
+  buff[3] = sender_id & 0xFF;
+  buff[4] = sender_id >> 8;
+  buff[5] = len;
+  memcpy(&buff[SBP_HEADER_SIZE], payload, len);
+  u16 crc = crc16_ccitt(&buff[1], SBP_HEADER_SIZE - 1 + len, 0);
+  buff[SBP_HEADER_SIZE + len] = crc & 0xFF;
+  buff[SBP_HEADER_SIZE + len + 1] = crc >> 8;
+  return SBP_HEADER_SIZE + len + SBP_CRC_SIZE;
+}
+
+/* Send a pooled buffer as one ZMQ message. Ownership of the buffer passes
+ * to libzmq, or back to the pool, in all cases. */
+static int frame_send(sbp_zmq_tx_ctx_t *ctx, pool_buffer_t *buffer,
+                      u32 length)
+{
+  zmq_msg_t msg;
+  if (length <= ZMQ_VSM_SIZE_MAX) {
+    int ret = zmq_msg_init_size(&msg, length);
+    if (ret == 0) {
+      memcpy(zmq_msg_data(&msg), buffer->data, length);
+    }
+    pool_buffer_release(buffer->data, buffer);
+    if (ret != 0) {
+      piksi_log(LOG_ERR, "error in zmq_msg_init_size()");
+      return -1;
+    }
+  } else if (zmq_msg_init_data(&msg, buffer->data, length,
+                               pool_buffer_release, buffer) != 0) {
+    piksi_log(LOG_ERR, "error in zmq_msg_init_data()");
+    pool_buffer_release(buffer->data, buffer);
     return -1;
   }
 
   while (1) {
-    int ret = zmsg_send(&msg, ctx->zsock);
-    if (ret == 0) {
+    int ret = zmq_msg_send(&msg, zsock_resolve(ctx->zsock), 0);
+    if (ret >= 0) {
       /* Break on success */
-      break;
+      return 0;
     } else if (errno == EINTR) {
       /* Retry if interrupted */
       continue;
     } else {
       /* Return error */
-      piksi_log(LOG_ERR, "error in zmsg_send()");
-      zmsg_destroy(&msg);
-      return ret;
+      piksi_log(LOG_ERR, "error in zmq_msg_send()");
+      zmq_msg_close(&msg);
+      return -1;
     }
   }
+}
 
-  ctx->send_buffer_length = 0;
+static void batch_discard(sbp_zmq_tx_ctx_t *ctx, u32 start)
+{
+  for (u32 i = start; i < ctx->batch_frames_count; i++) {
+    pool_buffer_t *b = ctx->batch_frames[i].buffer;
+    pool_buffer_release(b->data, b);
+  }
+  ctx->batch_frames_count = 0;
+}
+
+/* Send the batch as one ZMQ message per SBP frame. The router, subscribers
+ * and zmq_adapter filters handle each ZMQ message as one SBP message, and
+ * zmq_adapter writes each ZMQ message to its endpoint in one piece, so
+ * frames must not be merged. libzmq still coalesces the messages queued by
+ * a flush into few socket writes. */
+static int batch_buffer_flush(sbp_zmq_tx_ctx_t *ctx)
+{
+  for (u32 i = 0; i < ctx->batch_frames_count; i++) {
+    const batch_frame_t *f = &ctx->batch_frames[i];
+    if (frame_send(ctx, f->buffer, f->length) != 0) {
+      batch_discard(ctx, i + 1);
+      return -1;
+    }
+  }
+
+  ctx->batch_frames_count = 0;
   return 0;
 }
 
@@ -86,9 +262,15 @@ sbp_zmq_tx_ctx_t * sbp_zmq_tx_create(zsock_t *zsock)
 
   ctx->zsock = zsock;
   ctx->sender_id = sbp_sender_id_get();
+  ctx->batch_frames_count = 0;
+  ctx->batch_active = false;
 
-  sbp_state_init(&ctx->sbp_state);
-  sbp_state_set_io_context(&ctx->sbp_state, ctx);
+  ctx->pool = pool_create();
+  if (ctx->pool == NULL) {
+    piksi_log(LOG_ERR, "error allocating send buffers");
+    free(ctx);
+    return NULL;
+  }
 
   return ctx;
 }
@@ -98,6 +280,9 @@ void sbp_zmq_tx_destroy(sbp_zmq_tx_ctx_t **ctx)
   assert(ctx != NULL);
   assert(*ctx != NULL);
 
+  batch_discard(*ctx, 0);
+  pool_destroy((*ctx)->pool);
+
   free(*ctx);
   *ctx = NULL;
 }
@@ -111,15 +296,83 @@ int sbp_zmq_tx_send(sbp_zmq_tx_ctx_t *ctx, u16 msg_type, u8 len, u8 *payload)
 
 int sbp_zmq_tx_send_from(sbp_zmq_tx_ctx_t *ctx, u16 msg_type, u8 len,
                          u8 *payload, u16 sbp_sender_id)
+{
+  assert(ctx != NULL);
+  assert((payload != NULL) || (len == 0));
+
+  pool_buffer_t *buffer = pool_buffer_get(ctx->pool);
+  if (buffer == NULL) {
+    return -1;
+  }
+
+  u32 length = frame_encode(buffer->data, msg_type, sbp_sender_id,
+                            len, payload);
+  return frame_send(ctx, buffer, length);
+}
+
+int sbp_zmq_tx_batch_begin(sbp_zmq_tx_ctx_t *ctx)
+{
+  assert(ctx != NULL);
+
+  if (ctx->batch_active) {
+    piksi_log(LOG_ERR, "batch already active");
+    return -1;
+  }
+
+  ctx->batch_active = true;
+  return 0;
+}
+
+int sbp_zmq_tx_batch_append(sbp_zmq_tx_ctx_t *ctx, u16 msg_type, u8 len,
+                            u8 *payload)
+{
+  assert(ctx != NULL);
+
+  return sbp_zmq_tx_batch_append_from(ctx, msg_type, len, payload,
+                                      ctx->sender_id);
+}
+
+int sbp_zmq_tx_batch_append_from(sbp_zmq_tx_ctx_t *ctx, u16 msg_type, u8 len,
+                                 u8 *payload, u16 sbp_sender_id)
+{
+  assert(ctx != NULL);
+  assert((payload != NULL) || (len == 0));
+
+  if (!ctx->batch_active) {
+    piksi_log(LOG_ERR, "no active batch");
+    return -1;
+  }
+
+  /* Send what has been batched so far if full */
+  if (ctx->batch_frames_count >= BATCH_FRAMES_MAX) {
+    if (batch_buffer_flush(ctx) != 0) {
+      return -1;
+    }
+  }
+
+  pool_buffer_t *buffer = pool_buffer_get(ctx->pool);
+  if (buffer == NULL) {
+    return -1;
+  }
+
+  ctx->batch_frames[ctx->batch_frames_count++] = (batch_frame_t) {
+    .length = frame_encode(buffer->data, msg_type, sbp_sender_id,
+                           len, payload),
+    .buffer = buffer
+  };
+
+  return 0;
+}
+
+int sbp_zmq_tx_batch_flush(sbp_zmq_tx_ctx_t *ctx)
 {
   assert(ctx != NULL);
 
-  send_buffer_reset(ctx);
-  if (sbp_send_message(&ctx->sbp_state, msg_type, sbp_sender_id, len, payload,
-                       send_buffer_write) != SBP_OK) {
-    piksi_log(LOG_ERR, "error sending SBP message");
+  if (!ctx->batch_active) {
+    piksi_log(LOG_ERR, "no active batch");
     return -1;
   }
 
-  return send_buffer_flush(ctx);
+  ctx->batch_active = false;
+  return batch_buffer_flush(ctx);
 }
@@ -0,0 +1,326 @@
+/*
+ * Copyright (C) 2017 Swift Navigation Inc.
+ * Contact: Jacob McNamee <jacob@swiftnav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <libpiksi/sbp_zmq_workers.h>
+#include <libpiksi/logging.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <assert.h>
+
+#define THREADS_MAX 8
+#define RECV_TIMEOUT_ms 100
+#define QUEUE_ENDPOINT_SIZE 64
+
+/* Either cb, or trampoline and view_cb are set. */
+typedef struct registration_s {
+  sbp_zmq_workers_ctx_t *ctx;
+  sbp_zmq_workers_callback_t cb;
+  sbp_zmq_workers_view_trampoline_t trampoline;
+  sbp_zmq_rx_view_fn_t view_cb;
+  void *context;
+  u8 min_len;
+  sbp_msg_callbacks_node_t *node;
+  struct registration_s *next;
+} registration_t;
+
+/* Jobs are queued from the ZMQ loop thread to the workers as a single ZMQ
+ * frame holding the header and a copy of the payload. Registrations are
+ * only freed once the workers have been joined. */
+typedef struct {
+  const registration_t *r;
+  u16 sender_id;
+  u8 len;
+  u8 msg[256];
+} job_t;
+
+#define JOB_HEADER_SIZE offsetof(job_t, msg)
+
+/* Sockets are created by sbp_zmq_workers_create() and handed to the worker
+ * thread, which is the only user until it has been joined. */
+typedef struct {
+  pthread_t thread;
+  bool started;
+  zsock_t *zsock_pull;
+  zsock_t *zsock_pub;
+  sbp_zmq_tx_ctx_t *tx_ctx;
+  volatile bool *stop;
+} worker_t;
+
+struct sbp_zmq_workers_ctx_s {
+  sbp_zmq_rx_ctx_t *rx_ctx;
+  zsock_t *zsock_push;
+  worker_t workers[THREADS_MAX];
+  u32 workers_count;
+  registration_t *registrations;
+  volatile bool stop;
+};
+
+static void * worker_thread(void *arg)
+{
+  worker_t *w = (worker_t *)arg;
+  job_t job;
+
+  while (!__atomic_load_n(w->stop, __ATOMIC_ACQUIRE)) {
+    int ret = zmq_recv(zsock_resolve(w->zsock_pull), &job, sizeof(job), 0);
+    if (ret < 0) {
+      if ((errno != EAGAIN) && (errno != EINTR)) {
+        piksi_log(LOG_ERR, "error in zmq_recv()");
+      }
+      continue;
+    }
+
+    if (((size_t)ret < JOB_HEADER_SIZE) ||
+        ((size_t)ret != JOB_HEADER_SIZE + job.len)) {
+      piksi_log(LOG_ERR, "invalid worker job");
+      continue;
+    }
+
+    const registration_t *r = job.r;
+    if (r->trampoline != NULL) {
+      r->trampoline(job.sender_id, job.len, job.msg, r->view_cb, w->tx_ctx,
+                    r->context);
+    } else {
+      r->cb(job.sender_id, job.len, job.msg, w->tx_ctx, r->context);
+    }
+  }
+
+  return NULL;
+}
+
+/* Runs on the ZMQ loop thread. Never blocks; if every worker queue is full
+ * the message is dropped. */
+static void dispatch_callback(u16 sender_id, u8 len, u8 msg[], void *context)
+{
+  registration_t *r = (registration_t *)context;
+
+  if (len < r->min_len) {
+    piksi_log(LOG_WARNING, "dropping short SBP message type 0x%04x",
+              r->node->msg_type);
+    return;
+  }
+
+  job_t job = {
+    .r = r,
+    .sender_id = sender_id,
+    .len = len
+  };
+  memcpy(job.msg, msg, len);
+
+  while (zmq_send(zsock_resolve(r->ctx->zsock_push), &job,
+                  JOB_HEADER_SIZE + len, ZMQ_DONTWAIT) < 0) {
+    if (errno == EINTR) {
+      continue;
+    }
+    piksi_log(LOG_WARNING, "worker queue full, dropping message");
+    return;
+  }
+}
+
+static void worker_stop_all(sbp_zmq_workers_ctx_t *ctx)
+{
+  __atomic_store_n(&ctx->stop, true, __ATOMIC_RELEASE);
+
+  for (u32 i = 0; i < ctx->workers_count; i++) {
+    worker_t *w = &ctx->workers[i];
+    if (w->started) {
+      pthread_join(w->thread, NULL);
+      w->started = false;
+    }
+  }
+}
+
+static void members_destroy(sbp_zmq_workers_ctx_t *ctx)
+{
+  worker_stop_all(ctx);
+
+  while (ctx->registrations != NULL) {
+    registration_t *r = ctx->registrations;
+    ctx->registrations = r->next;
+    sbp_zmq_rx_callback_remove(ctx->rx_ctx, &r->node);
+    free(r);
+  }
+
+  for (u32 i = 0; i < ctx->workers_count; i++) {
+    worker_t *w = &ctx->workers[i];
+
+    if (w->tx_ctx != NULL) {
+      sbp_zmq_tx_destroy(&w->tx_ctx);
+    }
+
+    if (w->zsock_pub != NULL) {
+      zsock_destroy(&w->zsock_pub);
+    }
+
+    if (w->zsock_pull != NULL) {
+      zsock_destroy(&w->zsock_pull);
+    }
+  }
+
+  if (ctx->zsock_push != NULL) {
+    zsock_destroy(&ctx->zsock_push);
+  }
+}
+
+static void destroy(sbp_zmq_workers_ctx_t **ctx)
+{
+  members_destroy(*ctx);
+  free(*ctx);
+  *ctx = NULL;
+}
+
+static int worker_init(sbp_zmq_workers_ctx_t *ctx, worker_t *w,
+                       const char *queue_ept, const char *pub_ept)
+{
+  w->stop = &ctx->stop;
+
+  w->zsock_pull = zsock_new_pull(queue_ept);
+  if (w->zsock_pull == NULL) {
+    piksi_log(LOG_ERR, "error creating PULL socket");
+    return -1;
+  }
+  /* Wake periodically to check for stop */
+  zsock_set_rcvtimeo(w->zsock_pull, RECV_TIMEOUT_ms);
+
+  w->zsock_pub = zsock_new_pub(pub_ept);
+  if (w->zsock_pub == NULL) {
+    piksi_log(LOG_ERR, "error creating PUB socket");
+    return -1;
+  }
+
+  w->tx_ctx = sbp_zmq_tx_create(w->zsock_pub);
+  if (w->tx_ctx == NULL) {
+    piksi_log(LOG_ERR, "error creating TX context");
+    return -1;
+  }
+
+  if (pthread_create(&w->thread, NULL, worker_thread, w) != 0) {
+    piksi_log(LOG_ERR, "error creating worker thread");
+    return -1;
+  }
+  w->started = true;
+
+  return 0;
+}
+
+sbp_zmq_workers_ctx_t * sbp_zmq_workers_create(sbp_zmq_rx_ctx_t *rx_ctx,
+                                               const char *pub_ept,
+                                               u32 threads)
+{
+  assert(rx_ctx != NULL);
+  assert(pub_ept != NULL);
+  assert(threads > 0);
+
+  if (threads > THREADS_MAX) {
+    piksi_log(LOG_WARNING, "limiting worker threads to %d", THREADS_MAX);
+    threads = THREADS_MAX;
+  }
+
+  sbp_zmq_workers_ctx_t *ctx = (sbp_zmq_workers_ctx_t *)calloc(1, sizeof(*ctx));
+  if (ctx == NULL) {
+    piksi_log(LOG_ERR, "error allocating context");
+    return ctx;
+  }
+
+  ctx->rx_ctx = rx_ctx;
+  ctx->registrations = NULL;
+  ctx->stop = false;
+
+  /* The loop thread binds the queue, the workers connect */
+  char queue_ept[QUEUE_ENDPOINT_SIZE];
+  snprintf(queue_ept, sizeof(queue_ept), "inproc://sbp_zmq_workers_%p",
+           (void *)ctx);
+
+  char ept[QUEUE_ENDPOINT_SIZE + 1];
+  snprintf(ept, sizeof(ept), "@%s", queue_ept);
+  ctx->zsock_push = zsock_new_push(ept);
+  if (ctx->zsock_push == NULL) {
+    piksi_log(LOG_ERR, "error creating PUSH socket");
+    destroy(&ctx);
+    return ctx;
+  }
+
+  snprintf(ept, sizeof(ept), ">%s", queue_ept);
+  for (u32 i = 0; i < threads; i++) {
+    ctx->workers_count++;
+    if (worker_init(ctx, &ctx->workers[i], ept, pub_ept) != 0) {
+      destroy(&ctx);
+      return ctx;
+    }
+  }
+
+  return ctx;
+}
+
+void sbp_zmq_workers_destroy(sbp_zmq_workers_ctx_t **ctx)
+{
+  assert(ctx != NULL);
+  assert(*ctx != NULL);
+
+  destroy(ctx);
+}
+
+static int registration_add(sbp_zmq_workers_ctx_t *ctx, u16 msg_type,
+                            const registration_t *init)
+{
+  registration_t *r = (registration_t *)malloc(sizeof(*r));
+  if (r == NULL) {
+    piksi_log(LOG_ERR, "error allocating callback");
+    return -1;
+  }
+
+  *r = *init;
+  r->ctx = ctx;
+  r->node = NULL;
+
+  if (sbp_zmq_rx_callback_register(ctx->rx_ctx, msg_type, dispatch_callback,
+                                   r, &r->node) != 0) {
+    free(r);
+    return -1;
+  }
+
+  r->next = ctx->registrations;
+  ctx->registrations = r;
+  return 0;
+}
+
+int sbp_zmq_workers_callback_register(sbp_zmq_workers_ctx_t *ctx,
+                                      u16 msg_type,
+                                      sbp_zmq_workers_callback_t cb,
+                                      void *context)
+{
+  assert(ctx != NULL);
+  assert(cb != NULL);
+
+  registration_t init = {
+    .cb = cb,
+    .context = context
+  };
+  return registration_add(ctx, msg_type, &init);
+}
+
+int sbp_zmq_workers_view_callback_register(
+    sbp_zmq_workers_ctx_t *ctx, u16 msg_type, u8 min_len,
+    sbp_zmq_workers_view_trampoline_t trampoline, sbp_zmq_rx_view_fn_t cb,
+    void *context)
+{
+  assert(ctx != NULL);
+  assert(trampoline != NULL);
+  assert(cb != NULL);
+
+  registration_t init = {
+    .trampoline = trampoline,
+    .view_cb = cb,
+    .context = context,
+    .min_len = min_len
+  };
+  return registration_add(ctx, msg_type, &init);
+}
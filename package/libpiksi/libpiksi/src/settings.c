@@ -11,10 +11,15 @@
  */
 
 #include <libpiksi/settings.h>
+#include <libpiksi/settings_protocol.h>
 #include <libpiksi/sbp_zmq_pubsub.h>
+#include <libpiksi/sbp_zmq_rx_views.h>
 #include <libpiksi/util.h>
 #include <libpiksi/logging.h>
 #include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
 #include <assert.h>
 #include <libsbp/settings.h>
 
@@ -24,8 +29,15 @@
 #define REGISTER_TIMEOUT_ms 100
 #define REGISTER_TRIES 5
 
+#define READ_ALL_TIMEOUT_ms 100
+#define READ_ALL_TRIES 5
+
 #define SBP_PAYLOAD_SIZE_MAX 255
 
+#define SETTING_TABLE_SIZE_INIT 64
+
+#define NOTIFY_RETRY_ms 1000
+
 typedef int (*to_string_fn)(const void *priv, char *str, int slen,
                             const void *blob, int blen);
 typedef bool (*from_string_fn)(const void *priv, void *blob, int blen,
@@ -49,7 +61,10 @@ typedef struct setting_data_s {
   type_data_t *type_data;
   settings_notify_fn notify;
   void *notify_context;
+  settings_notify_group_t *notify_group;
   bool readonly;
+  u8 typed_type;
+  u32 hash;
   struct setting_data_s *next;
 } setting_data_t;
 
@@ -60,11 +75,93 @@ typedef struct {
   u8 compare_data_len;
 } registration_state_t;
 
+/* Registration sent during a batch, awaiting the reply from the daemon */
+typedef struct pending_registration_s {
+  setting_data_t *setting_data;
+  u8 msg[SBP_PAYLOAD_SIZE_MAX];
+  u8 msg_len;
+  struct pending_registration_s *next;
+} pending_registration_t;
+
+typedef struct {
+  bool active;
+  pending_registration_t *pending;
+  u32 pending_count;
+  u32 failed_count;
+  u8 tries;
+  zloop_t *zloop;
+  int timer_id;
+  bool timer_active;
+  settings_register_complete_fn complete;
+  void *complete_context;
+} registration_batch_t;
+
+typedef struct watch_s {
+  char *section;
+  char *name_prefix;
+  settings_watch_fn watch_fn;
+  void *watch_context;
+  struct watch_s *next;
+} watch_t;
+
+typedef struct notify_group_member_s {
+  void *var;
+  void *var_applied;
+  size_t var_len;
+  struct notify_group_member_s *next;
+} notify_group_member_t;
+
+/* The lock of a group protects the setting variables of the group. It is
+ * held by the reader while a setting of the group is written and by the
+ * worker thread while the variables are copied to their applied copies, but
+ * not while the deferred notify function runs. The pending flag and
+ * deadline are protected by the worker lock. */
+struct settings_notify_group_s {
+  settings_deferred_notify_fn notify;
+  void *notify_context;
+  u32 debounce_ms;
+  pthread_mutex_t lock;
+  notify_group_member_t *members;
+  bool pending;
+  u64 deadline_ms;
+  struct settings_notify_group_s *next;
+};
+
+typedef struct {
+  pthread_t thread;
+  bool started;
+  bool stop;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  settings_notify_group_t *groups;
+} notify_worker_t;
+
+typedef struct {
+  settings_read_fn read_fn;
+  void *read_context;
+  u16 next_index;
+  u16 range_start;
+  u32 range_end;
+  bool range_complete;
+  bool done;
+} read_all_state_t;
+
 struct settings_ctx_s {
   sbp_zmq_pubsub_ctx_t *pubsub_ctx;
   type_data_t *type_data_list;
   setting_data_t *setting_data_list;
+  setting_data_t **setting_table;
+  u32 setting_table_mask;
+  u32 setting_count;
   registration_state_t registration_state;
+  registration_batch_t registration_batch;
+  zloop_t *reader_zloop;
+  read_all_state_t read_all_state;
+  zsock_t *write_zsock;
+  bool write_interrupt;
+  zsock_t *watch_zsock;
+  watch_t *watch_list;
+  notify_worker_t notify_worker;
 };
 
 static const char * const bool_enum_names[] = {"False", "True", NULL};
@@ -108,7 +205,7 @@ static int int_to_string(const void *priv, char *str, int slen,
   case 2:
     return snprintf(str, slen, "%hd", *(s16*)blob);
   case 4:
-    return snprintf(str, slen, "%ld", *(s32*)blob);
+    return snprintf(str, slen, "%" PRId32, *(s32*)blob);
   }
   return -1;
 }
@@ -131,7 +228,7 @@ static bool int_from_string(const void *priv, void *blob, int blen,
   case 2:
     return sscanf(str, "%hd", (s16*)blob) == 1;
   case 4:
-    return sscanf(str, "%ld", (s32*)blob) == 1;
+    return sscanf(str, "%" SCNd32, (s32*)blob) == 1;
   }
   return false;
 }
@@ -281,19 +378,109 @@ static type_data_t * type_data_lookup(settings_ctx_t *ctx, settings_type_t type)
   return type_data;
 }
 
+static u32 setting_hash(const char *section, const char *name)
+{
+  /* The terminator separates section and name */
+  u32 h = fnv1a_32_update(FNV1A_32_INIT, section, strlen(section) + 1);
+  return fnv1a_32_update(h, name, strlen(name));
+}
+
+static void setting_table_insert(settings_ctx_t *ctx,
+                                 setting_data_t *setting_data)
+{
+  u32 i = setting_data->hash & ctx->setting_table_mask;
+  while (ctx->setting_table[i] != NULL) {
+    i = (i + 1) & ctx->setting_table_mask;
+  }
+  ctx->setting_table[i] = setting_data;
+}
+
+/* Settings are looked up for every write, so they are also kept in an open
+ * addressing table, at most half full */
+static int setting_table_add(settings_ctx_t *ctx, setting_data_t *setting_data)
+{
+  if ((ctx->setting_table == NULL) ||
+      (2 * (ctx->setting_count + 1) > ctx->setting_table_mask + 1)) {
+    u32 size = (ctx->setting_table == NULL) ? SETTING_TABLE_SIZE_INIT :
+                                              2 * (ctx->setting_table_mask + 1);
+    setting_data_t **table = (setting_data_t **)calloc(size, sizeof(*table));
+    if (table == NULL) {
+      piksi_log(LOG_ERR, "error allocating setting table");
+      return -1;
+    }
+
+    free(ctx->setting_table);
+    ctx->setting_table = table;
+    ctx->setting_table_mask = size - 1;
+    for (setting_data_t *s = ctx->setting_data_list; s != NULL; s = s->next) {
+      if (s != setting_data) {
+        setting_table_insert(ctx, s);
+      }
+    }
+  }
+
+  setting_table_insert(ctx, setting_data);
+  ctx->setting_count++;
+  return 0;
+}
+
 static setting_data_t * setting_data_lookup(settings_ctx_t *ctx,
                                             const char *section,
                                             const char *name)
 {
-  setting_data_t *setting_data = ctx->setting_data_list;
-  while (setting_data != NULL) {
-    if ((strcmp(setting_data->section, section) == 0) &&
+  if (ctx->setting_table == NULL) {
+    return NULL;
+  }
+
+  u32 hash = setting_hash(section, name);
+  for (u32 i = hash & ctx->setting_table_mask; ctx->setting_table[i] != NULL;
+       i = (i + 1) & ctx->setting_table_mask) {
+    setting_data_t *setting_data = ctx->setting_table[i];
+    if ((setting_data->hash == hash) &&
+        (strcmp(setting_data->section, section) == 0) &&
         (strcmp(setting_data->name, name) == 0)) {
-      break;
+      return setting_data;
+    }
+  }
+  return NULL;
+}
+
+/* Binary representation of a setting for typed messages, which only
+ * exists for the standard numeric types, booleans and enums */
+static u8 typed_type_get(const type_data_t *type_data, size_t var_len)
+{
+  if (type_data->to_string == int_to_string) {
+    switch (var_len) {
+    case 1: return SETTINGS_TYPED_S8;
+    case 2: return SETTINGS_TYPED_S16;
+    case 4: return SETTINGS_TYPED_S32;
     }
-    setting_data = setting_data->next;
+  } else if (type_data->to_string == float_to_string) {
+    switch (var_len) {
+    case 4: return SETTINGS_TYPED_FLOAT;
+    case 8: return SETTINGS_TYPED_DOUBLE;
+    }
+  } else if (type_data->to_string == enum_to_string) {
+    return SETTINGS_TYPED_ENUM;
   }
-  return setting_data;
+  return SETTINGS_TYPED_NONE;
+}
+
+/* Check that a binary value is valid for a setting */
+static bool typed_value_valid(const setting_data_t *setting_data,
+                              const u8 *value)
+{
+  if (setting_data->typed_type != SETTINGS_TYPED_ENUM) {
+    return true;
+  }
+
+  const char * const *enum_names = setting_data->type_data->priv;
+  for (u8 i = 0; enum_names[i] != NULL; i++) {
+    if (i == value[0]) {
+      return true;
+    }
+  }
+  return false;
 }
 
 static void setting_data_list_insert(settings_ctx_t *ctx,
@@ -327,7 +514,7 @@ static void compare_init(settings_ctx_t *ctx, const u8 *data, u8 data_len)
   r->pending = true;
 }
 
-static void compare_check(settings_ctx_t *ctx, const u8 *data, u8 data_len)
+static void compare_check(settings_ctx_t *ctx, const void *data, u8 data_len)
 {
   registration_state_t *r = &ctx->registration_state;
 
@@ -339,7 +526,7 @@ static void compare_check(settings_ctx_t *ctx, const u8 *data, u8 data_len)
       (memcmp(data, r->compare_data, r->compare_data_len) == 0)) {
     r->match = true;
     r->pending = false;
-    sbp_zmq_rx_reader_interrupt(sbp_zmq_pubsub_rx_ctx_get(ctx->pubsub_ctx));
+    ctx->write_interrupt = true;
   }
 }
 
@@ -355,6 +542,234 @@ static bool compare_match(settings_ctx_t *ctx)
   return r->match;
 }
 
+static void batch_send(settings_ctx_t *ctx)
+{
+  registration_batch_t *b = &ctx->registration_batch;
+  sbp_zmq_tx_ctx_t *tx_ctx = sbp_zmq_pubsub_tx_ctx_get(ctx->pubsub_ctx);
+
+  for (pending_registration_t *p = b->pending; p != NULL; p = p->next) {
+    sbp_zmq_tx_send(tx_ctx, SBP_MSG_SETTINGS_REGISTER, p->msg_len, p->msg);
+  }
+}
+
+static void batch_pending_free(settings_ctx_t *ctx)
+{
+  registration_batch_t *b = &ctx->registration_batch;
+
+  while (b->pending != NULL) {
+    pending_registration_t *p = b->pending;
+    b->pending = p->next;
+    free(p);
+  }
+  b->pending_count = 0;
+}
+
+static int batch_complete(settings_ctx_t *ctx)
+{
+  registration_batch_t *b = &ctx->registration_batch;
+
+  if (b->timer_active) {
+    zloop_timer_end(b->zloop, b->timer_id);
+    b->timer_active = false;
+  }
+
+  for (pending_registration_t *p = b->pending; p != NULL; p = p->next) {
+    piksi_log(LOG_ERR, "setting registration failed: %s.%s",
+              p->setting_data->section, p->setting_data->name);
+  }
+  b->failed_count += b->pending_count;
+  batch_pending_free(ctx);
+
+  settings_register_complete_fn complete = b->complete;
+  void *complete_context = b->complete_context;
+  int result = (b->failed_count == 0) ? 0 : -1;
+  b->complete = NULL;
+  b->zloop = NULL;
+
+  if (complete != NULL) {
+    complete(result, complete_context);
+  }
+  return result;
+}
+
+/* Remove a setting from the pending registrations once the daemon has
+ * replied to it */
+static void batch_ack(settings_ctx_t *ctx, setting_data_t *setting_data)
+{
+  registration_batch_t *b = &ctx->registration_batch;
+
+  pending_registration_t **pp = &b->pending;
+  while ((*pp != NULL) && ((*pp)->setting_data != setting_data)) {
+    pp = &(*pp)->next;
+  }
+  if (*pp == NULL) {
+    return;
+  }
+
+  pending_registration_t *p = *pp;
+  *pp = p->next;
+  free(p);
+  b->pending_count--;
+
+  if ((b->pending_count == 0) && !b->active) {
+    if (b->zloop != NULL) {
+      batch_complete(ctx);
+    } else {
+      ctx->write_interrupt = true;
+    }
+  }
+}
+
+/* Resend registrations which have not been replied to */
+static int batch_timer_handler(zloop_t *loop, int timer_id, void *arg)
+{
+  (void)loop;
+  (void)timer_id;
+  settings_ctx_t *ctx = (settings_ctx_t *)arg;
+  registration_batch_t *b = &ctx->registration_batch;
+
+  if (++b->tries >= REGISTER_TRIES) {
+    batch_complete(ctx);
+    return 0;
+  }
+
+  batch_send(ctx);
+  return 0;
+}
+
+static u64 monotonic_ms_get(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Execute the deferred notify function of each group once no setting of the
+ * group has been written for its debounce time. A group written again while
+ * its function runs is executed again afterwards, a failed function is
+ * retried after NOTIFY_RETRY_ms. */
+static void * notify_worker_thread(void *arg)
+{
+  notify_worker_t *w = (notify_worker_t *)arg;
+
+  pthread_mutex_lock(&w->lock);
+  while (!w->stop) {
+    settings_notify_group_t *next = NULL;
+    for (settings_notify_group_t *g = w->groups; g != NULL; g = g->next) {
+      if (g->pending &&
+          ((next == NULL) || (g->deadline_ms < next->deadline_ms))) {
+        next = g;
+      }
+    }
+
+    if (next == NULL) {
+      pthread_cond_wait(&w->cond, &w->lock);
+      continue;
+    }
+
+    if (next->deadline_ms > monotonic_ms_get()) {
+      struct timespec ts = {
+        .tv_sec = next->deadline_ms / 1000,
+        .tv_nsec = (next->deadline_ms % 1000) * 1000000
+      };
+      pthread_cond_timedwait(&w->cond, &w->lock, &ts);
+      continue;
+    }
+
+    next->pending = false;
+    pthread_mutex_unlock(&w->lock);
+
+    /* The notify function may be slow, it runs on the applied copies so
+     * that writes to the group are not blocked meanwhile */
+    pthread_mutex_lock(&next->lock);
+    for (notify_group_member_t *m = next->members; m != NULL; m = m->next) {
+      memcpy(m->var_applied, m->var, m->var_len);
+    }
+    pthread_mutex_unlock(&next->lock);
+
+    int result = next->notify(next->notify_context);
+
+    pthread_mutex_lock(&w->lock);
+    if ((result != 0) && !next->pending) {
+      piksi_log(LOG_ERR, "deferred notify failed, retrying");
+      next->pending = true;
+      next->deadline_ms = monotonic_ms_get() + NOTIFY_RETRY_ms;
+    }
+  }
+  pthread_mutex_unlock(&w->lock);
+
+  return NULL;
+}
+
+static int notify_worker_start(notify_worker_t *w)
+{
+  pthread_condattr_t attr;
+  if ((pthread_condattr_init(&attr) != 0) ||
+      (pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0) ||
+      (pthread_cond_init(&w->cond, &attr) != 0)) {
+    piksi_log(LOG_ERR, "error initializing notify worker");
+    return -1;
+  }
+  pthread_condattr_destroy(&attr);
+
+  if (pthread_mutex_init(&w->lock, NULL) != 0) {
+    piksi_log(LOG_ERR, "error initializing notify worker");
+    pthread_cond_destroy(&w->cond);
+    return -1;
+  }
+
+  w->stop = false;
+  if (pthread_create(&w->thread, NULL, notify_worker_thread, w) != 0) {
+    piksi_log(LOG_ERR, "error creating notify worker thread");
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+    return -1;
+  }
+
+  w->started = true;
+  return 0;
+}
+
+static void notify_worker_stop(notify_worker_t *w)
+{
+  if (w->started) {
+    pthread_mutex_lock(&w->lock);
+    w->stop = true;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+    w->started = false;
+  }
+
+  while (w->groups != NULL) {
+    settings_notify_group_t *g = w->groups;
+    w->groups = g->next;
+    while (g->members != NULL) {
+      notify_group_member_t *m = g->members;
+      g->members = m->next;
+      free(m);
+    }
+    pthread_mutex_destroy(&g->lock);
+    free(g);
+  }
+}
+
+/* (Re)start the debounce time of a group after a write */
+static void notify_group_schedule(settings_ctx_t *ctx,
+                                  settings_notify_group_t *group)
+{
+  notify_worker_t *w = &ctx->notify_worker;
+
+  pthread_mutex_lock(&w->lock);
+  group->pending = true;
+  group->deadline_ms = monotonic_ms_get() + group->debounce_ms;
+  pthread_cond_signal(&w->cond);
+  pthread_mutex_unlock(&w->lock);
+}
+
 static int type_register(settings_ctx_t *ctx, to_string_fn to_string,
                          from_string_fn from_string, format_type_fn format_type,
                          const void *priv, settings_type_t *type)
@@ -404,10 +819,31 @@ static void setting_data_members_destroy(setting_data_t *setting_data)
   }
 }
 
+/* Receive write requests for a section, before its first setting is added */
+static int write_subscribe(settings_ctx_t *ctx, const char *section)
+{
+  for (setting_data_t *s = ctx->setting_data_list; s != NULL; s = s->next) {
+    if (strcmp(s->section, section) == 0) {
+      return 0;
+    }
+  }
+
+  /* Topic is "<section>\0" */
+  if (zmq_setsockopt(zsock_resolve(ctx->write_zsock), ZMQ_SUBSCRIBE,
+                     section, strlen(section) + 1) != 0) {
+    piksi_log(LOG_ERR, "error subscribing to settings writes");
+    return -1;
+  }
+
+  return 0;
+}
+
 static int setting_register(settings_ctx_t *ctx, const char *section,
                             const char *name, void *var, size_t var_len,
                             settings_type_t type, settings_notify_fn notify,
-                            void *notify_context, bool readonly)
+                            void *notify_context,
+                            settings_notify_group_t *notify_group,
+                            bool readonly)
 {
   /* Look up type data */
   type_data_t *type_data = type_data_lookup(ctx, type);
@@ -416,6 +852,10 @@ static int setting_register(settings_ctx_t *ctx, const char *section,
     return -1;
   }
 
+  if (write_subscribe(ctx, section) != 0) {
+    return -1;
+  }
+
   /* Set up setting data */
   setting_data_t *setting_data = (setting_data_t *)
                                      malloc(sizeof(*setting_data));
@@ -433,7 +873,10 @@ static int setting_register(settings_ctx_t *ctx, const char *section,
     .type_data = type_data,
     .notify = notify,
     .notify_context = notify_context,
+    .notify_group = notify_group,
     .readonly = readonly,
+    .typed_type = typed_type_get(type_data, var_len),
+    .hash = setting_hash(section, name),
     .next = NULL
   };
 
@@ -449,6 +892,9 @@ static int setting_register(settings_ctx_t *ctx, const char *section,
 
   /* Add to list */
   setting_data_list_insert(ctx, setting_data);
+  if (setting_table_add(ctx, setting_data) != 0) {
+    return -1;
+  }
 
   /* Build message */
   u8 msg[SBP_PAYLOAD_SIZE_MAX];
@@ -471,6 +917,32 @@ static int setting_register(settings_ctx_t *ctx, const char *section,
   }
   msg_len += l;
 
+  /* Within a batch, send now and collect the reply later */
+  if (ctx->registration_batch.active) {
+    registration_batch_t *b = &ctx->registration_batch;
+    pending_registration_t *p = (pending_registration_t *)malloc(sizeof(*p));
+    if (p == NULL) {
+      piksi_log(LOG_ERR, "error allocating pending registration");
+      return -1;
+    }
+    memcpy(p->msg, msg, msg_len);
+    p->msg_len = msg_len;
+    p->setting_data = setting_data;
+    p->next = NULL;
+
+    /* Keep registration order, which the daemon uses for read by index */
+    pending_registration_t **pp = &b->pending;
+    while (*pp != NULL) {
+      pp = &(*pp)->next;
+    }
+    *pp = p;
+    b->pending_count++;
+
+    sbp_zmq_tx_send(sbp_zmq_pubsub_tx_ctx_get(ctx->pubsub_ctx),
+                    SBP_MSG_SETTINGS_REGISTER, msg_len, msg);
+    return 0;
+  }
+
   /* Register with daemon */
   compare_init(ctx, msg, msg_header_len);
 
@@ -495,16 +967,85 @@ static int setting_register(settings_ctx_t *ctx, const char *section,
   return 0;
 }
 
-static void settings_write_callback(u16 sender_id, u8 len, u8 msg[],
-                                    void* context)
+/* Update the value of a setting from either a string or a value in its
+ * binary representation. The previous value is restored if the conversion
+ * fails or the notify function rejects the new value. */
+static bool setting_update(settings_ctx_t *ctx, setting_data_t *setting_data,
+                           const char *str, const u8 *bin)
 {
-  settings_ctx_t *ctx = (settings_ctx_t *)context;
+  /* The worker thread may be copying the variables of the group */
+  settings_notify_group_t *group = setting_data->notify_group;
+  if (group != NULL) {
+    pthread_mutex_lock(&group->lock);
+  }
 
-  if (sender_id != SBP_SENDER_ID) {
-    piksi_log(LOG_WARNING, "invalid sender");
+  bool accepted = false;
+
+  /* Store copy and update value */
+  memcpy(setting_data->var_copy, setting_data->var, setting_data->var_len);
+  if (str != NULL) {
+    accepted = setting_data->type_data->from_string(
+                   setting_data->type_data->priv, setting_data->var,
+                   setting_data->var_len, str);
+  } else if (typed_value_valid(setting_data, bin)) {
+    memcpy(setting_data->var, bin, settings_typed_size(setting_data->typed_type));
+    accepted = true;
+  }
+
+  if (accepted && (setting_data->notify != NULL) &&
+      (setting_data->notify(setting_data->notify_context) != 0)) {
+    accepted = false;
+  }
+
+  if (!accepted) {
+    /* Revert value if conversion fails or notify returns error */
+    memcpy(setting_data->var, setting_data->var_copy, setting_data->var_len);
+  }
+
+  if (group != NULL) {
+    pthread_mutex_unlock(&group->lock);
+    if (accepted) {
+      notify_group_schedule(ctx, group);
+    }
+  }
+
+  return accepted;
+}
+
+static void setting_read_resp_send(settings_ctx_t *ctx,
+                                   setting_data_t *setting_data)
+{
+  /* Build message */
+  u8 resp[SBP_PAYLOAD_SIZE_MAX];
+  u8 resp_len = 0;
+  int l;
+
+  l = message_header_get(setting_data, &resp[resp_len], sizeof(resp) - resp_len);
+  if (l < 0) {
+    piksi_log(LOG_ERR, "error building settings message");
+    return;
+  }
+  resp_len += l;
+
+  l = message_data_get(setting_data, &resp[resp_len], sizeof(resp) - resp_len);
+  if (l < 0) {
+    piksi_log(LOG_ERR, "error building settings message");
+    return;
+  }
+  resp_len += l;
+
+  if (sbp_zmq_tx_send(sbp_zmq_pubsub_tx_ctx_get(ctx->pubsub_ctx),
+                      SBP_MSG_SETTINGS_READ_RESP, resp_len, resp) != 0) {
+    piksi_log(LOG_ERR, "error sending settings read response");
     return;
   }
+}
 
+/* Write requests are forwarded by the settings daemon, which only forwards
+ * writes from SBP_SENDER_ID */
+static void setting_write_process(settings_ctx_t *ctx, const char *msg,
+                                  u8 len)
+{
   /* Check for a response to a pending registration request */
   compare_check(ctx, msg, len);
 
@@ -520,17 +1061,17 @@ static void settings_write_callback(u16 sender_id, u8 len, u8 msg[],
   const char *section = NULL;
   const char *name = NULL;
   const char *value = NULL;
-  section = (const char *)msg;
+  section = msg;
   for (int i = 0, tok = 0; i < len; i++) {
     if (msg[i] == '\0') {
       tok++;
       switch (tok) {
       case 1:
-        name = (const char *)&msg[i+1];
+        name = &msg[i+1];
         break;
       case 2:
         if (i + 1 < len)
-          value = (const char *)&msg[i+1];
+          value = &msg[i+1];
         break;
       case 3:
         if (i == len-1)
@@ -554,51 +1095,321 @@ static void settings_write_callback(u16 sender_id, u8 len, u8 msg[],
   }
 
   if (!setting_data->readonly) {
-    /* Store copy and update value */
-    memcpy(setting_data->var_copy, setting_data->var, setting_data->var_len);
-    if (!setting_data->type_data->from_string(setting_data->type_data->priv,
-                                             setting_data->var,
-                                             setting_data->var_len,
-                                             value)) {
-      /* Revert value if conversion fails */
-      memcpy(setting_data->var, setting_data->var_copy, setting_data->var_len);
-    } else if (setting_data->notify != NULL) {
-      /* Call notify function */
-      if (setting_data->notify(setting_data->notify_context) != 0) {
-        /* Revert value if notify returns error */
-        memcpy(setting_data->var, setting_data->var_copy, setting_data->var_len);
-      }
-    }
+    setting_update(ctx, setting_data, value, NULL);
   }
 
-  /* Build message */
+  /* Complete a batched registration once the value has been applied */
+  batch_ack(ctx, setting_data);
+
+  setting_read_resp_send(ctx, setting_data);
+}
+
+/* Parse two null terminated strings, section and name, filling len bytes */
+static bool setting_names_parse(const u8 *msg, u8 len, const char **section,
+                                const char **name)
+{
+  if ((len == 0) || (msg[len-1] != '\0')) {
+    return false;
+  }
+
+  *section = (const char *)msg;
+  u8 section_len = strlen(*section) + 1;
+  if (section_len >= len) {
+    return false;
+  }
+
+  *name = (const char *)&msg[section_len];
+  return (section_len + strlen(*name) + 1 == len);
+}
+
+static void setting_typed_resp_send(settings_ctx_t *ctx,
+                                    setting_data_t *setting_data, u8 status)
+{
   u8 resp[SBP_PAYLOAD_SIZE_MAX];
-  u8 resp_len = 0;
-  int l;
+  settings_typed_header_t *header = (settings_typed_header_t *)resp;
+  header->type = setting_data->typed_type;
+  header->status = status;
+  u8 resp_len = sizeof(*header);
 
-  l = message_header_get(setting_data, &resp[resp_len], sizeof(resp) - resp_len);
+  u8 size = settings_typed_size(header->type);
+  memcpy(&resp[resp_len], setting_data->var, size);
+  resp_len += size;
+
+  int l = message_header_get(setting_data, (char *)&resp[resp_len],
+                             sizeof(resp) - resp_len);
   if (l < 0) {
     piksi_log(LOG_ERR, "error building settings message");
     return;
   }
   resp_len += l;
 
-  l = message_data_get(setting_data, &resp[resp_len], sizeof(resp) - resp_len);
-  if (l < 0) {
-    piksi_log(LOG_ERR, "error building settings message");
+  if (sbp_zmq_tx_send(sbp_zmq_pubsub_tx_ctx_get(ctx->pubsub_ctx),
+                      SBP_MSG_SETTINGS_TYPED_READ_RESP, resp_len, resp) != 0) {
+    piksi_log(LOG_ERR, "error sending settings typed read response");
+  }
+}
+
+static void settings_typed_write_callback(u16 sender_id, u8 len,
+                                          const settings_typed_header_t *header,
+                                          void *context)
+{
+  settings_ctx_t *ctx = (settings_ctx_t *)context;
+
+  if (sender_id != SBP_SENDER_ID) {
+    piksi_log(LOG_WARNING, "invalid sender");
     return;
   }
-  resp_len += l;
 
-  if (sbp_zmq_tx_send(sbp_zmq_pubsub_tx_ctx_get(ctx->pubsub_ctx),
-                      SBP_MSG_SETTINGS_READ_RESP, resp_len, resp) != 0) {
-    piksi_log(LOG_ERR, "error sending settings read response");
+  /* Header, value, then section and name */
+  const u8 *value = (const u8 *)(header + 1);
+  u8 size = settings_typed_size(header->type);
+  const char *section = NULL;
+  const char *name = NULL;
+  if ((size == 0) || (len <= sizeof(*header) + size) ||
+      !setting_names_parse(&value[size], len - sizeof(*header) - size,
+                           &section, &name)) {
+    piksi_log(LOG_WARNING, "error in settings typed write message");
     return;
   }
+
+  setting_data_t *setting_data = setting_data_lookup(ctx, section, name);
+  if (setting_data == NULL) {
+    return;
+  }
+
+  u8 status;
+  if (setting_data->readonly) {
+    status = SETTINGS_TYPED_STATUS_READONLY;
+  } else if (header->type != setting_data->typed_type) {
+    status = SETTINGS_TYPED_STATUS_TYPE_MISMATCH;
+  } else if (!setting_update(ctx, setting_data, NULL, value)) {
+    status = SETTINGS_TYPED_STATUS_REJECTED;
+  } else {
+    status = SETTINGS_TYPED_STATUS_OK;
+  }
+
+  setting_typed_resp_send(ctx, setting_data, status);
+
+  /* Keep the value stored by the settings daemon up to date */
+  if (status == SETTINGS_TYPED_STATUS_OK) {
+    setting_read_resp_send(ctx, setting_data);
+  }
+}
+
+static void settings_typed_read_callback(u16 sender_id, u8 len, u8 msg[],
+                                         void *context)
+{
+  settings_ctx_t *ctx = (settings_ctx_t *)context;
+
+  if (sender_id != SBP_SENDER_ID) {
+    piksi_log(LOG_WARNING, "invalid sender");
+    return;
+  }
+
+  const char *section = NULL;
+  const char *name = NULL;
+  if (!setting_names_parse(msg, len, &section, &name)) {
+    piksi_log(LOG_WARNING, "error in settings typed read message");
+    return;
+  }
+
+  setting_data_t *setting_data = setting_data_lookup(ctx, section, name);
+  if (setting_data == NULL) {
+    return;
+  }
+
+  setting_typed_resp_send(ctx, setting_data,
+                          (setting_data->typed_type == SETTINGS_TYPED_NONE) ?
+                            SETTINGS_TYPED_STATUS_TYPE_MISMATCH :
+                            SETTINGS_TYPED_STATUS_OK);
+}
+
+static void settings_read_by_index_resp_callback(
+    u16 sender_id, u8 len, const msg_settings_read_by_index_resp_t *msg,
+    void *context)
+{
+  (void)sender_id;
+  settings_ctx_t *ctx = (settings_ctx_t *)context;
+  read_all_state_t *r = &ctx->read_all_state;
+
+  u8 setting_len = len - sizeof(*msg);
+  if ((setting_len == 0) || (msg->setting[setting_len-1] != '\0')) {
+    piksi_log(LOG_WARNING, "error in settings read by index response");
+    return;
+  }
+
+  /* Responses arrive in order, anything else belongs to another reader or
+   * follows a lost response and is requested again */
+  u16 index = msg->index;
+  if ((index != r->next_index) || (index >= r->range_end)) {
+    return;
+  }
+
+  /* Extract parameters from message:
+   * 3 null terminated strings: section, setting and value
+   * An optional fourth string is a description of the type.
+   */
+  const char *strings[4] = {NULL, NULL, NULL, NULL};
+  u8 count = 0;
+  for (u8 i = 0; (i < setting_len) && (count < 4); count++) {
+    strings[count] = &msg->setting[i];
+    i += strlen(strings[count]) + 1;
+  }
+  if (count < 3) {
+    piksi_log(LOG_WARNING, "error in settings read by index response");
+    return;
+  }
+  const char *type = ((count == 4) && (strings[3][0] != '\0')) ? strings[3] :
+                                                                 NULL;
+
+  r->read_fn(index, strings[0], strings[1], strings[2], type, r->read_context);
+
+  r->next_index++;
+  if (r->next_index == r->range_end) {
+    r->range_complete = true;
+    sbp_zmq_rx_reader_interrupt(sbp_zmq_pubsub_rx_ctx_get(ctx->pubsub_ctx));
+  }
+}
+
+static void settings_read_by_index_done_callback(u16 sender_id, u8 len,
+                                                 u8 msg[], void *context)
+{
+  (void)sender_id;
+  settings_ctx_t *ctx = (settings_ctx_t *)context;
+  read_all_state_t *r = &ctx->read_all_state;
+
+  /* DONE may answer another reader's request. The read only ends once the
+   * number of settings reported by the daemon has been read, otherwise the
+   * range is requested again on timeout. */
+  if (len >= sizeof(settings_read_by_index_done_t)) {
+    u16 count = (msg[1] << 8) | msg[0];
+    if (r->next_index >= count) {
+      r->done = true;
+      r->range_complete = true;
+      sbp_zmq_rx_reader_interrupt(sbp_zmq_pubsub_rx_ctx_get(ctx->pubsub_ctx));
+    }
+    return;
+  }
+
+  /* Older daemons do not report the number of settings. The read then ends
+   * on a DONE received before any setting of the current range, which
+   * guards against responses lost at the end of a range at the cost of one
+   * more request. A DONE sent to another reader before the first response
+   * of a range still ends the read early, with a truncated list. */
+  if (r->next_index == r->range_start) {
+    r->done = true;
+  }
+  r->range_complete = true;
+  sbp_zmq_rx_reader_interrupt(sbp_zmq_pubsub_rx_ctx_get(ctx->pubsub_ctx));
+}
+
+/* Process a single write request, returns true if a blocking registration
+ * is waiting for the ZMQ loop to return */
+static bool write_receive(settings_ctx_t *ctx)
+{
+  char msg[SBP_PAYLOAD_SIZE_MAX];
+  int len = zmq_recv(zsock_resolve(ctx->write_zsock), msg, sizeof(msg),
+                     ZMQ_DONTWAIT);
+  if (len < 0) {
+    return false;
+  }
+
+  if (len > (int)sizeof(msg)) {
+    piksi_log(LOG_WARNING, "error in settings write message");
+    return false;
+  }
+
+  ctx->write_interrupt = false;
+  setting_write_process(ctx, msg, len);
+  return ctx->write_interrupt;
+}
+
+static int write_reader_handler(zloop_t *zloop, zsock_t *zsock, void *arg)
+{
+  (void)zloop;
+  (void)zsock;
+  settings_ctx_t *ctx = (settings_ctx_t *)arg;
+
+  /* Return -1 to break the ZMQ loop of a blocking registration */
+  return write_receive(ctx) ? -1 : 0;
+}
+
+static int watch_reader_handler(zloop_t *zloop, zsock_t *zsock, void *arg)
+{
+  (void)zloop;
+  settings_ctx_t *ctx = (settings_ctx_t *)arg;
+
+  u8 msg[SBP_PAYLOAD_SIZE_MAX];
+  int len = zmq_recv(zsock_resolve(zsock), msg, sizeof(msg), ZMQ_DONTWAIT);
+  if (len < 0) {
+    return 0;
+  }
+
+  if ((len == 0) || (len > (int)sizeof(msg)) || (msg[len-1] != '\0')) {
+    piksi_log(LOG_WARNING, "error in settings watch message");
+    return 0;
+  }
+
+  /* Extract parameters from message:
+   * 3 null terminated strings: section, setting and value
+   */
+  const char *strings[3];
+  int count = 0;
+  for (int i = 0; (i < len) && (count < 3); count++) {
+    strings[count] = (const char *)&msg[i];
+    i += strlen(strings[count]) + 1;
+  }
+  if (count < 3) {
+    piksi_log(LOG_WARNING, "error in settings watch message");
+    return 0;
+  }
+
+  for (watch_t *w = ctx->watch_list; w != NULL; w = w->next) {
+    if ((strcmp(w->section, strings[0]) == 0) &&
+        (strncmp(w->name_prefix, strings[1], strlen(w->name_prefix)) == 0)) {
+      w->watch_fn(strings[0], strings[1], strings[2], w->watch_context);
+    }
+  }
+
+  return 0;
 }
 
 static void members_destroy(settings_ctx_t *ctx)
 {
+  notify_worker_stop(&ctx->notify_worker);
+
+  if (ctx->registration_batch.timer_active) {
+    zloop_timer_end(ctx->registration_batch.zloop,
+                    ctx->registration_batch.timer_id);
+  }
+  batch_pending_free(ctx);
+
+  if (ctx->write_zsock != NULL) {
+    if (ctx->reader_zloop != NULL) {
+      zloop_reader_end(ctx->reader_zloop, ctx->write_zsock);
+    }
+    if (ctx->pubsub_ctx != NULL) {
+      zloop_reader_end(sbp_zmq_pubsub_zloop_get(ctx->pubsub_ctx),
+                       ctx->write_zsock);
+    }
+    zsock_destroy(&ctx->write_zsock);
+  }
+
+  if (ctx->watch_zsock != NULL) {
+    if (ctx->reader_zloop != NULL) {
+      zloop_reader_end(ctx->reader_zloop, ctx->watch_zsock);
+    }
+    zsock_destroy(&ctx->watch_zsock);
+  }
+
+  while (ctx->watch_list != NULL) {
+    watch_t *w = ctx->watch_list;
+    ctx->watch_list = w->next;
+    free(w->section);
+    free(w->name_prefix);
+    free(w);
+  }
+
   if (ctx->pubsub_ctx != NULL) {
     sbp_zmq_pubsub_destroy(&ctx->pubsub_ctx);
   }
@@ -610,6 +1421,9 @@ static void members_destroy(settings_ctx_t *ctx)
     free(t);
   }
 
+  free(ctx->setting_table);
+  ctx->setting_table = NULL;
+
   /* Free setting data list elements */
   while (ctx->setting_data_list != NULL) {
     setting_data_t *s = ctx->setting_data_list;
@@ -634,6 +1448,21 @@ settings_ctx_t * settings_create(void)
     return ctx;
   }
 
+  ctx->type_data_list = NULL;
+  ctx->setting_data_list = NULL;
+  ctx->setting_table = NULL;
+  ctx->setting_table_mask = 0;
+  ctx->setting_count = 0;
+  ctx->registration_state.pending = false;
+  ctx->registration_batch = (registration_batch_t) {0};
+  ctx->reader_zloop = NULL;
+  ctx->read_all_state = (read_all_state_t) {0};
+  ctx->write_zsock = NULL;
+  ctx->write_interrupt = false;
+  ctx->watch_zsock = NULL;
+  ctx->watch_list = NULL;
+  ctx->notify_worker = (notify_worker_t) {0};
+
   ctx->pubsub_ctx = sbp_zmq_pubsub_create(PUB_ENDPOINT, SUB_ENDPOINT);
   if (ctx->pubsub_ctx == NULL) {
     piksi_log(LOG_ERR, "error creating PUBSUB context");
@@ -641,9 +1470,21 @@ settings_ctx_t * settings_create(void)
     return ctx;
   }
 
-  ctx->type_data_list = NULL;
-  ctx->setting_data_list = NULL;
-  ctx->registration_state.pending = false;
+  /* Sections are subscribed to as settings are registered. Registrations
+   * wait for their replies on the loop of the PUBSUB context. */
+  ctx->write_zsock = zsock_new_sub(SETTINGS_WRITE_SUB_ENDPOINT, NULL);
+  if (ctx->write_zsock == NULL) {
+    piksi_log(LOG_ERR, "error creating settings write socket");
+    destroy(&ctx);
+    return ctx;
+  }
+
+  if (zloop_reader(sbp_zmq_pubsub_zloop_get(ctx->pubsub_ctx),
+                   ctx->write_zsock, write_reader_handler, ctx) != 0) {
+    piksi_log(LOG_ERR, "error adding settings write reader");
+    destroy(&ctx);
+    return ctx;
+  }
 
   /* Register standard types */
   settings_type_t type;
@@ -676,10 +1517,14 @@ settings_ctx_t * settings_create(void)
   }
   assert(type == SETTINGS_TYPE_BOOL);
 
-  if (sbp_zmq_rx_callback_register(sbp_zmq_pubsub_rx_ctx_get(ctx->pubsub_ctx),
-                                   SBP_MSG_SETTINGS_WRITE,
-                                   settings_write_callback, ctx, NULL) != 0) {
-    piksi_log(LOG_ERR, "error registering settings write callback");
+  if ((sbp_zmq_rx_settings_typed_write_register(
+           sbp_zmq_pubsub_rx_ctx_get(ctx->pubsub_ctx),
+           settings_typed_write_callback, ctx, NULL) != 0) ||
+      (sbp_zmq_rx_callback_register(sbp_zmq_pubsub_rx_ctx_get(ctx->pubsub_ctx),
+                                    SBP_MSG_SETTINGS_TYPED_READ_REQ,
+                                    settings_typed_read_callback,
+                                    ctx, NULL) != 0)) {
+    piksi_log(LOG_ERR, "error registering settings typed callbacks");
     destroy(&ctx);
     return ctx;
   }
@@ -718,7 +1563,7 @@ int settings_register(settings_ctx_t *ctx, const char *section,
   assert(var != NULL);
 
   return setting_register(ctx, section, name, var, var_len, type,
-                          notify, notify_context, false);
+                          notify, notify_context, NULL, false);
 }
 
 int settings_register_readonly(settings_ctx_t *ctx, const char *section,
@@ -731,14 +1576,251 @@ int settings_register_readonly(settings_ctx_t *ctx, const char *section,
   assert(var != NULL);
 
   return setting_register(ctx, section, name, (void *)var, var_len, type,
-                          NULL, NULL, true);
+                          NULL, NULL, NULL, true);
+}
+
+settings_notify_group_t * settings_notify_group_create(settings_ctx_t *ctx,
+                                                       u32 debounce_ms,
+                                                       settings_deferred_notify_fn notify,
+                                                       void *notify_context)
+{
+  assert(ctx != NULL);
+  assert(notify != NULL);
+
+  notify_worker_t *w = &ctx->notify_worker;
+  if (!w->started && (notify_worker_start(w) != 0)) {
+    return NULL;
+  }
+
+  settings_notify_group_t *group = (settings_notify_group_t *)
+                                       malloc(sizeof(*group));
+  if (group == NULL) {
+    piksi_log(LOG_ERR, "error allocating notify group");
+    return group;
+  }
+
+  *group = (settings_notify_group_t) {
+    .notify = notify,
+    .notify_context = notify_context,
+    .debounce_ms = debounce_ms,
+    .members = NULL,
+    .pending = false,
+    .next = NULL
+  };
+
+  if (pthread_mutex_init(&group->lock, NULL) != 0) {
+    piksi_log(LOG_ERR, "error initializing notify group");
+    free(group);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&w->lock);
+  group->next = w->groups;
+  w->groups = group;
+  pthread_mutex_unlock(&w->lock);
+
+  return group;
+}
+
+int settings_register_grouped(settings_ctx_t *ctx, const char *section,
+                              const char *name, void *var, size_t var_len,
+                              settings_type_t type, settings_notify_fn notify,
+                              void *notify_context,
+                              settings_notify_group_t *group,
+                              void *var_applied)
+{
+  assert(ctx != NULL);
+  assert(section != NULL);
+  assert(name != NULL);
+  assert(var != NULL);
+  assert(group != NULL);
+  assert(var_applied != NULL);
+
+  notify_group_member_t *m = (notify_group_member_t *)malloc(sizeof(*m));
+  if (m == NULL) {
+    piksi_log(LOG_ERR, "error allocating notify group member");
+    return -1;
+  }
+
+  pthread_mutex_lock(&group->lock);
+  *m = (notify_group_member_t) {
+    .var = var,
+    .var_applied = var_applied,
+    .var_len = var_len,
+    .next = group->members
+  };
+  group->members = m;
+  memcpy(var_applied, var, var_len);
+  pthread_mutex_unlock(&group->lock);
+
+  return setting_register(ctx, section, name, var, var_len, type,
+                          notify, notify_context, group, false);
+}
+
+int settings_register_batch_begin(settings_ctx_t *ctx)
+{
+  assert(ctx != NULL);
+
+  registration_batch_t *b = &ctx->registration_batch;
+  if (b->active || (b->pending != NULL)) {
+    piksi_log(LOG_ERR, "registration batch already active");
+    return -1;
+  }
+
+  b->active = true;
+  b->failed_count = 0;
+  b->tries = 0;
+  return 0;
+}
+
+int settings_register_batch_end(settings_ctx_t *ctx,
+                                settings_register_complete_fn complete,
+                                void *context)
+{
+  assert(ctx != NULL);
+
+  registration_batch_t *b = &ctx->registration_batch;
+  if (!b->active) {
+    piksi_log(LOG_ERR, "no active registration batch");
+    return -1;
+  }
+
+  b->active = false;
+  b->complete = complete;
+  b->complete_context = context;
+
+  if (b->pending == NULL) {
+    return batch_complete(ctx);
+  }
+
+  /* Collect replies from the loop the reader was added to */
+  if (ctx->reader_zloop != NULL) {
+    b->zloop = ctx->reader_zloop;
+    b->timer_id = zloop_timer(b->zloop, REGISTER_TIMEOUT_ms, 0,
+                              batch_timer_handler, ctx);
+    if (b->timer_id < 0) {
+      piksi_log(LOG_ERR, "error creating zloop timer");
+      b->zloop = NULL;
+    } else {
+      b->timer_active = true;
+      return 0;
+    }
+  }
+
+  /* Otherwise wait for them here */
+  while (1) {
+    zmq_simple_loop_timeout(sbp_zmq_pubsub_zloop_get(ctx->pubsub_ctx),
+                            REGISTER_TIMEOUT_ms);
+    if ((b->pending == NULL) || (++b->tries >= REGISTER_TRIES)) {
+      break;
+    }
+    batch_send(ctx);
+  }
+
+  return batch_complete(ctx);
+}
+
+int settings_watch_add(settings_ctx_t *ctx, const char *section,
+                       const char *name_prefix, settings_watch_fn watch_fn,
+                       void *context)
+{
+  assert(ctx != NULL);
+  assert(section != NULL);
+  assert(watch_fn != NULL);
+
+  if (name_prefix == NULL) {
+    name_prefix = "";
+  }
+
+  /* Topic is "<section>\0<name_prefix>" */
+  u8 topic[SBP_PAYLOAD_SIZE_MAX];
+  int l = snprintf((char *)topic, sizeof(topic), "%s%c%s", section, '\0',
+                   name_prefix);
+  if ((l < 0) || (l >= (int)sizeof(topic))) {
+    piksi_log(LOG_ERR, "invalid settings watch");
+    return -1;
+  }
+
+  watch_t *w = (watch_t *)malloc(sizeof(*w));
+  if (w == NULL) {
+    piksi_log(LOG_ERR, "error allocating settings watch");
+    return -1;
+  }
+
+  *w = (watch_t) {
+    .section = strdup(section),
+    .name_prefix = strdup(name_prefix),
+    .watch_fn = watch_fn,
+    .watch_context = context,
+    .next = NULL
+  };
+
+  if ((w->section == NULL) || (w->name_prefix == NULL)) {
+    piksi_log(LOG_ERR, "error allocating settings watch");
+    free(w->section);
+    free(w->name_prefix);
+    free(w);
+    return -1;
+  }
+
+  if (ctx->watch_zsock == NULL) {
+    ctx->watch_zsock = zsock_new_sub(SETTINGS_WATCH_SUB_ENDPOINT, NULL);
+    if (ctx->watch_zsock == NULL) {
+      piksi_log(LOG_ERR, "error creating settings watch socket");
+      free(w->section);
+      free(w->name_prefix);
+      free(w);
+      return -1;
+    }
+
+    if ((ctx->reader_zloop != NULL) &&
+        (zloop_reader(ctx->reader_zloop, ctx->watch_zsock,
+                      watch_reader_handler, ctx) != 0)) {
+      piksi_log(LOG_ERR, "error adding settings watch reader");
+    }
+  }
+
+  if (zmq_setsockopt(zsock_resolve(ctx->watch_zsock), ZMQ_SUBSCRIBE,
+                     topic, l) != 0) {
+    piksi_log(LOG_ERR, "error subscribing to settings watch");
+    free(w->section);
+    free(w->name_prefix);
+    free(w);
+    return -1;
+  }
+
+  w->next = ctx->watch_list;
+  ctx->watch_list = w;
+  return 0;
 }
 
 int settings_read(settings_ctx_t *ctx)
 {
   assert(ctx != NULL);
 
-  return sbp_zmq_rx_read(sbp_zmq_pubsub_rx_ctx_get(ctx->pubsub_ctx));
+  sbp_zmq_rx_ctx_t *rx_ctx = sbp_zmq_pubsub_rx_ctx_get(ctx->pubsub_ctx);
+  zmq_pollitem_t items[2];
+  if (sbp_zmq_rx_pollitem_init(rx_ctx, &items[0]) != 0) {
+    return -1;
+  }
+  items[1] = (zmq_pollitem_t) {
+    .socket = zsock_resolve(ctx->write_zsock),
+    .events = ZMQ_POLLIN
+  };
+
+  while (zmq_poll(items, 2, -1) < 0) {
+    if (errno != EINTR) {
+      piksi_log(LOG_ERR, "error in zmq_poll()");
+      return -1;
+    }
+  }
+
+  if (items[1].revents & ZMQ_POLLIN) {
+    write_receive(ctx);
+    return 0;
+  }
+
+  return sbp_zmq_rx_read(rx_ctx);
 }
 
 int settings_pollitem_init(settings_ctx_t *ctx, zmq_pollitem_t *pollitem)
@@ -755,6 +1837,11 @@ int settings_pollitem_check(settings_ctx_t *ctx, zmq_pollitem_t *pollitem)
   assert(ctx != NULL);
   assert(pollitem != NULL);
 
+  /* Write requests are not covered by the pollitem */
+  while (zsock_events(ctx->write_zsock) & ZMQ_POLLIN) {
+    write_receive(ctx);
+  }
+
   return sbp_zmq_rx_pollitem_check(sbp_zmq_pubsub_rx_ctx_get(ctx->pubsub_ctx),
                                    pollitem);
 }
@@ -764,8 +1851,28 @@ int settings_reader_add(settings_ctx_t *ctx, zloop_t *zloop)
   assert(ctx != NULL);
   assert(zloop != NULL);
 
-  return sbp_zmq_rx_reader_add(sbp_zmq_pubsub_rx_ctx_get(ctx->pubsub_ctx),
-                               zloop);
+  int result = sbp_zmq_rx_reader_add(sbp_zmq_pubsub_rx_ctx_get(ctx->pubsub_ctx),
+                                     zloop);
+  if (result != 0) {
+    return result;
+  }
+
+  if (zloop_reader(zloop, ctx->write_zsock, write_reader_handler, ctx) != 0) {
+    piksi_log(LOG_ERR, "error adding settings write reader");
+    sbp_zmq_rx_reader_remove(sbp_zmq_pubsub_rx_ctx_get(ctx->pubsub_ctx), zloop);
+    return -1;
+  }
+
+  if ((ctx->watch_zsock != NULL) &&
+      (zloop_reader(zloop, ctx->watch_zsock, watch_reader_handler, ctx) != 0)) {
+    piksi_log(LOG_ERR, "error adding settings watch reader");
+    zloop_reader_end(zloop, ctx->write_zsock);
+    sbp_zmq_rx_reader_remove(sbp_zmq_pubsub_rx_ctx_get(ctx->pubsub_ctx), zloop);
+    return -1;
+  }
+
+  ctx->reader_zloop = zloop;
+  return 0;
 }
 
 int settings_reader_remove(settings_ctx_t *ctx, zloop_t *zloop)
@@ -773,6 +1880,84 @@ int settings_reader_remove(settings_ctx_t *ctx, zloop_t *zloop)
   assert(ctx != NULL);
   assert(zloop != NULL);
 
+  if (ctx->reader_zloop == zloop) {
+    ctx->reader_zloop = NULL;
+  }
+  zloop_reader_end(zloop, ctx->write_zsock);
+  if (ctx->watch_zsock != NULL) {
+    zloop_reader_end(zloop, ctx->watch_zsock);
+  }
   return sbp_zmq_rx_reader_remove(sbp_zmq_pubsub_rx_ctx_get(ctx->pubsub_ctx),
                                   zloop);
 }
+
+int settings_read_all(settings_ctx_t *ctx, settings_read_fn read_fn,
+                      void *context)
+{
+  assert(ctx != NULL);
+  assert(read_fn != NULL);
+
+  sbp_zmq_rx_ctx_t *rx_ctx = sbp_zmq_pubsub_rx_ctx_get(ctx->pubsub_ctx);
+  sbp_zmq_tx_ctx_t *tx_ctx = sbp_zmq_pubsub_tx_ctx_get(ctx->pubsub_ctx);
+  read_all_state_t *r = &ctx->read_all_state;
+
+  /* Only listen for responses while reading, they are also sent to the
+   * console and any other reader */
+  sbp_msg_callbacks_node_t *resp_node = NULL;
+  sbp_msg_callbacks_node_t *done_node = NULL;
+  if ((sbp_zmq_rx_settings_read_by_index_resp_register(
+           rx_ctx, settings_read_by_index_resp_callback, ctx,
+           &resp_node) != 0) ||
+      (sbp_zmq_rx_callback_register(rx_ctx,
+                                    SBP_MSG_SETTINGS_READ_BY_INDEX_DONE,
+                                    settings_read_by_index_done_callback,
+                                    ctx, &done_node) != 0)) {
+    piksi_log(LOG_ERR, "error registering settings read by index callbacks");
+    if (resp_node != NULL) {
+      sbp_zmq_rx_callback_remove(rx_ctx, &resp_node);
+    }
+    return -1;
+  }
+
+  *r = (read_all_state_t) {
+    .read_fn = read_fn,
+    .read_context = context,
+    .next_index = 0,
+    .done = false
+  };
+
+  /* Request one range at a time, resuming from the first missing setting
+   * if a range is not completed in time */
+  u8 tries = 0;
+  while (!r->done && (tries < READ_ALL_TRIES)) {
+    u16 range_start = r->next_index;
+    settings_read_by_index_range_t req = {
+      .index = range_start,
+      .count = SETTINGS_READ_BY_INDEX_COUNT_MAX
+    };
+    r->range_start = range_start;
+    r->range_end = (u32)range_start + SETTINGS_READ_BY_INDEX_COUNT_MAX;
+    r->range_complete = false;
+
+    sbp_zmq_tx_send_from(tx_ctx, SBP_MSG_SETTINGS_READ_BY_INDEX_REQ,
+                         sizeof(req), (u8 *)&req, SBP_SENDER_ID);
+    zmq_simple_loop_timeout(sbp_zmq_pubsub_zloop_get(ctx->pubsub_ctx),
+                            READ_ALL_TIMEOUT_ms);
+
+    if (r->range_complete) {
+      tries = 0;
+    } else if (r->next_index == range_start) {
+      tries++;
+    }
+  }
+
+  sbp_zmq_rx_callback_remove(rx_ctx, &resp_node);
+  sbp_zmq_rx_callback_remove(rx_ctx, &done_node);
+
+  if (!r->done) {
+    piksi_log(LOG_ERR, "settings read by index failed");
+    return -1;
+  }
+
+  return 0;
+}
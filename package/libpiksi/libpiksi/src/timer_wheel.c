@@ -0,0 +1,355 @@
+/*
+ * Copyright (C) 2017 Swift Navigation Inc.
+ * Contact: Jacob McNamee <jacob@swiftnav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <libpiksi/timer_wheel.h>
+#include <libpiksi/logging.h>
+#include <time.h>
+#include <assert.h>
+
+#define WHEEL_SLOTS 256
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define BITMAP_WORDS (WHEEL_SLOTS / 64)
+
+/* Each timer sits in the slot of its absolute expiry tick. A slot may hold
+ * timers for later revolutions of the wheel, so the expiry tick is checked
+ * when the slot is processed. A bitmap of occupied slots lets the wheel skip
+ * empty slots and arm a single zloop timer for the next occupied one. */
+struct timer_wheel_timer_s {
+  timer_wheel_t *wheel;
+  timer_wheel_handler_t handler;
+  void *context;
+  u64 expiry_tick;
+  u32 period_ticks;
+  u32 missed;
+  bool active;
+  struct timer_wheel_timer_s *prev;
+  struct timer_wheel_timer_s *next;
+};
+
+struct timer_wheel_s {
+  zloop_t *zloop;
+  u64 tick_us;
+  u64 base_us;
+  u64 cursor_tick;
+  timer_wheel_timer_t *slots[WHEEL_SLOTS];
+  u64 occupied[BITMAP_WORDS];
+  u32 active_count;
+  bool armed;
+  int armed_timer_id;
+  u64 armed_tick;
+  u32 lag_last_us;
+  u32 lag_max_us;
+};
+
+static u64 now_us(const timer_wheel_t *wheel)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 - wheel->base_us;
+}
+
+/* Round up so that timers never expire early */
+static u64 us_to_ticks(const timer_wheel_t *wheel, u64 us)
+{
+  return (us + wheel->tick_us - 1) / wheel->tick_us;
+}
+
+static u64 ms_to_ticks(const timer_wheel_t *wheel, u32 ms)
+{
+  return us_to_ticks(wheel, (u64)ms * 1000);
+}
+
+static void slot_insert(timer_wheel_t *wheel, timer_wheel_timer_t *t)
+{
+  u32 slot = t->expiry_tick & WHEEL_MASK;
+  t->prev = NULL;
+  t->next = wheel->slots[slot];
+  if (t->next != NULL) {
+    t->next->prev = t;
+  }
+  wheel->slots[slot] = t;
+  wheel->occupied[slot / 64] |= (u64)1 << (slot % 64);
+  t->active = true;
+  wheel->active_count++;
+}
+
+static void slot_remove(timer_wheel_t *wheel, timer_wheel_timer_t *t)
+{
+  u32 slot = t->expiry_tick & WHEEL_MASK;
+  if (t->prev != NULL) {
+    t->prev->next = t->next;
+  } else {
+    wheel->slots[slot] = t->next;
+  }
+  if (t->next != NULL) {
+    t->next->prev = t->prev;
+  }
+  if (wheel->slots[slot] == NULL) {
+    wheel->occupied[slot / 64] &= ~((u64)1 << (slot % 64));
+  }
+  t->active = false;
+  wheel->active_count--;
+}
+
+/* Distance in ticks from the cursor to the next occupied slot, or -1 */
+static int slot_next_occupied(const timer_wheel_t *wheel)
+{
+  u32 d = 0;
+  while (d < WHEEL_SLOTS) {
+    u32 slot = (wheel->cursor_tick + d) & WHEEL_MASK;
+    u64 word = wheel->occupied[slot / 64] >> (slot % 64);
+    if (word != 0) {
+      return d + __builtin_ctzll(word);
+    }
+    d += 64 - (slot % 64);
+  }
+  return -1;
+}
+
+static int zloop_timer_handler(zloop_t *loop, int timer_id, void *arg);
+
+static void arm(timer_wheel_t *wheel)
+{
+  int d = slot_next_occupied(wheel);
+  if (d < 0) {
+    return;
+  }
+
+  u64 tick = wheel->cursor_tick + d;
+  if (wheel->armed) {
+    if (wheel->armed_tick <= tick) {
+      return;
+    }
+    zloop_timer_end(wheel->zloop, wheel->armed_timer_id);
+    wheel->armed = false;
+  }
+
+  u64 deadline_us = tick * wheel->tick_us;
+  u64 now = now_us(wheel);
+  size_t delay_ms = (deadline_us > now) ?
+                    (deadline_us - now + 999) / 1000 : 0;
+
+  int id = zloop_timer(wheel->zloop, delay_ms, 1, zloop_timer_handler, wheel);
+  if (id < 0) {
+    piksi_log(LOG_ERR, "error creating zloop timer");
+    return;
+  }
+
+  wheel->armed = true;
+  wheel->armed_timer_id = id;
+  wheel->armed_tick = tick;
+}
+
+/* Fire all timers in the slot of tick which are due. Periodic timers are
+ * rescheduled after now_tick, skipping any deadlines already missed. */
+static void slot_process(timer_wheel_t *wheel, u64 tick, u64 now_tick)
+{
+  u32 slot = tick & WHEEL_MASK;
+
+  /* Handlers may start, stop or destroy timers, so rescan the slot after
+   * each one. Rescheduled timers are never due at this tick. */
+  while (1) {
+    timer_wheel_timer_t *t = wheel->slots[slot];
+    while ((t != NULL) && (t->expiry_tick > tick)) {
+      t = t->next;
+    }
+    if (t == NULL) {
+      return;
+    }
+
+    slot_remove(wheel, t);
+    if (t->period_ticks > 0) {
+      t->expiry_tick += t->period_ticks;
+      if (t->expiry_tick <= now_tick) {
+        u64 missed = (now_tick - t->expiry_tick) / t->period_ticks + 1;
+        t->expiry_tick += missed * t->period_ticks;
+        t->missed += missed;
+      }
+      slot_insert(wheel, t);
+    }
+
+    t->handler(t, t->context);
+  }
+}
+
+static int zloop_timer_handler(zloop_t *loop, int timer_id, void *arg)
+{
+  (void)loop;
+  (void)timer_id;
+  timer_wheel_t *wheel = (timer_wheel_t *)arg;
+
+  /* One-shot zloop timer, already removed by zloop */
+  wheel->armed = false;
+
+  u64 now = now_us(wheel);
+  u64 deadline_us = wheel->armed_tick * wheel->tick_us;
+  if (now > deadline_us) {
+    u64 lag = now - deadline_us;
+    wheel->lag_last_us = (lag > UINT32_MAX) ? UINT32_MAX : lag;
+  } else {
+    wheel->lag_last_us = 0;
+  }
+  if (wheel->lag_last_us > wheel->lag_max_us) {
+    wheel->lag_max_us = wheel->lag_last_us;
+  }
+
+  u64 now_tick = now / wheel->tick_us;
+  while ((wheel->cursor_tick <= now_tick) && (wheel->active_count > 0)) {
+    int d = slot_next_occupied(wheel);
+    if ((d < 0) || (wheel->cursor_tick + d > now_tick)) {
+      break;
+    }
+    wheel->cursor_tick += d;
+    slot_process(wheel, wheel->cursor_tick, now_tick);
+    wheel->cursor_tick++;
+  }
+  wheel->cursor_tick = now_tick + 1;
+
+  arm(wheel);
+  return 0;
+}
+
+timer_wheel_t * timer_wheel_create(zloop_t *zloop, u32 resolution_ms)
+{
+  assert(zloop != NULL);
+  assert(resolution_ms > 0);
+
+  timer_wheel_t *wheel = (timer_wheel_t *)calloc(1, sizeof(*wheel));
+  if (wheel == NULL) {
+    piksi_log(LOG_ERR, "error allocating context");
+    return wheel;
+  }
+
+  wheel->zloop = zloop;
+  wheel->tick_us = (u64)resolution_ms * 1000;
+  wheel->base_us = 0;
+  wheel->base_us = now_us(wheel);
+  wheel->cursor_tick = 0;
+  wheel->armed = false;
+
+  return wheel;
+}
+
+void timer_wheel_destroy(timer_wheel_t **wheel)
+{
+  assert(wheel != NULL);
+  assert(*wheel != NULL);
+
+  timer_wheel_t *w = *wheel;
+
+  if (w->armed) {
+    zloop_timer_end(w->zloop, w->armed_timer_id);
+  }
+
+  /* Timers are owned by the caller, stop any still active */
+  for (u32 i = 0; i < WHEEL_SLOTS; i++) {
+    while (w->slots[i] != NULL) {
+      slot_remove(w, w->slots[i]);
+    }
+  }
+
+  free(w);
+  *wheel = NULL;
+}
+
+timer_wheel_timer_t * timer_wheel_timer_create(timer_wheel_t *wheel,
+                                               timer_wheel_handler_t handler,
+                                               void *context)
+{
+  assert(wheel != NULL);
+  assert(handler != NULL);
+
+  timer_wheel_timer_t *t = (timer_wheel_timer_t *)calloc(1, sizeof(*t));
+  if (t == NULL) {
+    piksi_log(LOG_ERR, "error allocating timer");
+    return t;
+  }
+
+  t->wheel = wheel;
+  t->handler = handler;
+  t->context = context;
+  t->active = false;
+
+  return t;
+}
+
+void timer_wheel_timer_destroy(timer_wheel_timer_t **timer)
+{
+  assert(timer != NULL);
+  assert(*timer != NULL);
+
+  timer_wheel_timer_stop(*timer);
+  free(*timer);
+  *timer = NULL;
+}
+
+void timer_wheel_timer_start(timer_wheel_timer_t *timer, u32 delay_ms,
+                             u32 period_ms)
+{
+  assert(timer != NULL);
+
+  timer_wheel_t *wheel = timer->wheel;
+
+  if (timer->active) {
+    slot_remove(wheel, timer);
+  }
+
+  u64 now = now_us(wheel);
+  if (wheel->active_count == 0) {
+    /* Cursor only advances while timers are active */
+    wheel->cursor_tick = now / wheel->tick_us;
+  }
+
+  /* The first tick starting at or after the deadline. Rounding the current
+   * time down to a tick would let the timer expire up to a tick early. */
+  timer->expiry_tick = us_to_ticks(wheel, now + (u64)delay_ms * 1000);
+  if (timer->expiry_tick < wheel->cursor_tick) {
+    timer->expiry_tick = wheel->cursor_tick;
+  }
+  timer->period_ticks = ms_to_ticks(wheel, period_ms);
+  if ((period_ms > 0) && (timer->period_ticks == 0)) {
+    timer->period_ticks = 1;
+  }
+  timer->missed = 0;
+
+  slot_insert(wheel, timer);
+  arm(wheel);
+}
+
+void timer_wheel_timer_stop(timer_wheel_timer_t *timer)
+{
+  assert(timer != NULL);
+
+  if (timer->active) {
+    slot_remove(timer->wheel, timer);
+  }
+}
+
+u32 timer_wheel_timer_missed_get(timer_wheel_timer_t *timer)
+{
+  assert(timer != NULL);
+  return timer->missed;
+}
+
+void timer_wheel_lag_get(timer_wheel_t *wheel, u32 *last_us, u32 *max_us)
+{
+  assert(wheel != NULL);
+
+  if (last_us != NULL) {
+    *last_us = wheel->lag_last_us;
+  }
+
+  if (max_us != NULL) {
+    *max_us = wheel->lag_max_us;
+  }
+  wheel->lag_max_us = 0;
+}
@@ -100,3 +100,21 @@ int zmq_simple_loop_timeout(zloop_t *zloop, u32 timeout_ms)
   zloop_ticket_delete(zloop, ticket);
   return result;
 }
+
+u32 fnv1a_32_update(u32 hash, const void *data, size_t len)
+{
+  const u8 *bytes = (const u8 *)data;
+  for (size_t i = 0; i < len; i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+u64 fnv1a_64_update(u64 hash, const void *data, size_t len)
+{
+  const u8 *bytes = (const u8 *)data;
+  for (size_t i = 0; i < len; i++) {
+    hash = (hash ^ bytes[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
@@ -18,12 +18,19 @@
 #include <libpiksi/settings.h>
 #include <libpiksi/logging.h>
 
+#include "notify_debounce.h"
+
 /* External settings */
 static char cellmodem_dev[32] = "ttyACM0";
 static char cellmodem_apn[32] = "INTERNET";
 static bool cellmodem_enabled;
 static int cellmodem_pppd_pid;
 
+/* Settings as applied by the notify worker thread */
+static char cellmodem_dev_applied[sizeof(cellmodem_dev)];
+static char cellmodem_apn_applied[sizeof(cellmodem_apn)];
+static bool cellmodem_enabled_applied;
+
 static int cellmodem_notify(void *context)
 {
   (void)context;
@@ -37,16 +44,17 @@ static int cellmodem_notify(void *context)
     cellmodem_pppd_pid = 0;
   }
 
-  if (!cellmodem_enabled)
+  if (!cellmodem_enabled_applied)
     return 0;
 
   char chatcmd[256];
   snprintf(chatcmd, sizeof(chatcmd),
-           "/usr/sbin/chat -v -T %s -f /etc/ppp/chatscript", cellmodem_apn);
+           "/usr/sbin/chat -v -T %s -f /etc/ppp/chatscript",
+           cellmodem_apn_applied);
 
   /* Build pppd command line */
   char *args[] = {"/usr/sbin/pppd",
-                  cellmodem_dev,
+                  cellmodem_dev_applied,
                   "connect",
                   chatcmd,
                   NULL};
@@ -58,19 +66,36 @@ static int cellmodem_notify(void *context)
     exit(EXIT_FAILURE);
   }
 
+  if (cellmodem_pppd_pid < 0) {
+    piksi_log(LOG_ERR, "error starting pppd (%d) \"%s\"",
+              errno, strerror(errno));
+    cellmodem_pppd_pid = 0;
+    return -1;
+  }
+
   return 0;
 }
 
 int cellmodem_init(settings_ctx_t *settings_ctx)
 {
-  settings_register(settings_ctx, "cell_modem", "device", &cellmodem_dev,
-                    sizeof(cellmodem_dev), SETTINGS_TYPE_STRING,
-                    cellmodem_notify, NULL);
-  settings_register(settings_ctx, "cell_modem", "APN", &cellmodem_apn,
-                    sizeof(cellmodem_apn), SETTINGS_TYPE_STRING,
-                    cellmodem_notify, NULL);
-  settings_register(settings_ctx, "cell_modem", "enable", &cellmodem_enabled,
-                    sizeof(cellmodem_enabled), SETTINGS_TYPE_BOOL,
-                    cellmodem_notify, NULL);
+  settings_notify_group_t *group =
+    settings_notify_group_create(settings_ctx, NOTIFY_DEBOUNCE_ms,
+                                 cellmodem_notify, NULL);
+  if (group == NULL) {
+    return -1;
+  }
+
+  settings_register_grouped(settings_ctx, "cell_modem", "device",
+                            &cellmodem_dev, sizeof(cellmodem_dev),
+                            SETTINGS_TYPE_STRING, NULL, NULL, group,
+                            &cellmodem_dev_applied);
+  settings_register_grouped(settings_ctx, "cell_modem", "APN",
+                            &cellmodem_apn, sizeof(cellmodem_apn),
+                            SETTINGS_TYPE_STRING, NULL, NULL, group,
+                            &cellmodem_apn_applied);
+  settings_register_grouped(settings_ctx, "cell_modem", "enable",
+                            &cellmodem_enabled, sizeof(cellmodem_enabled),
+                            SETTINGS_TYPE_BOOL, NULL, NULL, group,
+                            &cellmodem_enabled_applied);
   return 0;
 }
@@ -11,6 +11,7 @@
  */
 
 #include <libpiksi/sbp_zmq_pubsub.h>
+#include <libpiksi/sbp_zmq_rx_views.h>
 #include <libpiksi/settings.h>
 #include <libpiksi/logging.h>
 #include <libpiksi/util.h>
@@ -35,6 +36,7 @@
 #include "skylark.h"
 #include "whitelists.h"
 #include "cellmodem.h"
+#include "notify_debounce.h"
 
 #define PROGRAM_NAME "piksi_system_daemon"
 
@@ -73,24 +75,28 @@ static const char * const flow_control_enum_names[] = {"None", "RTS/CTS", NULL};
 enum {FLOW_CONTROL_NONE, FLOW_CONTROL_RTS_CTS};
 
 typedef struct {
+  const char *name;
   const char *tty_path;
   u8 baudrate;
   u8 flow_control;
 } uart_t;
 
 static uart_t uart0 = {
+  .name = "uart0",
   .tty_path = "/dev/ttyPS0",
   .baudrate = BAUDRATE_115200,
   .flow_control = FLOW_CONTROL_NONE
 };
 
 static uart_t uart1 = {
+  .name = "uart1",
   .tty_path = "/dev/ttyPS1",
   .baudrate = BAUDRATE_115200,
   .flow_control = FLOW_CONTROL_NONE
 };
 
 static uart_t usb0 = {
+  .name = "usb0",
   .tty_path = "/dev/ttyGS0",
   .baudrate = BAUDRATE_9600,
   .flow_control = FLOW_CONTROL_NONE
@@ -143,7 +149,14 @@ static int uart_configure(const uart_t *uart)
 static int baudrate_notify(void *context)
 {
   const uart_t *uart = (uart_t *)context;
-  return uart_configure(uart);
+  if (uart_configure(uart) != 0) {
+    return -1;
+  }
+
+  /* Limit SBP output to what the line can carry, 10 bits per byte for 8N1 */
+  unsigned baudrate = strtoul(baudrate_enum_names[uart->baudrate], NULL, 10);
+  whitelists_port_budget_set(uart->name, baudrate / 10);
+  return 0;
 }
 
 static int flow_control_notify(void *context)
@@ -162,13 +175,16 @@ enum {
 typedef struct {
   const char * const name;
   const char * const opts;
+  const bool dedup;
   u8 mode;
+  u8 mode_applied;
   pid_t pid;
 } adapter_config_t;
 
 static adapter_config_t uart0_adapter_config = {
   .name = "uart0",
   .opts = "--file /dev/ttyPS0",
+  .dedup = true,
   .mode = PORT_MODE_SBP,
   .pid = 0
 };
@@ -176,6 +192,7 @@ static adapter_config_t uart0_adapter_config = {
 static adapter_config_t uart1_adapter_config = {
   .name = "uart1",
   .opts = "--file /dev/ttyPS1",
+  .dedup = true,
   .mode = PORT_MODE_SBP,
   .pid = 0
 };
@@ -201,19 +218,27 @@ static adapter_config_t tcp_server1_adapter_config = {
   .pid = 0
 };
 
-int port_mode_notify(void *context)
+static int port_mode_notify(void *context)
 {
   adapter_config_t *adapter_config = (adapter_config_t *)context;
 
   char mode_opts[200] = {0};
   u16 zmq_port_pub = 0;
   u16 zmq_port_sub = 0;
-  switch (adapter_config->mode) {
+  switch (adapter_config->mode_applied) {
   case PORT_MODE_SBP:
     snprintf(mode_opts, sizeof(mode_opts),
              "-f sbp --filter-out sbp "
              "--filter-out-config /etc/%s_filter_out_config",
              adapter_config->name);
+    if (adapter_config->dedup) {
+      /* Repeated messages are dropped after the sbp filter */
+      size_t len = strlen(mode_opts);
+      snprintf(&mode_opts[len], sizeof(mode_opts) - len,
+               " --filter-out dedup "
+               "--filter-out-config /etc/%s_dedup_config",
+               adapter_config->name);
+    }
     zmq_port_pub = 43031;
     zmq_port_sub = 43030;
     break;
@@ -228,6 +253,8 @@ int port_mode_notify(void *context)
     zmq_port_sub = 45030;
     break;
   default:
+    piksi_log(LOG_ERR, "invalid port mode %d for %s",
+              adapter_config->mode_applied, adapter_config->name);
     return -1;
   }
 
@@ -240,7 +267,7 @@ int port_mode_notify(void *context)
   }
 
   /* Prepare the command used to launch zmq_adapter. */
-  char cmd[200];
+  char cmd[300];
   snprintf(cmd, sizeof(cmd),
            "zmq_adapter %s %s "
            "-p >tcp://127.0.0.1:%d "
@@ -249,10 +276,13 @@ int port_mode_notify(void *context)
 
   piksi_log(LOG_DEBUG, "Starting zmq_adapter: %s", cmd);
 
-  /* Split the command on each space for argv */
+  /* Split the command on each space for argv, the notify function runs on
+   * the settings worker thread */
   char *args[100] = {0};
-  args[0] = strtok(cmd, " ");
-  for (u8 i=1; (args[i] = strtok(NULL, " ")) && i < 100; i++);
+  char *saveptr;
+  args[0] = strtok_r(cmd, " ", &saveptr);
+  for (size_t i = 1; (i < sizeof(args) / sizeof(args[0]) - 1) &&
+                     ((args[i] = strtok_r(NULL, " ", &saveptr)) != NULL); i++);
 
   /* Create a new zmq_adapter. */
   if (!(adapter_config->pid = fork())) {
@@ -261,46 +291,61 @@ int port_mode_notify(void *context)
     exit(EXIT_FAILURE);
   }
 
-  piksi_log(LOG_DEBUG, "zmq_adapter started with PID: %d",
-            adapter_config->pid);
-
   if (adapter_config->pid < 0) {
-    /* fork() failed */
+    /* fork() failed, the port stays down until the notify is retried */
+    piksi_log(LOG_ERR, "error starting zmq_adapter for %s (%d) \"%s\"",
+              adapter_config->name, errno, strerror(errno));
+    adapter_config->pid = 0;
     return -1;
   }
 
+  piksi_log(LOG_DEBUG, "zmq_adapter started with PID: %d",
+            adapter_config->pid);
+
   return 0;
 }
 
 static const char const * ip_mode_enum_names[] = {"Static", "DHCP", NULL};
 enum {IP_CFG_STATIC, IP_CFG_DHCP};
-static u8 eth_ip_mode = IP_CFG_STATIC;
-static char eth_ip_addr[16] = "192.168.0.222";
-static char eth_netmask[16] = "255.255.255.0";
-static char eth_gateway[16] = "192.168.0.1";
+typedef struct {
+  u8 ip_mode;
+  char ip_addr[16];
+  char netmask[16];
+  char gateway[16];
+} eth_config_t;
+
+static eth_config_t eth_config = {
+  .ip_mode = IP_CFG_STATIC,
+  .ip_addr = "192.168.0.222",
+  .netmask = "255.255.255.0",
+  .gateway = "192.168.0.1"
+};
+
+/* Ethernet settings as applied by the notify worker thread */
+static eth_config_t eth_config_applied;
 
-static void eth_update_config(void)
+static int eth_update_config(void *context)
 {
+  const eth_config_t *config = (const eth_config_t *)context;
+
   system("ifdown -f eth0");
 
   FILE *interfaces = fopen("/etc/network/interfaces", "w");
-  if (eth_ip_mode == IP_CFG_DHCP) {
+  if (interfaces == NULL) {
+    piksi_log(LOG_ERR, "error opening /etc/network/interfaces");
+    return -1;
+  }
+  if (config->ip_mode == IP_CFG_DHCP) {
     fprintf(interfaces, "iface eth0 inet dhcp\n");
   } else {
     fprintf(interfaces, "iface eth0 inet static\n");
-    fprintf(interfaces, "\taddress %s\n", eth_ip_addr);
-    fprintf(interfaces, "\tnetmask %s\n", eth_netmask);
-    fprintf(interfaces, "\tgateway %s\n", eth_gateway);
+    fprintf(interfaces, "\taddress %s\n", config->ip_addr);
+    fprintf(interfaces, "\tnetmask %s\n", config->netmask);
+    fprintf(interfaces, "\tgateway %s\n", config->gateway);
   }
   fclose(interfaces);
 
   system("ifup eth0");
-}
-
-static int eth_ip_mode_notify(void *context)
-{
-  (void)context;
-  eth_update_config();
   return 0;
 }
 
@@ -312,7 +357,6 @@ static int eth_ip_config_notify(void *context)
     return -1;
   }
 
-  eth_update_config();
   return 0;
 }
 
@@ -456,18 +500,29 @@ static void sbp_network_req(u16 sender_id, u8 len, u8 msg_[], void* context)
   freeifaddrs(ifaddr);
 }
 
-static void sbp_command(u16 sender_id, u8 len, u8 msg_[], void* context)
+static void sbp_command(u16 sender_id, u8 len, const msg_command_req_t *msg,
+                        void* context)
 {
   sbp_zmq_pubsub_ctx_t *pubsub_ctx = (sbp_zmq_pubsub_ctx_t *)context;
 
-  msg_[len] = 0;
-  msg_command_req_t *msg = (msg_command_req_t *)msg_;
+  /* The payload is shared with the other callbacks of the frame. The
+   * command is used in place if the sender terminated it, otherwise it is
+   * terminated in a copy. */
+  size_t command_len = len - sizeof(*msg);
+  const char *command = msg->command;
+  char command_buf[SBP_FRAMING_MAX_PAYLOAD_SIZE + 1];
+  if (memchr(command, '\0', command_len) == NULL) {
+    memcpy(command_buf, command, command_len);
+    command_buf[command_len] = '\0';
+    command = command_buf;
+  }
+
   /* TODO As more commands are added in the future the command field will need
    * to be parsed into a command and arguments, and restrictions imposed
    * on what commands and arguments are legal.  For now we only accept one
    * canned command.
    */
-  if (strcmp(msg->command, "upgrade_tool upgrade.image_set.bin") != 0) {
+  if (strcmp(command, "upgrade_tool upgrade.image_set.bin") != 0) {
     msg_command_resp_t resp = {
       .sequence = msg->sequence,
       .code = (u32)-1,
@@ -477,7 +532,7 @@ static void sbp_command(u16 sender_id, u8 len, u8 msg_[], void* context)
     return;
   }
   struct shell_cmd_ctx *ctx = calloc(1, sizeof(*ctx));
-  ctx->pipe = popen(msg->command, "r");
+  ctx->pipe = popen(command, "r");
   ctx->sequence = msg->sequence;
   ctx->pubsub_ctx = pubsub_ctx;
   ctx->pollitem.fd = fileno(ctx->pipe);
@@ -636,7 +691,10 @@ int main(void)
   /* Configure USB0 */
   uart_configure(&usb0);
 
-  /* Register settings */
+  /* Register settings. Registrations are pipelined, replies from the
+   * settings daemon are processed once the loop is running. */
+  settings_register_batch_begin(settings_ctx);
+
   settings_type_t settings_type_baudrate;
   settings_type_register_enum(settings_ctx, baudrate_enum_names,
                               &settings_type_baudrate);
@@ -657,40 +715,61 @@ int main(void)
                     sizeof(uart1.flow_control), settings_type_flow_control,
                     flow_control_notify, &uart1);
 
+  /* Restarting a zmq_adapter or the ethernet interface is slow, so it is
+   * done on the settings worker thread once writes have settled */
+  adapter_config_t *adapter_configs[] = {
+    &uart0_adapter_config, &uart1_adapter_config, &usb0_adapter_config,
+    &tcp_server0_adapter_config, &tcp_server1_adapter_config
+  };
+
   settings_type_t settings_type_port_mode;
   settings_type_register_enum(settings_ctx, port_mode_enum_names,
                               &settings_type_port_mode);
-  settings_register(settings_ctx, "uart0", "mode", &uart0_adapter_config.mode,
-                    sizeof(uart0_adapter_config.mode), settings_type_port_mode,
-                    port_mode_notify, &uart0_adapter_config);
-  settings_register(settings_ctx, "uart1", "mode", &uart1_adapter_config.mode,
-                    sizeof(uart1_adapter_config.mode), settings_type_port_mode,
-                    port_mode_notify, &uart1_adapter_config);
-  settings_register(settings_ctx, "usb0", "mode", &usb0_adapter_config.mode,
-                    sizeof(usb0_adapter_config.mode), settings_type_port_mode,
-                    port_mode_notify, &usb0_adapter_config);
-  settings_register(settings_ctx, "tcp_server0", "mode", &tcp_server0_adapter_config.mode,
-                    sizeof(tcp_server0_adapter_config.mode), settings_type_port_mode,
-                    port_mode_notify, &tcp_server0_adapter_config);
-  settings_register(settings_ctx, "tcp_server1", "mode", &tcp_server1_adapter_config.mode,
-                    sizeof(tcp_server1_adapter_config.mode), settings_type_port_mode,
-                    port_mode_notify, &tcp_server1_adapter_config);
+  for (size_t i = 0; i < sizeof(adapter_configs) / sizeof(adapter_configs[0]);
+       i++) {
+    adapter_config_t *adapter_config = adapter_configs[i];
+    settings_notify_group_t *group =
+      settings_notify_group_create(settings_ctx, NOTIFY_DEBOUNCE_ms,
+                                   port_mode_notify, adapter_config);
+    if (group == NULL) {
+      exit(EXIT_FAILURE);
+    }
+    settings_register_grouped(settings_ctx, adapter_config->name, "mode",
+                              &adapter_config->mode,
+                              sizeof(adapter_config->mode),
+                              settings_type_port_mode, NULL, NULL, group,
+                              &adapter_config->mode_applied);
+  }
+
+  settings_notify_group_t *eth_group =
+    settings_notify_group_create(settings_ctx, NOTIFY_DEBOUNCE_ms,
+                                 eth_update_config, &eth_config_applied);
+  if (eth_group == NULL) {
+    exit(EXIT_FAILURE);
+  }
 
   settings_type_t settings_type_ip_mode;
   settings_type_register_enum(settings_ctx, ip_mode_enum_names,
                               &settings_type_ip_mode);
-  settings_register(settings_ctx, "ethernet", "ip_config_mode", &eth_ip_mode,
-                    sizeof(eth_ip_mode), settings_type_ip_mode,
-                    eth_ip_mode_notify, &eth_ip_mode);
-  settings_register(settings_ctx, "ethernet", "ip_address", &eth_ip_addr,
-                    sizeof(eth_ip_addr), SETTINGS_TYPE_STRING,
-                    eth_ip_config_notify, &eth_ip_addr);
-  settings_register(settings_ctx, "ethernet", "netmask", &eth_netmask,
-                    sizeof(eth_netmask), SETTINGS_TYPE_STRING,
-                    eth_ip_config_notify, &eth_netmask);
-  settings_register(settings_ctx, "ethernet", "gateway", &eth_gateway,
-                    sizeof(eth_gateway), SETTINGS_TYPE_STRING,
-                    eth_ip_config_notify, &eth_gateway);
+  settings_register_grouped(settings_ctx, "ethernet", "ip_config_mode",
+                            &eth_config.ip_mode, sizeof(eth_config.ip_mode),
+                            settings_type_ip_mode, NULL, NULL, eth_group,
+                            &eth_config_applied.ip_mode);
+  settings_register_grouped(settings_ctx, "ethernet", "ip_address",
+                            &eth_config.ip_addr, sizeof(eth_config.ip_addr),
+                            SETTINGS_TYPE_STRING, eth_ip_config_notify,
+                            &eth_config.ip_addr, eth_group,
+                            &eth_config_applied.ip_addr);
+  settings_register_grouped(settings_ctx, "ethernet", "netmask",
+                            &eth_config.netmask, sizeof(eth_config.netmask),
+                            SETTINGS_TYPE_STRING, eth_ip_config_notify,
+                            &eth_config.netmask, eth_group,
+                            &eth_config_applied.netmask);
+  settings_register_grouped(settings_ctx, "ethernet", "gateway",
+                            &eth_config.gateway, sizeof(eth_config.gateway),
+                            SETTINGS_TYPE_STRING, eth_ip_config_notify,
+                            &eth_config.gateway, eth_group,
+                            &eth_config_applied.gateway);
 
   sbp_zmq_rx_callback_register(sbp_zmq_pubsub_rx_ctx_get(pubsub_ctx),
                                SBP_MSG_RESET, reset_callback, NULL, NULL);
@@ -703,8 +782,10 @@ int main(void)
   cellmodem_init(settings_ctx);
 
   img_tbl_settings_setup(settings_ctx);
-  sbp_zmq_rx_callback_register(sbp_zmq_pubsub_rx_ctx_get(pubsub_ctx),
-                               SBP_MSG_COMMAND_REQ, sbp_command, pubsub_ctx, NULL);
+  settings_register_batch_end(settings_ctx, NULL, NULL);
+
+  sbp_zmq_rx_command_req_register(sbp_zmq_pubsub_rx_ctx_get(pubsub_ctx),
+                                  sbp_command, pubsub_ctx, NULL);
   sbp_zmq_rx_callback_register(sbp_zmq_pubsub_rx_ctx_get(pubsub_ctx),
                                SBP_MSG_NETWORK_STATE_REQ, sbp_network_req,
                                pubsub_ctx, NULL);
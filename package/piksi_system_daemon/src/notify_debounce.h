@@ -0,0 +1,20 @@
+/*
+ * Copyright (C) 2017 Swift Navigation Inc.
+ * Contact: Gareth McMullin <gareth@swiftnav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef __NOTIFY_DEBOUNCE_H
+#define __NOTIFY_DEBOUNCE_H
+
+/* Time without writes after which a group of related settings is applied,
+ * see settings_notify_group_create() */
+#define NOTIFY_DEBOUNCE_ms 200
+
+#endif
@@ -13,12 +13,17 @@
 #include <libpiksi/logging.h>
 
 #include "ntrip.h"
+#include "notify_debounce.h"
 
 #define FIFO_FILE_PATH "/var/run/ntrip"
 
 static bool ntrip_enabled;
 static char ntrip_url[256];
 
+/* Settings as applied by the notify worker thread */
+static bool ntrip_enabled_applied;
+static char ntrip_url_applied[sizeof(ntrip_url)];
+
 typedef struct {
   int (*execfn)(void);
   int pid;
@@ -28,7 +33,7 @@ static int ntrip_daemon_execfn(void) {
   char *argv[] = {
     "ntrip_daemon",
     "--file", FIFO_FILE_PATH,
-    "--url", ntrip_url,
+    "--url", ntrip_url_applied,
     NULL,
   };
 
@@ -58,6 +63,7 @@ static const int ntrip_processes_count =
 static int ntrip_notify(void *context)
 {
   (void)context;
+  int result = 0;
 
   for (int i=0; i<ntrip_processes_count; i++) {
     ntrip_process_t *process = &ntrip_processes[i];
@@ -71,7 +77,7 @@ static int ntrip_notify(void *context)
       process->pid = 0;
     }
 
-    if (!ntrip_enabled || strcmp(ntrip_url, "") == 0) {
+    if (!ntrip_enabled_applied || strcmp(ntrip_url_applied, "") == 0) {
       continue;
     }
 
@@ -81,22 +87,35 @@ static int ntrip_notify(void *context)
       piksi_log(LOG_ERR, "exec error (%d) \"%s\"", errno, strerror(errno));
       exit(EXIT_FAILURE);
     }
+
+    if (process->pid < 0) {
+      piksi_log(LOG_ERR, "fork error (%d) \"%s\"", errno, strerror(errno));
+      process->pid = 0;
+      result = -1;
+    }
   }
 
-  return 0;
+  return result;
 }
 
 void ntrip_init(settings_ctx_t *settings_ctx)
 {
+  settings_notify_group_t *group =
+    settings_notify_group_create(settings_ctx, NOTIFY_DEBOUNCE_ms,
+                                 ntrip_notify, NULL);
+  if (group == NULL) {
+    return;
+  }
+
   mkfifo(FIFO_FILE_PATH, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
 
-  settings_register(settings_ctx, "ntrip", "enable",
-                    &ntrip_enabled, sizeof(ntrip_enabled),
-                    SETTINGS_TYPE_BOOL,
-                    ntrip_notify, NULL);
+  settings_register_grouped(settings_ctx, "ntrip", "enable",
+                            &ntrip_enabled, sizeof(ntrip_enabled),
+                            SETTINGS_TYPE_BOOL, NULL, NULL, group,
+                            &ntrip_enabled_applied);
 
-  settings_register(settings_ctx, "ntrip", "url",
-                    &ntrip_url, sizeof(ntrip_url),
-                    SETTINGS_TYPE_STRING,
-                    ntrip_notify, NULL);
+  settings_register_grouped(settings_ctx, "ntrip", "url",
+                            &ntrip_url, sizeof(ntrip_url),
+                            SETTINGS_TYPE_STRING, NULL, NULL, group,
+                            &ntrip_url_applied);
 }
@@ -13,6 +13,7 @@
 #include <libpiksi/logging.h>
 
 #include "skylark.h"
+#include "notify_debounce.h"
 
 #define UPLOAD_FIFO_FILE_PATH   "/var/run/skylark_upload"
 #define DOWNLOAD_FIFO_FILE_PATH "/var/run/skylark_download"
@@ -21,13 +22,18 @@
 static bool skylark_enabled;
 static char skylark_url[256];
 
+/* Settings as applied by the notify worker thread */
+static bool skylark_enabled_applied;
+static char skylark_url_applied[sizeof(skylark_url)];
+
 typedef struct {
   int (*execfn)(void);
   int pid;
 } skylark_process_t;
 
 static char *get_skylark_url(void) {
-  return strcmp(skylark_url, "") == 0 ? SKYLARK_URL : skylark_url;
+  return strcmp(skylark_url_applied, "") == 0 ? SKYLARK_URL :
+                                                skylark_url_applied;
 }
 
 static int skylark_upload_daemon_execfn(void) {
@@ -49,6 +55,8 @@ static int skylark_upload_adapter_execfn(void) {
     "-s", ">tcp://127.0.0.1:43080",
     "--filter-out", "sbp",
     "--filter-out-config", "/etc/skylark_upload_filter_out_config",
+    "--filter-out", "dedup",
+    "--filter-out-config", "/etc/skylark_upload_dedup_config",
     NULL,
   };
 
@@ -92,6 +100,7 @@ static const int skylark_processes_count =
 static int skylark_notify(void *context)
 {
   (void)context;
+  int result = 0;
 
   for (int i=0; i<skylark_processes_count; i++) {
     skylark_process_t *process = &skylark_processes[i];
@@ -105,7 +114,7 @@ static int skylark_notify(void *context)
       process->pid = 0;
     }
 
-    if (!skylark_enabled) {
+    if (!skylark_enabled_applied) {
       continue;
     }
 
@@ -115,24 +124,37 @@ static int skylark_notify(void *context)
       piksi_log(LOG_ERR, "exec error (%d) \"%s\"", errno, strerror(errno));
       exit(EXIT_FAILURE);
     }
+
+    if (process->pid < 0) {
+      piksi_log(LOG_ERR, "fork error (%d) \"%s\"", errno, strerror(errno));
+      process->pid = 0;
+      result = -1;
+    }
   }
 
-  return 0;
+  return result;
 }
 
 void skylark_init(settings_ctx_t *settings_ctx)
 {
+  settings_notify_group_t *group =
+    settings_notify_group_create(settings_ctx, NOTIFY_DEBOUNCE_ms,
+                                 skylark_notify, NULL);
+  if (group == NULL) {
+    return;
+  }
+
   mkfifo(UPLOAD_FIFO_FILE_PATH, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
 
   mkfifo(DOWNLOAD_FIFO_FILE_PATH, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
 
-  settings_register(settings_ctx, "skylark", "enable",
-                    &skylark_enabled, sizeof(skylark_enabled),
-                    SETTINGS_TYPE_BOOL,
-                    skylark_notify, NULL);
+  settings_register_grouped(settings_ctx, "skylark", "enable",
+                            &skylark_enabled, sizeof(skylark_enabled),
+                            SETTINGS_TYPE_BOOL, NULL, NULL, group,
+                            &skylark_enabled_applied);
 
-  settings_register(settings_ctx, "skylark", "url",
-                    &skylark_url, sizeof(skylark_url),
-                    SETTINGS_TYPE_STRING,
-                    skylark_notify, NULL);
+  settings_register_grouped(settings_ctx, "skylark", "url",
+                            &skylark_url, sizeof(skylark_url),
+                            SETTINGS_TYPE_STRING, NULL, NULL, group,
+                            &skylark_url_applied);
 }
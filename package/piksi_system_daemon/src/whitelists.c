@@ -15,6 +15,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
 
 #include "whitelists.h"
 
@@ -30,8 +31,22 @@
  *  - Message 1234 is sent at full rate
  *  - Message 5678 is sent at half rate
  *  - Message 3456 is sent at 1/10 rate
+ * "1234@5,5678/2@1"
+ *  - Message 1234 is sent at no more than 5 Hz
+ *  - Message 5678 is sent at half rate, and no more than 1 Hz
+ *
+ * Ports with a fixed line rate (see whitelists_port_budget_set()) also get
+ * a total byte budget so the link is never oversubscribed.
  */
 
+#define WHITELIST_ENTRIES_MAX 128
+
+typedef struct {
+  unsigned id;
+  unsigned div;
+  unsigned hz;
+} whitelist_entry_t;
+
 enum port {
   PORT_UART0,
   PORT_UART1,
@@ -44,6 +59,10 @@ enum port {
 typedef struct {
   const char *name;
   char wl[256];
+  whitelist_entry_t entries[WHITELIST_ENTRIES_MAX];
+  int entries_count;
+  bool parsed;
+  unsigned budget;
 } port_whitelist_config_t;
 
 static port_whitelist_config_t port_whitelist_config[PORT_MAX] = {
@@ -69,6 +88,30 @@ static port_whitelist_config_t port_whitelist_config[PORT_MAX] = {
   }
 };
 
+static int whitelist_config_write(port_whitelist_config_t *port_whitelist_config)
+{
+  char fn[256];
+  sprintf(fn, "/etc/%s_filter_out_config", port_whitelist_config->name);
+  FILE *cfg = fopen(fn, "w");
+  if (cfg == NULL) {
+    return -1;
+  }
+  for (int i = 0; i < port_whitelist_config->entries_count; i++) {
+    const whitelist_entry_t *e = &port_whitelist_config->entries[i];
+    if (e->hz != 0) {
+      fprintf(cfg, "%x %x hz=%x\n", e->id, e->div, e->hz);
+    } else {
+      fprintf(cfg, "%x %x\n", e->id, e->div);
+    }
+  }
+  if (port_whitelist_config->budget != 0) {
+    fprintf(cfg, "budget %x\n", port_whitelist_config->budget);
+  }
+  fclose(cfg);
+
+  return 0;
+}
+
 static int whitelist_notify(void *context)
 {
   port_whitelist_config_t *port_whitelist_config =
@@ -76,30 +119,38 @@ static int whitelist_notify(void *context)
 
   char *c = port_whitelist_config->wl;
   unsigned tmp;
-  enum {PARSE_ID, PARSE_AFTER_ID, PARSE_DIV, PARSE_AFTER_DIV} state = PARSE_ID;
-  struct {
-    unsigned id;
-    unsigned div;
-  } whitelist[128];
+  enum {
+    PARSE_ID, PARSE_AFTER_ID, PARSE_DIV, PARSE_AFTER_DIV,
+    PARSE_RATE, PARSE_AFTER_RATE
+  } state = PARSE_ID;
+  whitelist_entry_t whitelist[WHITELIST_ENTRIES_MAX];
   int entries = 0;
 
   /* Simple parser for whitelist settings */
   while (*c) {
     switch (*c) {
-    /* Integer token, this is an ID or divider */
+    /* Integer token, this is an ID, divider or rate */
     case '0' ... '9':
       tmp = strtoul(c, &c, 10);
       switch (state) {
       case PARSE_ID:
+        if (entries >= WHITELIST_ENTRIES_MAX) {
+          return -1;
+        }
         state = PARSE_AFTER_ID;
         whitelist[entries].id = tmp;
         whitelist[entries].div = 1;
+        whitelist[entries].hz = 0;
         entries++;
         break;
       case PARSE_DIV:
         state = PARSE_AFTER_DIV;
         whitelist[entries-1].div = tmp;
         break;
+      case PARSE_RATE:
+        state = PARSE_AFTER_RATE;
+        whitelist[entries-1].hz = tmp;
+        break;
       default:
         return -1;
       }
@@ -115,9 +166,20 @@ static int whitelist_notify(void *context)
       }
       break;
 
+    /* Rate token, following is maximum rate in Hz */
+    case '@':
+      if ((state == PARSE_AFTER_ID) || (state == PARSE_AFTER_DIV)) {
+        state = PARSE_RATE;
+        c++;
+      } else {
+        return -1;
+      }
+      break;
+
     /* Separator token, following is message id */
     case ',':
-      if ((state == PARSE_AFTER_ID) || (state == PARSE_AFTER_DIV)) {
+      if ((state == PARSE_AFTER_ID) || (state == PARSE_AFTER_DIV) ||
+          (state == PARSE_AFTER_RATE)) {
         state = PARSE_ID;
         c++;
       } else {
@@ -132,17 +194,33 @@ static int whitelist_notify(void *context)
   }
 
   /* Parsed successfully, write config file and accept setting */
-  char fn[256];
-  sprintf(fn, "/etc/%s_filter_out_config", port_whitelist_config->name);
-  FILE *cfg = fopen(fn, "w");
-  for (int i = 0; i < entries; i++) {
-    fprintf(cfg, "%x %x\n", whitelist[i].id, whitelist[i].div);
-  }
-  fclose(cfg);
+  memcpy(port_whitelist_config->entries, whitelist,
+         entries * sizeof(whitelist[0]));
+  port_whitelist_config->entries_count = entries;
+  port_whitelist_config->parsed = true;
+  whitelist_config_write(port_whitelist_config);
 
   return 0;
 }
 
+void whitelists_port_budget_set(const char *name, unsigned bytes_per_s)
+{
+  for (int i = 0; i < PORT_MAX; i++) {
+    port_whitelist_config_t *p = &port_whitelist_config[i];
+    if (strcmp(p->name, name) != 0) {
+      continue;
+    }
+
+    p->budget = bytes_per_s;
+
+    /* Don't write out a budget without the whitelist it applies to */
+    if (p->parsed) {
+      whitelist_config_write(p);
+    }
+    return;
+  }
+}
+
 int whitelists_init(settings_ctx_t *settings_ctx)
 {
   for (int i = 0; i < PORT_MAX; i++) {
@@ -16,5 +16,6 @@
 #include <libpiksi/settings.h>
 
 int whitelists_init(settings_ctx_t *settings_ctx);
+void whitelists_port_budget_set(const char *name, unsigned bytes_per_s);
 
 #endif
@@ -18,6 +18,10 @@
 
 #define PROGRAM_NAME "sbp_fileio_daemon"
 
+/* A single worker keeps requests in order, e.g. a remove followed by
+ * writes to the same file, while disk access no longer blocks the loop */
+#define WORKER_THREADS 1
+
 static const char *pub_endpoint = NULL;
 static const char *sub_endpoint = NULL;
 
@@ -88,11 +92,18 @@ int main(int argc, char *argv[])
     exit(EXIT_FAILURE);
   }
 
-  sbp_fileio_setup(sbp_zmq_pubsub_rx_ctx_get(ctx),
-                   sbp_zmq_pubsub_tx_ctx_get(ctx));
+  sbp_zmq_workers_ctx_t *workers_ctx =
+      sbp_zmq_workers_create(sbp_zmq_pubsub_rx_ctx_get(ctx), pub_endpoint,
+                             WORKER_THREADS);
+  if (workers_ctx == NULL) {
+    exit(EXIT_FAILURE);
+  }
+
+  sbp_fileio_setup(workers_ctx);
 
   zmq_simple_loop(sbp_zmq_pubsub_zloop_get(ctx));
 
+  sbp_zmq_workers_destroy(&workers_ctx);
   sbp_zmq_pubsub_destroy(&ctx);
   exit(EXIT_SUCCESS);
 }
@@ -17,30 +17,49 @@
 #include <unistd.h>
 
 #include <libpiksi/logging.h>
+#include <libpiksi/sbp_zmq_workers_views.h>
 #include <libsbp/file_io.h>
 
 #include "sbp_fileio.h"
 
 #define SBP_FRAMING_MAX_PAYLOAD_SIZE 255
 
-static void read_cb(u16 sender_id, u8 len, u8 msg[], void* context);
-static void read_dir_cb(u16 sender_id, u8 len, u8 msg[], void* context);
-static void remove_cb(u16 sender_id, u8 len, u8 msg[], void* context);
-static void write_cb(u16 sender_id, u8 len, u8 msg[], void* context);
+static void read_cb(u16 sender_id, u8 len, const msg_fileio_read_req_t *msg,
+                    sbp_zmq_tx_ctx_t *tx_ctx, void *context);
+static void read_dir_cb(u16 sender_id, u8 len,
+                        const msg_fileio_read_dir_req_t *msg,
+                        sbp_zmq_tx_ctx_t *tx_ctx, void *context);
+static void remove_cb(u16 sender_id, u8 len, const msg_fileio_remove_t *msg,
+                      sbp_zmq_tx_ctx_t *tx_ctx, void *context);
+static void write_cb(u16 sender_id, u8 len, const msg_fileio_write_req_t *msg,
+                     sbp_zmq_tx_ctx_t *tx_ctx, void *context);
+
+/** Get a null terminated path from a message.
+ * The message payload is used in place if the sender included the null
+ * termination, otherwise it is copied to buf, which must hold len + 1 bytes.
+ */
+static const char * path_get(const char *path, size_t len, char *buf)
+{
+  if (memchr(path, '\0', len) != NULL) {
+    return path;
+  }
+
+  memcpy(buf, path, len);
+  buf[len] = '\0';
+  return buf;
+}
 
 /** Setup file IO
- * Registers relevant SBP callbacks for file IO operations.
+ * Registers relevant SBP callbacks for file IO operations. The callbacks
+ * block on disk access and are executed by the worker pool, responses are
+ * sent from the worker's TX context.
  */
-void sbp_fileio_setup(sbp_zmq_rx_ctx_t *rx_ctx, sbp_zmq_tx_ctx_t *tx_ctx)
+void sbp_fileio_setup(sbp_zmq_workers_ctx_t *workers_ctx)
 {
-  sbp_zmq_rx_callback_register(rx_ctx, SBP_MSG_FILEIO_READ_REQ,
-                               read_cb, tx_ctx, NULL);
-  sbp_zmq_rx_callback_register(rx_ctx, SBP_MSG_FILEIO_READ_DIR_REQ,
-                               read_dir_cb, tx_ctx, NULL);
-  sbp_zmq_rx_callback_register(rx_ctx, SBP_MSG_FILEIO_REMOVE,
-                               remove_cb, tx_ctx, NULL);
-  sbp_zmq_rx_callback_register(rx_ctx, SBP_MSG_FILEIO_WRITE_REQ,
-                               write_cb, tx_ctx, NULL);
+  sbp_zmq_workers_fileio_read_req_register(workers_ctx, read_cb, NULL);
+  sbp_zmq_workers_fileio_read_dir_req_register(workers_ctx, read_dir_cb, NULL);
+  sbp_zmq_workers_fileio_remove_register(workers_ctx, remove_cb, NULL);
+  sbp_zmq_workers_fileio_write_req_register(workers_ctx, write_cb, NULL);
 }
 
 /** File read callback.
@@ -50,25 +69,25 @@ void sbp_fileio_setup(sbp_zmq_rx_ctx_t *rx_ctx, sbp_zmq_tx_ctx_t *tx_ctx)
  * data in a SBP_MSG_FILEIO_READ_RESP message where the message length field
  * indicates how many bytes were succesfully read.
  */
-static void read_cb(u16 sender_id, u8 len, u8 msg_[], void *context)
+static void read_cb(u16 sender_id, u8 len, const msg_fileio_read_req_t *msg,
+                    sbp_zmq_tx_ctx_t *tx_ctx, void *context)
 {
   (void)sender_id;
-  msg_fileio_read_req_t *msg = (msg_fileio_read_req_t *)msg_;
-  sbp_zmq_tx_ctx_t *tx_ctx = (sbp_zmq_tx_ctx_t *)context;
+  (void)context;
 
   if ((len <= sizeof(*msg)) || (len == SBP_FRAMING_MAX_PAYLOAD_SIZE)) {
     piksi_log(LOG_WARNING, "Invalid fileio read message!");
     return;
   }
 
-  /* Add a null termination to filename */
-  msg_[len] = 0;
+  char buf[SBP_FRAMING_MAX_PAYLOAD_SIZE + 1];
+  const char *filename = path_get(msg->filename, len - sizeof(*msg), buf);
 
   msg_fileio_read_resp_t *reply;
   int readlen = MIN(msg->chunk_size, SBP_FRAMING_MAX_PAYLOAD_SIZE - sizeof(*reply));
   reply = alloca(sizeof(msg_fileio_read_resp_t) + readlen);
   reply->sequence = msg->sequence;
-  int f = open(msg->filename, O_RDONLY);
+  int f = open(filename, O_RDONLY);
   lseek(f, msg->offset, SEEK_SET);
   readlen = read(f, &reply->contents, readlen);
   if (readlen < 0)
@@ -88,25 +107,26 @@ static void read_cb(u16 sender_id, u8 len, u8 msg_[], void *context)
  * Returns a SBP_MSG_FILEIO_READ_DIR_RESP message containing the directory
  * listings as a NULL delimited list.
  */
-static void read_dir_cb(u16 sender_id, u8 len, u8 msg_[], void *context)
+static void read_dir_cb(u16 sender_id, u8 len,
+                        const msg_fileio_read_dir_req_t *msg,
+                        sbp_zmq_tx_ctx_t *tx_ctx, void *context)
 {
   (void)sender_id;
-  msg_fileio_read_dir_req_t *msg = (msg_fileio_read_dir_req_t *)msg_;
-  sbp_zmq_tx_ctx_t *tx_ctx = (sbp_zmq_tx_ctx_t *)context;
+  (void)context;
 
   if ((len <= sizeof(*msg)) || (len == SBP_FRAMING_MAX_PAYLOAD_SIZE)) {
     piksi_log(LOG_WARNING, "Invalid fileio read dir message!");
     return;
   }
 
-  /* Add a null termination to dirname */
-  msg_[len] = 0;
+  char buf[SBP_FRAMING_MAX_PAYLOAD_SIZE + 1];
+  const char *dirname = path_get(msg->dirname, len - sizeof(*msg), buf);
 
   struct dirent *dirent;
   u32 offset = msg->offset;
   msg_fileio_read_dir_resp_t *reply = alloca(SBP_FRAMING_MAX_PAYLOAD_SIZE);
   reply->sequence = msg->sequence;
-  DIR *dir = opendir(msg->dirname);
+  DIR *dir = opendir(dirname);
   while (offset && (dirent = readdir(dir)))
     offset--;
 
@@ -128,8 +148,10 @@ static void read_dir_cb(u16 sender_id, u8 len, u8 msg_[], void *context)
 /* Remove file callback.
  * Responds to a SBP_MSG_FILEIO_REMOVE message.
  */
-static void remove_cb(u16 sender_id, u8 len, u8 msg[], void *context)
+static void remove_cb(u16 sender_id, u8 len, const msg_fileio_remove_t *msg,
+                      sbp_zmq_tx_ctx_t *tx_ctx, void *context)
 {
+  (void)tx_ctx;
   (void)context;
   (void)sender_id;
 
@@ -138,10 +160,8 @@ static void remove_cb(u16 sender_id, u8 len, u8 msg[], void *context)
     return;
   }
 
-  /* Add a null termination to filename */
-  msg[len] = 0;
-
-  unlink((char*)msg);
+  char buf[SBP_FRAMING_MAX_PAYLOAD_SIZE + 1];
+  unlink(path_get(msg->filename, len, buf));
 }
 
 /* Write to file callback.
@@ -151,15 +171,15 @@ static void remove_cb(u16 sender_id, u8 len, u8 msg[], void *context)
  * of the original SBP_MSG_FILEIO_WRITE_RESP message to check integrity of
  * the write.
  */
-static void write_cb(u16 sender_id, u8 len, u8 msg_[], void *context)
+static void write_cb(u16 sender_id, u8 len, const msg_fileio_write_req_t *msg,
+                     sbp_zmq_tx_ctx_t *tx_ctx, void *context)
 {
   (void)sender_id;
-  msg_fileio_write_req_t *msg = (msg_fileio_write_req_t *)msg_;
-  sbp_zmq_tx_ctx_t *tx_ctx = (sbp_zmq_tx_ctx_t *)context;
+  (void)context;
 
+  /* The filename must be terminated within the message, data follows it */
   if ((len <= sizeof(*msg) + 2) ||
-      (strnlen(msg->filename, SBP_FRAMING_MAX_PAYLOAD_SIZE - sizeof(*msg)) ==
-                              SBP_FRAMING_MAX_PAYLOAD_SIZE - sizeof(*msg))) {
+      (strnlen(msg->filename, len - sizeof(*msg)) == len - sizeof(*msg))) {
     piksi_log(LOG_WARNING, "Invalid fileio write message!");
     return;
   }
@@ -167,7 +187,7 @@ static void write_cb(u16 sender_id, u8 len, u8 msg_[], void *context)
   u8 headerlen = sizeof(*msg) + strlen(msg->filename) + 1;
   int f = open(msg->filename, O_WRONLY | O_CREAT, 0666);
   lseek(f, msg->offset, SEEK_SET);
-  write(f, msg_ + headerlen, len - headerlen);
+  write(f, (const u8 *)msg + headerlen, len - headerlen);
   close(f);
 
   msg_fileio_write_resp_t reply = {.sequence = msg->sequence};
@@ -13,10 +13,9 @@
 #ifndef SWIFTNAV_SBP_FILEIO_H
 #define SWIFTNAV_SBP_FILEIO_H
 
-#include <libpiksi/sbp_zmq_rx.h>
-#include <libpiksi/sbp_zmq_tx.h>
+#include <libpiksi/sbp_zmq_workers.h>
 
-void sbp_fileio_setup(sbp_zmq_rx_ctx_t *rx_ctx, sbp_zmq_tx_ctx_t *tx_ctx);
+void sbp_fileio_setup(sbp_zmq_workers_ctx_t *workers_ctx);
 
 #endif
 
@@ -7,7 +7,7 @@
 SBP_LOG_VERSION = 0.1
 SBP_LOG_SITE = "${BR2_EXTERNAL}/package/sbp_log/src"
 SBP_LOG_SITE_METHOD = local
-SBP_LOG_DEPENDENCIES = czmq libsbp
+SBP_LOG_DEPENDENCIES = czmq libsbp libpiksi
 
 define SBP_LOG_BUILD_CMDS
     $(MAKE) CC=$(TARGET_CC) LD=$(TARGET_LD) -C $(@D) all
@@ -10,71 +10,152 @@
  * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
  */
 
-#include <libsbp/sbp.h>
+#include <libpiksi/sbp_zmq_tx.h>
+#include <libpiksi/logging.h>
 #include <libsbp/logging.h>
-#include <czmq.h>
 #include <getopt.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+
+#define PROGRAM_NAME "sbp_log"
 
 #define SBP_FRAMING_MAX_PAYLOAD_SIZE 255
-static u16 sbp_sender_id = SBP_SENDER_ID;
-static zsock_t *zpub;
-static sbp_state_t sbp;
-static u8 buf[SBP_FRAMING_MAX_PAYLOAD_SIZE];
-static u8 buf_len;
+#define TEXT_SIZE_MAX (SBP_FRAMING_MAX_PAYLOAD_SIZE - sizeof(msg_log_t))
 
-static u32 sbp_write(u8 *b, u32 n, void *context)
-{
-  (void)context;
-  n = MIN(n, sizeof(buf));
-  memcpy(&buf[buf_len], b, n);
-  buf_len += n;
-  return n;
-}
+#define PUB_ENDPOINT ">tcp://localhost:43011"
+
+/* Lines written to the FIFO are "<level> <text>\n". Each line is written with
+ * a single write() of less than PIPE_BUF bytes, so lines from concurrent
+ * writers are not interleaved. */
+#define FIFO_PATH "/var/run/sbp_log.fifo"
+#define FIFO_LINE_SIZE_MAX (TEXT_SIZE_MAX + 8)
+
+#define OPT_ID_DAEMON 8
+
+static zsock_t *zpub = NULL;
+static sbp_zmq_tx_ctx_t *tx_ctx = NULL;
 
-static void sbp_write_flush(void)
+static int tx_open(void)
 {
-  zmsg_t *msg = zmsg_new();
-  zmsg_addmem(msg, buf, buf_len);
-  zmsg_send(&msg, zpub);
-  buf_len = 0;
+  zpub = zsock_new_pub(PUB_ENDPOINT);
+  if (zpub == NULL) {
+    fprintf(stderr, "error creating PUB socket\n");
+    return -1;
+  }
+
+  tx_ctx = sbp_zmq_tx_create(zpub);
+  if (tx_ctx == NULL) {
+    fprintf(stderr, "error creating TX context\n");
+    zsock_destroy(&zpub);
+    return -1;
+  }
+
+  /* Delay for long enough for socket thread to sort itself out */
+  usleep(100000);
+  return 0;
 }
 
-static void sbp_send_msg(sbp_state_t *sbp, u16 msg_type, u8 len, u8 buff[])
+static void tx_close(void)
 {
-  sbp_send_message(sbp, msg_type, sbp_sender_id, len, buff, sbp_write);
-  sbp_write_flush();
+  if (tx_ctx != NULL) {
+    sbp_zmq_tx_destroy(&tx_ctx);
+  }
+
+  if (zpub != NULL) {
+    zsock_destroy(&zpub);
+  }
 }
 
-static int file_read_string(const char *filename, char *str, size_t str_size)
+/* Read lines from the FIFO and publish them over a persistent socket */
+static int daemon_run(void)
 {
-  FILE *fp = fopen(filename, "r");
-  if (fp == NULL) {
-    fprintf(stderr, "error opening %s\n", filename);
+  logging_init(PROGRAM_NAME);
+
+  if ((mkfifo(FIFO_PATH, 0666) != 0) && (errno != EEXIST)) {
+    piksi_log(LOG_ERR, "error creating %s", FIFO_PATH);
     return -1;
   }
 
-  bool success = (fgets(str, str_size, fp) != NULL);
+  /* Opening for read and write keeps the FIFO open without writers */
+  int fd = open(FIFO_PATH, O_RDWR);
+  if (fd < 0) {
+    piksi_log(LOG_ERR, "error opening %s", FIFO_PATH);
+    return -1;
+  }
 
-  fclose(fp);
+  FILE *fifo = fdopen(fd, "r");
+  if (fifo == NULL) {
+    piksi_log(LOG_ERR, "error opening %s", FIFO_PATH);
+    close(fd);
+    return -1;
+  }
 
-  if (!success) {
-    fprintf(stderr, "error reading %s\n", filename);
+  if (tx_open() != 0) {
+    fclose(fifo);
     return -1;
   }
 
+  char line[FIFO_LINE_SIZE_MAX + 1];
+  while (fgets(line, sizeof(line), fifo) != NULL) {
+    char *text;
+    unsigned long level = strtoul(line, &text, 10);
+    if ((text == line) || (*text != ' ') || (level > LOG_DEBUG)) {
+      piksi_log(LOG_WARNING, "invalid line");
+      continue;
+    }
+    sbp_log(tx_ctx, level, "%s", text + 1);
+  }
+
+  tx_close();
+  fclose(fifo);
+  logging_deinit();
   return 0;
 }
 
-int main(int argc, char *argv[])
+/* Hand lines to the daemon, or publish them directly if it is not running */
+static int client_run(int level)
 {
-  char sbp_sender_id_string[32];
-  if (file_read_string("/cfg/sbp_sender_id", sbp_sender_id_string,
-                        sizeof(sbp_sender_id_string)) == 0) {
-    sbp_sender_id = strtoul(sbp_sender_id_string, NULL, 10);
+  signal(SIGPIPE, SIG_IGN);
+
+  /* Fails with ENXIO if there is no reader */
+  int fifo_fd = open(FIFO_PATH, O_WRONLY | O_NONBLOCK);
+
+  char text[TEXT_SIZE_MAX];
+  while (fgets(text, sizeof(text), stdin)) {
+    if (fifo_fd >= 0) {
+      char line[FIFO_LINE_SIZE_MAX + 1];
+      size_t text_len = strlen(text);
+      bool newline = (text_len > 0) && (text[text_len - 1] == '\n');
+      int line_len = snprintf(line, sizeof(line), "%d %s%s", level, text,
+                              newline ? "" : "\n");
+      if (write(fifo_fd, line, line_len) == line_len) {
+        continue;
+      }
+      /* Daemon gone or FIFO full */
+      close(fifo_fd);
+      fifo_fd = -1;
+    }
+
+    if ((tx_ctx == NULL) && (tx_open() != 0)) {
+      return -1;
+    }
+    sbp_log(tx_ctx, level, "%s", text);
   }
 
-  msg_log_t *msg = alloca(SBP_FRAMING_MAX_PAYLOAD_SIZE);
+  if (fifo_fd >= 0) {
+    close(fifo_fd);
+  }
+  tx_close();
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  int level = LOG_INFO;
+  bool daemon_mode = false;
+
   const static struct option long_options[] = {
     {"emerg", no_argument, NULL, 0},
     {"alert", no_argument, NULL, 1},
@@ -84,29 +165,24 @@ int main(int argc, char *argv[])
     {"notice", no_argument, NULL, 5},
     {"info", no_argument, NULL, 6},
     {"debug", no_argument, NULL, 7},
+    {"daemon", no_argument, NULL, OPT_ID_DAEMON},
     {0, 0, 0, 0},
   };
   int opt;
-  while ((opt = getopt_long(argc, argv, "", long_options, NULL)) > 0) {
+  while ((opt = getopt_long(argc, argv, "", long_options, NULL)) >= 0) {
+    if (opt == OPT_ID_DAEMON) {
+      daemon_mode = true;
+      continue;
+    }
     if ((unsigned)opt > 7) {
       fprintf(stderr, "Invalid argument\n");
       return -1;
     }
-    msg->level = opt;
+    level = opt;
   }
 
-  sbp_state_init(&sbp);
-  zpub =  zsock_new_pub(">tcp://localhost:43011");
-  /* Delay for long enough for socket thread to sort itself out */
-  usleep(100000);
-
-  while (fgets(msg->text,
-               SBP_FRAMING_MAX_PAYLOAD_SIZE - offsetof(msg_log_t, text),
-               stdin)) {
-    sbp_send_msg(&sbp, SBP_MSG_LOG, sizeof(*msg) + strlen(msg->text), (u8*)msg);
-  }
+  /* Prevent czmq from catching signals */
+  zsys_handler_set(NULL);
 
-  zsock_destroy(&zpub);
-
-  return 0;
+  return daemon_mode ? daemon_run() : client_run(level);
 }
@@ -42,6 +42,33 @@ int sbp_message_send(u16 msg_type, u8 len, u8 *payload)
   return sbp_zmq_tx_send(ctx.tx_ctx, msg_type, len, payload);
 }
 
+int sbp_message_batch_begin(void)
+{
+  if (ctx.tx_ctx == NULL) {
+    return -1;
+  }
+
+  return sbp_zmq_tx_batch_begin(ctx.tx_ctx);
+}
+
+int sbp_message_batch_append(u16 msg_type, u8 len, u8 *payload)
+{
+  if (ctx.tx_ctx == NULL) {
+    return -1;
+  }
+
+  return sbp_zmq_tx_batch_append(ctx.tx_ctx, msg_type, len, payload);
+}
+
+int sbp_message_batch_flush(void)
+{
+  if (ctx.tx_ctx == NULL) {
+    return -1;
+  }
+
+  return sbp_zmq_tx_batch_flush(ctx.tx_ctx);
+}
+
 int sbp_callback_register(u16 msg_type, sbp_msg_callback_t cb, void *context)
 {
   if (ctx.rx_ctx == NULL) {
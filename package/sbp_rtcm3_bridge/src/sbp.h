@@ -18,6 +18,9 @@
 
 int sbp_init(sbp_zmq_rx_ctx_t *rx_ctx, sbp_zmq_tx_ctx_t *tx_ctx);
 int sbp_message_send(u16 msg_type, u8 len, u8 *payload);
+int sbp_message_batch_begin(void);
+int sbp_message_batch_append(u16 msg_type, u8 len, u8 *payload);
+int sbp_message_batch_flush(void);
 int sbp_callback_register(u16 msg_type, sbp_msg_callback_t cb, void *context);
 
 #endif /* SWIFTNAV_SBP_H */
@@ -22,6 +22,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+/* Debug logging is called for every RTCM frame */
+#define DEBUG_LOG_WINDOW_ms 1000
+#define DEBUG_LOG_BURST 10
+
 // time given from rover observation data. Must be maintained to within half a week of
 // the epoch of incoming RTCM data
 static gps_time_nano_t time_from_rover_obs = { .tow = 0, .ns_residual = 0, .wn = .0 };
@@ -72,9 +76,11 @@ void rtcm3_decode_frame(const uint8_t *frame, uint32_t frame_length) {
                                           sizeof(packed_obs_content_t)));
       }
       u8 num_messages = rtcm3_obs_to_sbp(&rtcm_msg, sbp_obs, sizes);
+      sbp_message_batch_begin();
       for (u8 msg = 0; msg < num_messages; ++msg) {
-        sbp_message_send(SBP_MSG_OBS, sizes[msg], (u8 *)sbp_obs[msg]);
+        sbp_message_batch_append(SBP_MSG_OBS, sizes[msg], (u8 *)sbp_obs[msg]);
       }
+      sbp_message_batch_flush();
     }
     break;
   }
@@ -105,8 +111,9 @@ void rtcm3_decode_frame(const uint8_t *frame, uint32_t frame_length) {
   }
 
   if (rtcm3_debug) {
-    piksi_log(LOG_DEBUG,"message type: %u, length: %u, count: %u\n", message_type,
-              frame_length, ++count);
+    piksi_log_ratelimited(DEBUG_LOG_WINDOW_ms, DEBUG_LOG_BURST, LOG_DEBUG,
+                          "message type: %u, length: %u, count: %u",
+                          message_type, frame_length, ++count);
   }
 }
 
@@ -500,13 +507,13 @@ void wgsecef2llh(const double ecef[3], double llh[3]) {
            sqrt(e_c * e_c * C * C + S * S);
 }
 
-void gps_time_callback(u16 sender_id, u8 len, u8 msg[], void *context)
+void gps_time_callback(u16 sender_id, u8 len, const msg_gps_time_t *msg,
+                       void *context)
 {
   (void) context;
   (void) sender_id;
   (void) len;
-  msg_gps_time_t *time = (msg_gps_time_t*)msg;
-  time_from_rover_obs.wn = time->wn;
-  time_from_rover_obs.tow = time->tow;
-  time_from_rover_obs.ns_residual = time->ns_residual;
+  time_from_rover_obs.wn = msg->wn;
+  time_from_rover_obs.tow = msg->tow;
+  time_from_rover_obs.ns_residual = msg->ns_residual;
 }
@@ -18,6 +18,7 @@
 #include <getopt.h>
 #include <libpiksi/sbp_zmq_pubsub.h>
 #include <libpiksi/sbp_zmq_rx.h>
+#include <libpiksi/sbp_zmq_rx_views.h>
 #include <libpiksi/util.h>
 #include <libsbp/navigation.h>
 #include <stdint.h>
@@ -32,6 +33,7 @@
 #define SBP_PUB_ENDPOINT    ">tcp://127.0.0.1:43031"  /* SBP External In */
 
 bool rtcm3_debug = false;
+static const char *log_binary_path = NULL;
 
 static int rtcm3_reader_handler(zloop_t *zloop, zsock_t *zsock, void *arg)
 {
@@ -66,16 +68,19 @@ static void usage(char *command)
 
   puts("\nMisc options");
   puts("\t--debug");
+  puts("\t--log-binary <file>");
 }
 
 static int parse_options(int argc, char *argv[])
 {
   enum {
     OPT_ID_DEBUG = 1,
+    OPT_ID_LOG_BINARY,
   };
 
   const struct option long_opts[] = {
-    {"debug", no_argument,       0, OPT_ID_DEBUG},
+    {"debug",      no_argument,       0, OPT_ID_DEBUG},
+    {"log-binary", required_argument, 0, OPT_ID_LOG_BINARY},
     {0, 0, 0, 0},
   };
 
@@ -87,6 +92,11 @@ static int parse_options(int argc, char *argv[])
       }
         break;
 
+      case OPT_ID_LOG_BINARY: {
+        log_binary_path = optarg;
+      }
+        break;
+
       default: {
         puts("Invalid option");
         return -1;
@@ -107,6 +117,11 @@ int main(int argc, char *argv[])
     exit(EXIT_FAILURE);
   }
 
+  if ((log_binary_path != NULL) &&
+      (logging_binary_output_set(log_binary_path) != 0)) {
+    piksi_log(LOG_WARNING, "error opening binary log, using system log");
+  }
+
   /* Prevent czmq from catching signals */
   zsys_handler_set(NULL);
 
@@ -134,7 +149,8 @@ int main(int argc, char *argv[])
     exit(EXIT_FAILURE);
   }
 
-  if (sbp_callback_register(SBP_MSG_GPS_TIME, gps_time_callback, NULL) != 0) {
+  if (sbp_zmq_rx_gps_time_register(sbp_zmq_pubsub_rx_ctx_get(ctx),
+                                   gps_time_callback, NULL, NULL) != 0) {
     piksi_log(LOG_ERR, "error setting GPS TIME callback");
     exit(EXIT_FAILURE);
   }
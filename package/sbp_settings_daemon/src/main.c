@@ -33,7 +33,8 @@ int main(void)
   }
 
   settings_setup(sbp_zmq_pubsub_rx_ctx_get(ctx),
-                 sbp_zmq_pubsub_tx_ctx_get(ctx));
+                 sbp_zmq_pubsub_tx_ctx_get(ctx),
+                 sbp_zmq_pubsub_zloop_get(ctx));
 
   zmq_simple_loop(sbp_zmq_pubsub_zloop_get(ctx));
 
@@ -11,65 +11,596 @@
  */
 
 #include <libpiksi/logging.h>
+#include <libpiksi/sbp_zmq_rx_views.h>
+#include <libpiksi/settings_protocol.h>
+#include <libpiksi/timer_wheel.h>
+#include <libpiksi/util.h>
 #include <libsbp/settings.h>
 
 #include <string.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <assert.h>
 
 #include "minIni/minIni.h"
 
 #include "settings.h"
 
-#define SETTINGS_FILE "/persistent/config.ini"
+/* Host builds keep the config file out of /persistent */
+#ifndef SETTINGS_DIR
+#define SETTINGS_DIR "/persistent"
+#endif
+#define SETTINGS_FILE SETTINGS_DIR "/config.ini"
+#define SETTINGS_FILE_TMP SETTINGS_FILE ".tmp"
 #define BUFSIZE 256
+#define SBP_PAYLOAD_SIZE_MAX 255
 
+#define TABLE_SIZE_INIT 256
+#define INDEX_SIZE_INIT 128
+#define SECTIONS_SIZE_INIT 16
+#define INTERN_SIZE_INIT 64
+#define ARENA_CHUNK_SIZE 4096
+#define VALUE_SIZE_ALIGN 8
+#define CONFIG_SIZE_INIT 64
+#define WATCH_PENDING_SIZE_INIT 16
+#define TIMER_RESOLUTION_ms 10
+#define WATCH_COALESCE_ms 50
+#define SNAPSHOT_SIZE_MAX (1024 * 1024)
+#define SNAPSHOT_TIMEOUT_ms 500
+#define SNAPSHOT_TRIES 4
+
+/* Section and type strings are interned, so settings of the same section or
+ * type share a single copy. Names, values and the settings themselves are
+ * carved out of an arena, since settings are never unregistered. A value
+ * is rewritten in place when it fits in value_size, otherwise a new slot is
+ * taken from the arena. */
 struct setting {
-  char section[BUFSIZE];
-  char name[BUFSIZE];
-  char type[BUFSIZE];
-  char value[BUFSIZE];
-  struct setting *next;
+  const char *section;
+  const char *name;
+  const char *type;
+  char *value;
+  u32 hash;
+  u16 value_size;
   bool dirty;
+  bool watch_pending;
+};
+
+struct arena_chunk {
+  struct arena_chunk *next;
+  size_t used;
+  size_t size;
+  char data[];
 };
 
-static struct setting *settings_head;
+static struct {
+  struct arena_chunk *chunks;
+  size_t allocated;
+  size_t used;
+  size_t wasted;
+} arena;
 
-/* Register a new setting in our linked list */
-static void settings_register(struct setting *setting)
+/* Arena state to return to if a registration fails */
+struct arena_mark {
+  struct arena_chunk *chunk;
+  size_t chunk_used;
+  size_t allocated;
+  size_t used;
+};
+
+static const char **intern_table;
+static u32 intern_table_mask;
+static u32 intern_count;
+
+/* Settings are kept in registration order grouped by section in an index
+ * array, which is what read by index walks. A hash table keyed on
+ * (section, name) with linear probing is used for lookup. */
+static struct setting **settings_index;
+static u32 settings_count;
+static u32 settings_index_size;
+
+static struct setting **settings_table;
+static u32 settings_table_mask;
+
+/* Sections in index order, with the number of settings in each, used to
+ * find the insertion point of a new setting. Names are interned. */
+struct section {
+  const char *name;
+  u32 count;
+};
+
+static struct section *sections;
+static u32 sections_count;
+static u32 sections_size;
+
+static u32 settings_memory_reported;
+
+/* Entries of the config file, loaded once at startup. Entries matched by a
+ * registered setting are superseded by it; the others are written back on
+ * save so that values of settings not (yet) registered are kept. */
+struct config_entry {
+  const char *section;
+  const char *name;
+  const char *value;
+  u32 hash;
+  bool registered;
+  bool saved;
+};
+
+static struct config_entry *config_entries;
+static u32 config_count;
+static u32 config_size;
+
+/* Open addressing on entry index + 1, 0 marks an empty slot */
+static u32 *config_table;
+static u32 config_table_mask;
+
+/* Set when a value changes, cleared once saved */
+static bool settings_modified;
+
+/* Writes are forwarded to the libpiksi settings clients, which subscribe to
+ * the sections they own */
+static zsock_t *write_zsock;
+
+/* Changed settings are published to watchers after WATCH_COALESCE_ms, so a
+ * setting changed several times in that window produces a single event with
+ * its latest value */
+static zsock_t *watch_zsock;
+static timer_wheel_timer_t *watch_timer;
+static struct setting **watch_pending;
+static u32 watch_pending_count;
+static u32 watch_pending_size;
+
+static timer_wheel_t *timer_wheel;
+
+/* A snapshot import writes the values which differ from the current ones to
+ * their owners, then waits for their read responses. Values point into the
+ * loaded snapshot. Only one import runs at a time. */
+struct snapshot_write {
+  struct setting *setting;
+  const char *value;
+  char *previous;
+  bool acked;
+  bool accepted;
+};
+
+static struct {
+  bool active;
+  u8 flags;
+  u8 tries;
+  u8 *data;
+  struct snapshot_write *writes;
+  u32 writes_count;
+  u32 acked_count;
+  sbp_zmq_tx_ctx_t *tx_ctx;
+  timer_wheel_timer_t *timer;
+} snapshot;
+
+static void * arena_alloc(size_t size, size_t align)
 {
-  struct setting *s;
+  struct arena_chunk *c = arena.chunks;
+  size_t offset = 0;
+  if (c != NULL) {
+    offset = (c->used + align - 1) & ~(align - 1);
+  }
 
-  if (!settings_head) {
-    settings_head = setting;
-  } else {
-    for (s = settings_head; s->next; s = s->next) {
-      if ((strcmp(s->section, setting->section) == 0) &&
-          (strcmp(s->next->section, setting->section) != 0))
-        break;
+  if ((c == NULL) || (offset + size > c->size)) {
+    size_t chunk_size = (size > ARENA_CHUNK_SIZE) ? size : ARENA_CHUNK_SIZE;
+    c = malloc(sizeof(*c) + chunk_size);
+    if (c == NULL) {
+      return NULL;
     }
-    setting->next = s->next;
-    s->next = setting;
+    c->next = arena.chunks;
+    c->used = 0;
+    c->size = chunk_size;
+    arena.chunks = c;
+    arena.allocated += sizeof(*c) + chunk_size;
+    offset = 0;
   }
-  char buf[BUFSIZE];
-  ini_gets(setting->section, setting->name, "", buf, sizeof(buf), SETTINGS_FILE);
-  if (buf[0] != 0) {
+
+  arena.used += offset - c->used + size;
+  c->used = offset + size;
+  return &c->data[offset];
+}
+
+static struct arena_mark arena_mark_get(void)
+{
+  return (struct arena_mark) {
+    .chunk = arena.chunks,
+    .chunk_used = (arena.chunks != NULL) ? arena.chunks->used : 0,
+    .allocated = arena.allocated,
+    .used = arena.used
+  };
+}
+
+/* Give back everything allocated since mark */
+static void arena_release(const struct arena_mark *mark)
+{
+  while (arena.chunks != mark->chunk) {
+    struct arena_chunk *c = arena.chunks;
+    arena.chunks = c->next;
+    free(c);
+  }
+  if (arena.chunks != NULL) {
+    arena.chunks->used = mark->chunk_used;
+  }
+  arena.allocated = mark->allocated;
+  arena.used = mark->used;
+}
+
+static char * arena_strdup(const char *str)
+{
+  size_t size = strlen(str) + 1;
+  char *copy = arena_alloc(size, 1);
+  if (copy != NULL) {
+    memcpy(copy, str, size);
+  }
+  return copy;
+}
+
+static u32 string_hash(const char *str)
+{
+  return fnv1a_32_update(FNV1A_32_INIT, str, strlen(str));
+}
+
+static void intern_table_insert(const char *str)
+{
+  u32 i = string_hash(str) & intern_table_mask;
+  while (intern_table[i] != NULL) {
+    i = (i + 1) & intern_table_mask;
+  }
+  intern_table[i] = str;
+}
+
+static bool intern_table_grow(void)
+{
+  u32 size = (intern_table == NULL) ? INTERN_SIZE_INIT :
+                                      2 * (intern_table_mask + 1);
+  const char **table = calloc(size, sizeof(*table));
+  if (table == NULL) {
+    return false;
+  }
+
+  const char **old_table = intern_table;
+  u32 old_size = (old_table == NULL) ? 0 : intern_table_mask + 1;
+  intern_table = table;
+  intern_table_mask = size - 1;
+  for (u32 i = 0; i < old_size; i++) {
+    if (old_table[i] != NULL) {
+      intern_table_insert(old_table[i]);
+    }
+  }
+  free(old_table);
+  return true;
+}
+
+/* Return the shared copy of str, adding it if not yet present */
+static const char * intern(const char *str)
+{
+  if (intern_table != NULL) {
+    for (u32 i = string_hash(str) & intern_table_mask; intern_table[i] != NULL;
+         i = (i + 1) & intern_table_mask) {
+      if (strcmp(intern_table[i], str) == 0) {
+        return intern_table[i];
+      }
+    }
+  }
+
+  /* Keep the table at most half full */
+  if ((intern_table == NULL) ||
+      (2 * (intern_count + 1) > intern_table_mask + 1)) {
+    if (!intern_table_grow()) {
+      return NULL;
+    }
+  }
+
+  const char *copy = arena_strdup(str);
+  if (copy == NULL) {
+    return NULL;
+  }
+  intern_table_insert(copy);
+  intern_count++;
+  return copy;
+}
+
+static bool setting_value_set(struct setting *s, const char *value)
+{
+  size_t size = strlen(value) + 1;
+  if (size > BUFSIZE) {
+    return false;
+  }
+
+  if (size > s->value_size) {
+    /* Round up so that small changes in length are absorbed in place */
+    size_t value_size = (size + VALUE_SIZE_ALIGN - 1) & ~(VALUE_SIZE_ALIGN - 1);
+    if (value_size > BUFSIZE) {
+      value_size = BUFSIZE;
+    }
+    char *v = arena_alloc(value_size, 1);
+    if (v == NULL) {
+      return false;
+    }
+    arena.wasted += s->value_size;
+    s->value = v;
+    s->value_size = value_size;
+  }
+
+  memcpy(s->value, value, size);
+  return true;
+}
+
+static u32 settings_hash(const char *section, const char *name)
+{
+  /* The terminator separates section and name */
+  u32 h = fnv1a_32_update(FNV1A_32_INIT, section, strlen(section) + 1);
+  return fnv1a_32_update(h, name, strlen(name));
+}
+
+static void settings_table_insert(struct setting *setting)
+{
+  u32 i = setting->hash & settings_table_mask;
+  while (settings_table[i] != NULL) {
+    i = (i + 1) & settings_table_mask;
+  }
+  settings_table[i] = setting;
+}
+
+static bool settings_table_grow(void)
+{
+  u32 size = (settings_table == NULL) ? TABLE_SIZE_INIT :
+                                        2 * (settings_table_mask + 1);
+  struct setting **table = calloc(size, sizeof(*table));
+  if (table == NULL) {
+    return false;
+  }
+
+  free(settings_table);
+  settings_table = table;
+  settings_table_mask = size - 1;
+  for (u32 i = 0; i < settings_count; i++) {
+    settings_table_insert(settings_index[i]);
+  }
+  return true;
+}
+
+static bool settings_index_grow(void)
+{
+  u32 size = (settings_index == NULL) ? INDEX_SIZE_INIT :
+                                        2 * settings_index_size;
+  struct setting **index = realloc(settings_index, size * sizeof(*index));
+  if (index == NULL) {
+    return false;
+  }
+
+  settings_index = index;
+  settings_index_size = size;
+  return true;
+}
+
+static struct config_entry * config_lookup(const char *section,
+                                           const char *name)
+{
+  if (config_table == NULL) {
+    return NULL;
+  }
+
+  u32 hash = settings_hash(section, name);
+  for (u32 i = hash & config_table_mask; config_table[i] != 0;
+       i = (i + 1) & config_table_mask) {
+    struct config_entry *e = &config_entries[config_table[i] - 1];
+    if ((e->hash == hash) &&
+        (strcmp(e->section, section) == 0) &&
+        (strcmp(e->name, name) == 0))
+      return e;
+  }
+  return NULL;
+}
+
+static bool config_add(const char *section, const char *name,
+                       const char *value)
+{
+  /* As with ini_gets(), the first of duplicate keys wins */
+  if (config_lookup(section, name) != NULL) {
+    return true;
+  }
+
+  if (config_count == config_size) {
+    u32 size = (config_entries == NULL) ? CONFIG_SIZE_INIT : 2 * config_size;
+    struct config_entry *entries = realloc(config_entries,
+                                           size * sizeof(*entries));
+    if (entries == NULL) {
+      return false;
+    }
+    config_entries = entries;
+    config_size = size;
+  }
+
+  /* Keep the table at most half full */
+  if ((config_table == NULL) ||
+      (2 * (config_count + 1) > config_table_mask + 1)) {
+    u32 size = (config_table == NULL) ? TABLE_SIZE_INIT :
+                                        2 * (config_table_mask + 1);
+    u32 *table = calloc(size, sizeof(*table));
+    if (table == NULL) {
+      return false;
+    }
+    free(config_table);
+    config_table = table;
+    config_table_mask = size - 1;
+    for (u32 i = 0; i < config_count; i++) {
+      u32 j = config_entries[i].hash & config_table_mask;
+      while (config_table[j] != 0) {
+        j = (j + 1) & config_table_mask;
+      }
+      config_table[j] = i + 1;
+    }
+  }
+
+  struct config_entry *e = &config_entries[config_count];
+  e->section = intern(section);
+  e->name = arena_strdup(name);
+  e->value = arena_strdup(value);
+  if ((e->section == NULL) || (e->name == NULL) || (e->value == NULL)) {
+    return false;
+  }
+  e->hash = settings_hash(section, name);
+  e->registered = false;
+  e->saved = false;
+
+  u32 i = e->hash & config_table_mask;
+  while (config_table[i] != 0) {
+    i = (i + 1) & config_table_mask;
+  }
+  config_table[i] = config_count + 1;
+  config_count++;
+  return true;
+}
+
+static int config_load_callback(const char *section, const char *name,
+                                const char *value, const void *context)
+{
+  (void)context;
+
+  if ((strlen(section) >= BUFSIZE) || (strlen(name) >= BUFSIZE) ||
+      (strlen(value) >= BUFSIZE)) {
+    return 1;
+  }
+
+  if (!config_add(section, name, value)) {
+    piksi_log(LOG_ERR, "Error loading config file");
+    return 0;
+  }
+  return 1;
+}
+
+/* Read the config file into memory in a single pass */
+static void config_load(void)
+{
+  ini_browse(config_load_callback, NULL, SETTINGS_FILE);
+}
+
+static bool sections_grow(void)
+{
+  u32 size = (sections == NULL) ? SECTIONS_SIZE_INIT : 2 * sections_size;
+  struct section *s = realloc(sections, size * sizeof(*s));
+  if (s == NULL) {
+    return false;
+  }
+
+  sections = s;
+  sections_size = size;
+  return true;
+}
+
+/* Make room in the index, lookup table and sections for one more setting,
+ * so that settings_register() cannot fail */
+static bool settings_reserve(void)
+{
+  /* Keep the table at most half full */
+  if ((settings_table == NULL) ||
+      (2 * (settings_count + 1) > settings_table_mask + 1)) {
+    if (!settings_table_grow()) {
+      return false;
+    }
+  }
+
+  if (settings_count == settings_index_size) {
+    if (!settings_index_grow()) {
+      return false;
+    }
+  }
+
+  if (sections_count == sections_size) {
+    if (!sections_grow()) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/* Register a new setting in our index and lookup table, which must have
+ * been reserved with settings_reserve() */
+static void settings_register(struct setting *setting)
+{
+  /* Insert after the last setting of the same section, or at the end */
+  u32 pos = 0;
+  u32 sec;
+  for (sec = 0; sec < sections_count; sec++) {
+    pos += sections[sec].count;
+    if (sections[sec].name == setting->section) {
+      break;
+    }
+  }
+  if (sec == sections_count) {
+    sections[sections_count].name = setting->section;
+    sections[sections_count].count = 0;
+    sections_count++;
+  }
+  sections[sec].count++;
+
+  memmove(&settings_index[pos + 1], &settings_index[pos],
+          (settings_count - pos) * sizeof(*settings_index));
+  settings_index[pos] = setting;
+  settings_count++;
+
+  setting->hash = settings_hash(setting->section, setting->name);
+  settings_table_insert(setting);
+
+  struct config_entry *e = config_lookup(setting->section, setting->name);
+  if ((e != NULL) && (e->value[0] != '\0')) {
     /* Use value from config file */
-    strncpy(setting->value, buf, BUFSIZE);
-    setting->dirty = true;
+    if (setting_value_set(setting, e->value)) {
+      setting->dirty = true;
+      e->registered = true;
+    }
   }
 }
 
-/* Lookup setting in our linked list */
+/* Lookup setting in our table */
 static struct setting *settings_lookup(const char *section, const char *setting)
 {
-  for (struct setting *s = settings_head; s; s = s->next)
-    if ((strcmp(s->section, section)  == 0) &&
+  if (settings_table == NULL) {
+    return NULL;
+  }
+
+  u32 hash = settings_hash(section, setting);
+  for (u32 i = hash & settings_table_mask; settings_table[i] != NULL;
+       i = (i + 1) & settings_table_mask) {
+    struct setting *s = settings_table[i];
+    if ((s->hash == hash) &&
+        (strcmp(s->section, section) == 0) &&
         (strcmp(s->name, setting) == 0))
       return s;
+  }
   return NULL;
 }
 
+/* Log the memory used by settings storage, along with what the previous
+ * layout of four fixed BUFSIZE arrays per setting would have used */
+static void settings_memory_report(void)
+{
+  size_t tables = settings_index_size * sizeof(*settings_index) +
+                  (settings_table == NULL ? 0 :
+                   (settings_table_mask + 1) * sizeof(*settings_table));
+  size_t interned = (intern_table == NULL) ? 0 :
+                    (intern_table_mask + 1) * sizeof(*intern_table);
+  size_t total = arena.allocated + tables + interned;
+  size_t fixed = settings_count * (4 * BUFSIZE + sizeof(u32) + sizeof(bool)) +
+                 tables;
+
+  piksi_log(LOG_INFO, "settings memory: %u settings, %u interned strings, "
+            "arena %zu/%zu bytes used (%zu in replaced values), "
+            "tables %zu bytes",
+            settings_count, intern_count, arena.used, arena.allocated,
+            arena.wasted, tables + interned);
+  piksi_log(LOG_INFO, "settings memory: %zu bytes total, %zu bytes/setting, "
+            "fixed layout %zu bytes",
+            total, settings_count ? total / settings_count : 0, fixed);
+}
+
 /* Format setting into SBP message payload */
 static int settings_format_setting(struct setting *s, char *buf, int len, bool type)
 {
@@ -82,7 +613,7 @@ static int settings_format_setting(struct setting *s, char *buf, int len, bool t
   buflen += strlen(s->name) + 1;
   strncpy(buf + buflen, s->value, len - buflen);
   buflen += strlen(s->value) + 1;
-  if (type && s->type[0]) {
+  if (type && (s->type != NULL)) {
     strncpy(buf + buflen, s->type, len - buflen);
     buflen += strlen(s->type) + 1;
     buf[buflen++] = '\0';
@@ -92,7 +623,7 @@ static int settings_format_setting(struct setting *s, char *buf, int len, bool t
 }
 
 /* Parse SBP message payload into setting parameters */
-static bool settings_parse_setting(u8 len, u8 msg[],
+static bool settings_parse_setting(u8 len, const char msg[],
                                    const char **section,
                                    const char **setting,
                                    const char **value,
@@ -116,22 +647,22 @@ static bool settings_parse_setting(u8 len, u8 msg[],
    * 3 null terminated strings: section, setting and value
    * An optional fourth string is a description of the type.
    */
-  *section = (const char *)msg;
+  *section = msg;
   for (int i = 0, tok = 0; i < len; i++) {
     if (msg[i] == '\0') {
       tok++;
       switch (tok) {
       case 1:
-        *setting = (const char *)&msg[i+1];
+        *setting = &msg[i+1];
         break;
       case 2:
         if (i + 1 < len)
-          *value = (const char *)&msg[i+1];
+          *value = &msg[i+1];
         break;
       case 3:
         if (i + 1 < len) {
           if (type != NULL)
-            *type = (const char *)&msg[i+1];
+            *type = &msg[i+1];
           break;
 	}
       case 4:
@@ -146,25 +677,613 @@ static bool settings_parse_setting(u8 len, u8 msg[],
   return true;
 }
 
-static void settings_register_callback(u16 sender_id, u8 len, u8 msg[], void *context)
+static void settings_watch_publish(timer_wheel_timer_t *timer, void *context)
+{
+  (void)timer;
+  (void)context;
+
+  for (u32 i = 0; i < watch_pending_count; i++) {
+    struct setting *s = watch_pending[i];
+    s->watch_pending = false;
+
+    /* The section and name lead the frame so that watchers subscribe to a
+     * section or name prefix */
+    char buf[256];
+    int buflen = settings_format_setting(s, buf, sizeof(buf), false);
+    if (zmq_send(zsock_resolve(watch_zsock), buf, buflen, ZMQ_DONTWAIT) < 0) {
+      piksi_log(LOG_WARNING, "Error publishing setting change");
+    }
+  }
+  watch_pending_count = 0;
+}
+
+static void settings_watch_notify(struct setting *s)
+{
+  if ((watch_zsock == NULL) || s->watch_pending) {
+    return;
+  }
+
+  if (watch_pending_count == watch_pending_size) {
+    u32 size = (watch_pending == NULL) ? WATCH_PENDING_SIZE_INIT :
+                                         2 * watch_pending_size;
+    struct setting **pending = realloc(watch_pending, size * sizeof(*pending));
+    if (pending == NULL) {
+      piksi_log(LOG_ERR, "Error allocating setting watch");
+      return;
+    }
+    watch_pending = pending;
+    watch_pending_size = size;
+  }
+
+  watch_pending[watch_pending_count++] = s;
+  s->watch_pending = true;
+  if (watch_pending_count == 1) {
+    timer_wheel_timer_start(watch_timer, WATCH_COALESCE_ms, 0);
+  }
+}
+
+static void settings_watch_setup(void)
+{
+  watch_zsock = zsock_new_pub(SETTINGS_WATCH_PUB_ENDPOINT);
+  if (watch_zsock == NULL) {
+    piksi_log(LOG_ERR, "Error creating settings watch socket");
+    return;
+  }
+
+  if (timer_wheel != NULL) {
+    watch_timer = timer_wheel_timer_create(timer_wheel, settings_watch_publish,
+                                           NULL);
+  }
+  if (watch_timer == NULL) {
+    piksi_log(LOG_ERR, "Error creating settings watch timer");
+    zsock_destroy(&watch_zsock);
+  }
+}
+
+/* The frame is the write payload, which leads with the section */
+static void settings_write_forward(const char *buf, u8 buflen)
+{
+  if (write_zsock == NULL) {
+    return;
+  }
+
+  if (zmq_send(zsock_resolve(write_zsock), buf, buflen, ZMQ_DONTWAIT) < 0) {
+    piksi_log(LOG_WARNING, "Error forwarding settings write");
+  }
+}
+
+static void settings_write_callback(u16 sender_id, u8 len,
+                                    const msg_settings_write_t *msg,
+                                    void *context)
+{
+  (void)context;
+
+  if (sender_id != SBP_SENDER_ID) {
+    piksi_log(LOG_WARNING, "Invalid sender");
+    return;
+  }
+
+  settings_write_forward(msg->setting, len);
+}
+
+static void settings_write_setup(void)
+{
+  write_zsock = zsock_new_pub(SETTINGS_WRITE_PUB_ENDPOINT);
+  if (write_zsock == NULL) {
+    piksi_log(LOG_ERR, "Error creating settings write socket");
+  }
+}
+
+static int snapshot_compare(const void *a, const void *b)
+{
+  const struct setting *sa = *(struct setting * const *)a;
+  const struct setting *sb = *(struct setting * const *)b;
+  int ret = strcmp(sa->section, sb->section);
+  return (ret != 0) ? ret : strcmp(sa->name, sb->name);
+}
+
+/* Settings in snapshot order, or NULL if allocation failed */
+static struct setting ** snapshot_sorted_get(void)
+{
+  struct setting **sorted = malloc((settings_count + 1) * sizeof(*sorted));
+  if (sorted == NULL) {
+    piksi_log(LOG_ERR, "Error allocating snapshot");
+    return NULL;
+  }
+
+  if (settings_count > 0) {
+    memcpy(sorted, settings_index, settings_count * sizeof(*sorted));
+    qsort(sorted, settings_count, sizeof(*sorted), snapshot_compare);
+  }
+  return sorted;
+}
+
+/* The hash of the entries, each string including its terminator */
+static u64 snapshot_hash(struct setting **sorted)
+{
+  u64 hash = FNV1A_64_INIT;
+  for (u32 i = 0; i < settings_count; i++) {
+    struct setting *s = sorted[i];
+    hash = fnv1a_64_update(hash, s->section, strlen(s->section) + 1);
+    hash = fnv1a_64_update(hash, s->name, strlen(s->name) + 1);
+    hash = fnv1a_64_update(hash, s->value, strlen(s->value) + 1);
+  }
+  return hash;
+}
+
+static bool snapshot_file_write(FILE *f, struct setting **sorted, u64 hash)
+{
+  settings_snapshot_header_t header = {
+    .magic = SETTINGS_SNAPSHOT_MAGIC,
+    .version = SETTINGS_SNAPSHOT_VERSION,
+    .count = settings_count,
+    .hash = hash
+  };
+  fwrite(&header, sizeof(header), 1, f);
+
+  for (u32 i = 0; i < settings_count; i++) {
+    struct setting *s = sorted[i];
+    fwrite(s->section, strlen(s->section) + 1, 1, f);
+    fwrite(s->name, strlen(s->name) + 1, 1, f);
+    fwrite(s->value, strlen(s->value) + 1, 1, f);
+  }
+
+  return (fflush(f) == 0) && (ferror(f) == 0) && (fsync(fileno(f)) == 0);
+}
+
+/* Write a snapshot of the current values to path, through a temporary file
+ * like the config file */
+static u8 snapshot_export(const char *path)
+{
+  char path_tmp[PATH_MAX];
+  if (snprintf(path_tmp, sizeof(path_tmp), "%s.tmp", path) >=
+      (int)sizeof(path_tmp)) {
+    piksi_log(LOG_WARNING, "Snapshot path too long");
+    return SETTINGS_SNAPSHOT_STATUS_IO_ERROR;
+  }
+
+  struct setting **sorted = snapshot_sorted_get();
+  if (sorted == NULL) {
+    return SETTINGS_SNAPSHOT_STATUS_IO_ERROR;
+  }
+
+  bool success = false;
+  FILE *f = fopen(path_tmp, "w");
+  if (f != NULL) {
+    success = snapshot_file_write(f, sorted, snapshot_hash(sorted));
+    if (fclose(f) != 0) {
+      success = false;
+    }
+  }
+  free(sorted);
+
+  if (!success || (rename(path_tmp, path) != 0)) {
+    piksi_log(LOG_ERR, "Error writing snapshot %s", path);
+    unlink(path_tmp);
+    return SETTINGS_SNAPSHOT_STATUS_IO_ERROR;
+  }
+
+  return SETTINGS_SNAPSHOT_STATUS_OK;
+}
+
+/* Reply with the hash of the current values. A rejected setting is named
+ * after the response if it fits. */
+static void snapshot_resp_send(sbp_zmq_tx_ctx_t *tx_ctx, u8 status,
+                               u16 changed, u16 rejected,
+                               const char *section, const char *name)
+{
+  u8 buf[256];
+  settings_snapshot_resp_t *resp = (settings_snapshot_resp_t *)buf;
+  resp->status = status;
+  resp->count = settings_count;
+  resp->changed = changed;
+  resp->rejected = rejected;
+  resp->hash = 0;
+
+  struct setting **sorted = snapshot_sorted_get();
+  if (sorted != NULL) {
+    resp->hash = snapshot_hash(sorted);
+    free(sorted);
+  }
+
+  size_t buflen = sizeof(*resp);
+  if ((section != NULL) && (name != NULL) &&
+      (buflen + strlen(section) + strlen(name) + 2 <= SBP_PAYLOAD_SIZE_MAX)) {
+    strcpy((char *)buf + buflen, section);
+    buflen += strlen(section) + 1;
+    strcpy((char *)buf + buflen, name);
+    buflen += strlen(name) + 1;
+  }
+
+  sbp_zmq_tx_send(tx_ctx, SBP_MSG_SETTINGS_SNAPSHOT_RESP, buflen, buf);
+}
+
+static void settings_snapshot_export_callback(u16 sender_id, u8 len, u8 msg[],
+                                              void *context)
+{
+  sbp_zmq_tx_ctx_t *tx_ctx = (sbp_zmq_tx_ctx_t *)context;
+
+  if (sender_id != SBP_SENDER_ID) {
+    piksi_log(LOG_WARNING, "Invalid sender");
+    return;
+  }
+
+  if ((len > 0) && (msg[len-1] != '\0')) {
+    piksi_log(LOG_WARNING, "Error in snapshot export message");
+    return;
+  }
+
+  /* Without a path, only report the hash */
+  u8 status = SETTINGS_SNAPSHOT_STATUS_OK;
+  if (len > 1) {
+    status = snapshot_export((const char *)msg);
+  }
+
+  snapshot_resp_send(tx_ctx, status, 0, 0, NULL, NULL);
+}
+
+static void snapshot_write_append(sbp_zmq_tx_ctx_t *tx_ctx, struct setting *s,
+                                  const char *value)
+{
+  char buf[256];
+  int buflen = 0;
+
+  /* Lengths were checked when the snapshot was loaded */
+  strcpy(buf + buflen, s->section);
+  buflen += strlen(s->section) + 1;
+  strcpy(buf + buflen, s->name);
+  buflen += strlen(s->name) + 1;
+  strcpy(buf + buflen, value);
+  buflen += strlen(value) + 1;
+
+  sbp_zmq_tx_batch_append_from(tx_ctx, SBP_MSG_SETTINGS_WRITE, buflen,
+                               (u8 *)buf, SBP_SENDER_ID);
+  settings_write_forward(buf, buflen);
+}
+
+/* Write the values of the import which have not been acknowledged */
+static void snapshot_import_send(void)
+{
+  sbp_zmq_tx_batch_begin(snapshot.tx_ctx);
+  for (u32 i = 0; i < snapshot.writes_count; i++) {
+    struct snapshot_write *w = &snapshot.writes[i];
+    if (!w->acked) {
+      snapshot_write_append(snapshot.tx_ctx, w->setting, w->value);
+    }
+  }
+  sbp_zmq_tx_batch_flush(snapshot.tx_ctx);
+}
+
+static void snapshot_import_free(void)
+{
+  for (u32 i = 0; i < snapshot.writes_count; i++) {
+    free(snapshot.writes[i].previous);
+  }
+  free(snapshot.writes);
+  free(snapshot.data);
+  snapshot.writes = NULL;
+  snapshot.data = NULL;
+  snapshot.writes_count = 0;
+  snapshot.acked_count = 0;
+  snapshot.active = false;
+}
+
+/* Complete the import. Unless partial imports were requested, a rejected
+ * or unacknowledged value restores the previous values of all settings the
+ * import may have changed. Restoring is best effort: the owners accepted
+ * these values before. */
+static void snapshot_import_finish(bool timeout)
+{
+  timer_wheel_timer_stop(snapshot.timer);
+
+  u16 changed = 0;
+  u16 rejected = 0;
+  struct snapshot_write *first_rejected = NULL;
+  for (u32 i = 0; i < snapshot.writes_count; i++) {
+    struct snapshot_write *w = &snapshot.writes[i];
+    if (w->accepted) {
+      changed++;
+    } else {
+      rejected++;
+      if (first_rejected == NULL) {
+        first_rejected = w;
+      }
+    }
+  }
+
+  u8 status = SETTINGS_SNAPSHOT_STATUS_OK;
+  if (rejected > 0) {
+    status = timeout ? SETTINGS_SNAPSHOT_STATUS_TIMEOUT :
+                       SETTINGS_SNAPSHOT_STATUS_REJECTED;
+  }
+
+  if ((rejected > 0) && !(snapshot.flags & SETTINGS_SNAPSHOT_IMPORT_PARTIAL)) {
+    u32 restored = 0;
+    sbp_zmq_tx_batch_begin(snapshot.tx_ctx);
+    for (u32 i = 0; i < snapshot.writes_count; i++) {
+      struct snapshot_write *w = &snapshot.writes[i];
+      if (w->accepted || !w->acked) {
+        snapshot_write_append(snapshot.tx_ctx, w->setting, w->previous);
+        restored++;
+      }
+    }
+    sbp_zmq_tx_batch_flush(snapshot.tx_ctx);
+    piksi_log(LOG_WARNING, "Snapshot import rejected, restoring %u settings",
+              restored);
+    changed = 0;
+  }
+
+  snapshot_resp_send(snapshot.tx_ctx, status, changed, rejected,
+                     (first_rejected != NULL) ? first_rejected->setting->section
+                                              : NULL,
+                     (first_rejected != NULL) ? first_rejected->setting->name
+                                              : NULL);
+  snapshot_import_free();
+}
+
+static void snapshot_import_timeout(timer_wheel_timer_t *timer, void *context)
+{
+  (void)timer;
+  (void)context;
+
+  if (++snapshot.tries < SNAPSHOT_TRIES) {
+    snapshot_import_send();
+    return;
+  }
+
+  snapshot_import_finish(true);
+}
+
+/* Record the read response of a setting written by the import. The owner
+ * replies with the value it kept, which is the previous one if it rejected
+ * the new value. An owner may format an accepted value differently. */
+static void snapshot_import_ack(struct setting *s, const char *value)
+{
+  for (u32 i = 0; i < snapshot.writes_count; i++) {
+    struct snapshot_write *w = &snapshot.writes[i];
+    if ((w->setting != s) || w->acked) {
+      continue;
+    }
+
+    w->acked = true;
+    w->accepted = (strcmp(value, w->value) == 0) ||
+                  (strcmp(value, w->previous) != 0);
+    if (++snapshot.acked_count == snapshot.writes_count) {
+      snapshot_import_finish(false);
+    }
+    return;
+  }
+}
+
+static u8 * snapshot_file_read(const char *path, size_t *size)
+{
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    piksi_log(LOG_WARNING, "Error opening snapshot %s", path);
+    return NULL;
+  }
+
+  u8 *data = NULL;
+  struct stat st;
+  if ((fstat(fileno(f), &st) == 0) && (st.st_size <= SNAPSHOT_SIZE_MAX)) {
+    data = malloc(st.st_size + 1);
+  }
+  if ((data != NULL) && (fread(data, 1, st.st_size, f) != (size_t)st.st_size)) {
+    free(data);
+    data = NULL;
+  }
+  fclose(f);
+
+  if (data == NULL) {
+    piksi_log(LOG_WARNING, "Error reading snapshot %s", path);
+    return NULL;
+  }
+
+  *size = st.st_size;
+  return data;
+}
+
+/* Next null terminated string of the entries, or NULL at the end */
+static const char * snapshot_string_next(const char **pos, const char *end)
+{
+  if (*pos >= end) {
+    return NULL;
+  }
+
+  /* The entries end with a terminator */
+  const char *str = *pos;
+  *pos += strlen(str) + 1;
+  return str;
+}
+
+/* Load a snapshot and collect the values which differ from the current
+ * ones. The whole snapshot is checked before anything is written. */
+static u8 snapshot_import_load(const char *path, const char **section,
+                               const char **name)
+{
+  size_t size;
+  snapshot.data = snapshot_file_read(path, &size);
+  if (snapshot.data == NULL) {
+    return SETTINGS_SNAPSHOT_STATUS_IO_ERROR;
+  }
+
+  settings_snapshot_header_t header;
+  if (size < sizeof(header)) {
+    return SETTINGS_SNAPSHOT_STATUS_INVALID;
+  }
+  memcpy(&header, snapshot.data, sizeof(header));
+
+  const char *pos = (const char *)snapshot.data + sizeof(header);
+  const char *end = (const char *)snapshot.data + size;
+  if ((header.magic != SETTINGS_SNAPSHOT_MAGIC) ||
+      (header.version != SETTINGS_SNAPSHOT_VERSION) ||
+      ((pos < end) && (end[-1] != '\0')) ||
+      (fnv1a_64_update(FNV1A_64_INIT, pos, end - pos) !=
+       header.hash)) {
+    piksi_log(LOG_WARNING, "Invalid snapshot %s", path);
+    return SETTINGS_SNAPSHOT_STATUS_INVALID;
+  }
+
+  snapshot.writes = calloc(header.count + 1, sizeof(*snapshot.writes));
+  if (snapshot.writes == NULL) {
+    piksi_log(LOG_ERR, "Error allocating snapshot");
+    return SETTINGS_SNAPSHOT_STATUS_IO_ERROR;
+  }
+
+  const char *prev_section = NULL;
+  const char *prev_name = NULL;
+  for (u32 i = 0; i < header.count; i++) {
+    *section = snapshot_string_next(&pos, end);
+    *name = snapshot_string_next(&pos, end);
+    const char *value = snapshot_string_next(&pos, end);
+    if (value == NULL) {
+      piksi_log(LOG_WARNING, "Invalid snapshot %s", path);
+      return SETTINGS_SNAPSHOT_STATUS_INVALID;
+    }
+
+    /* Entries are sorted without duplicates, and must fit a write */
+    int order = (prev_section == NULL) ? 1 : strcmp(*section, prev_section);
+    if (order == 0) {
+      order = strcmp(*name, prev_name);
+    }
+    if ((order <= 0) ||
+        (strlen(*section) + strlen(*name) + strlen(value) + 3 >
+         SBP_PAYLOAD_SIZE_MAX)) {
+      piksi_log(LOG_WARNING, "Invalid snapshot entry %s.%s", *section, *name);
+      return SETTINGS_SNAPSHOT_STATUS_INVALID;
+    }
+    prev_section = *section;
+    prev_name = *name;
+
+    struct setting *s = settings_lookup(*section, *name);
+    if (s == NULL) {
+      piksi_log(LOG_WARNING, "Snapshot entry %s.%s is not registered",
+                *section, *name);
+      return SETTINGS_SNAPSHOT_STATUS_UNKNOWN_SETTING;
+    }
+
+    if (strcmp(s->value, value) == 0) {
+      continue;
+    }
+
+    struct snapshot_write *w = &snapshot.writes[snapshot.writes_count];
+    w->setting = s;
+    w->value = value;
+    w->previous = strdup(s->value);
+    if (w->previous == NULL) {
+      piksi_log(LOG_ERR, "Error allocating snapshot");
+      return SETTINGS_SNAPSHOT_STATUS_IO_ERROR;
+    }
+    snapshot.writes_count++;
+  }
+
+  if (pos != end) {
+    piksi_log(LOG_WARNING, "Invalid snapshot %s", path);
+    return SETTINGS_SNAPSHOT_STATUS_INVALID;
+  }
+
+  *section = NULL;
+  *name = NULL;
+  return SETTINGS_SNAPSHOT_STATUS_OK;
+}
+
+/* A request is a flags byte followed by the path of the snapshot */
+static void settings_snapshot_import_callback(u16 sender_id, u8 len, u8 msg[],
+                                              void *context)
+{
+  sbp_zmq_tx_ctx_t *tx_ctx = (sbp_zmq_tx_ctx_t *)context;
+
+  if (sender_id != SBP_SENDER_ID) {
+    piksi_log(LOG_WARNING, "Invalid sender");
+    return;
+  }
+
+  if ((len < 3) || (msg[len-1] != '\0')) {
+    piksi_log(LOG_WARNING, "Error in snapshot import message");
+    return;
+  }
+
+  if (snapshot.active) {
+    snapshot_resp_send(tx_ctx, SETTINGS_SNAPSHOT_STATUS_BUSY, 0, 0,
+                       NULL, NULL);
+    return;
+  }
+
+  if (snapshot.timer == NULL) {
+    piksi_log(LOG_ERR, "Snapshot import unavailable");
+    snapshot_resp_send(tx_ctx, SETTINGS_SNAPSHOT_STATUS_IO_ERROR, 0, 0,
+                       NULL, NULL);
+    return;
+  }
+
+  const char *section = NULL;
+  const char *name = NULL;
+  u8 status = snapshot_import_load((const char *)&msg[1], &section, &name);
+  if ((status != SETTINGS_SNAPSHOT_STATUS_OK) ||
+      (snapshot.writes_count == 0)) {
+    snapshot_resp_send(tx_ctx, status, 0, 0, section, name);
+    snapshot_import_free();
+    return;
+  }
+
+  snapshot.active = true;
+  snapshot.flags = msg[0];
+  snapshot.tries = 0;
+  snapshot.tx_ctx = tx_ctx;
+  snapshot_import_send();
+  timer_wheel_timer_start(snapshot.timer, SNAPSHOT_TIMEOUT_ms,
+                          SNAPSHOT_TIMEOUT_ms);
+}
+
+static void settings_register_callback(u16 sender_id, u8 len,
+                                       const msg_settings_register_t *msg,
+                                       void *context)
 {
   (void)sender_id;
 
   sbp_zmq_tx_ctx_t *tx_ctx = (sbp_zmq_tx_ctx_t *)context;
 
   const char *section = NULL, *setting = NULL, *value = NULL, *type = NULL;
-  if (!settings_parse_setting(len, msg, &section, &setting, &value, &type))
+  if (!settings_parse_setting(len, msg->setting, &section, &setting, &value,
+                              &type) ||
+      (setting == NULL) || (value == NULL)) {
     piksi_log(LOG_WARNING, "Error in register message");
+    return;
+  }
 
   struct setting *s = settings_lookup(section, setting);
   /* Only register setting if it doesn't already exist */
   if (s == NULL) {
-    s = calloc(1, sizeof(*s));
-    strncpy(s->section, section, BUFSIZE);
-    strncpy(s->name, setting, BUFSIZE);
-    strncpy(s->value, value, BUFSIZE);
-    if (type != NULL)
-      strncpy(s->type, type, BUFSIZE);
+    if (!settings_reserve()) {
+      piksi_log(LOG_ERR, "Error registering setting");
+      return;
+    }
+
+    /* Interned strings are kept if registration fails, to be shared by
+     * later settings */
+    const char *section_interned = intern(section);
+    const char *type_interned = NULL;
+    if ((type != NULL) && (type[0] != '\0'))
+      type_interned = intern(type);
+    if ((section_interned == NULL) ||
+        ((type != NULL) && (type[0] != '\0') && (type_interned == NULL))) {
+      piksi_log(LOG_ERR, "Error allocating setting");
+      return;
+    }
+
+    struct arena_mark mark = arena_mark_get();
+    s = arena_alloc(sizeof(*s), __alignof__(struct setting));
+    if (s != NULL) {
+      memset(s, 0, sizeof(*s));
+      s->section = section_interned;
+      s->type = type_interned;
+      s->name = arena_strdup(setting);
+    }
+    if ((s == NULL) || (s->name == NULL) || !setting_value_set(s, value)) {
+      piksi_log(LOG_ERR, "Error allocating setting");
+      arena_release(&mark);
+      return;
+    }
 
     settings_register(s);
   }
@@ -174,17 +1293,24 @@ static void settings_register_callback(u16 sender_id, u8 len, u8 msg[], void *co
   size_t rlen = settings_format_setting(s, buf, sizeof(buf), false);
   sbp_zmq_tx_send_from(tx_ctx, SBP_MSG_SETTINGS_WRITE,
                        rlen, (u8*)buf, SBP_SENDER_ID);
+  settings_write_forward(buf, rlen);
 }
 
-static void settings_read_reply_callback(u16 sender_id, u8 len, u8 msg[], void *context)
+static void settings_read_reply_callback(u16 sender_id, u8 len,
+                                         const msg_settings_read_resp_t *msg,
+                                         void *context)
 {
   (void)sender_id; (void)context;
 
   static struct setting *s = NULL;
   const char *section = NULL, *setting = NULL, *value = NULL;
 
-  if(!settings_parse_setting(len, msg, &section, &setting, &value, NULL))
-    piksi_log(LOG_WARNING, "Error in register message");
+  if (!settings_parse_setting(len, msg->setting, &section, &setting, &value,
+                              NULL) ||
+      (setting == NULL) || (value == NULL)) {
+    piksi_log(LOG_WARNING, "Error in read reply message");
+    return;
+  }
 
   s = settings_lookup(section, setting);
   if (s == NULL) {
@@ -192,19 +1318,25 @@ static void settings_read_reply_callback(u16 sender_id, u8 len, u8 msg[], void *
     return;
   }
 
-  if (strcmp(s->value, value) == 0) {
-    /* Setting unchanged */
-    return;
+  if (strcmp(s->value, value) != 0) {
+    /* This is an assignment, call notify function */
+    if (!setting_value_set(s, value)) {
+      piksi_log(LOG_ERR, "Error allocating setting value");
+      return;
+    }
+    s->dirty = true;
+    settings_modified = true;
+    settings_watch_notify(s);
   }
 
-  /* This is an assignment, call notify function */
-  strncpy(s->value, value, BUFSIZE);
-  s->dirty = true;
-
-  return;
+  if (snapshot.active) {
+    snapshot_import_ack(s, value);
+  }
 }
 
-static void settings_read_callback(u16 sender_id, u8 len, u8 msg[], void *context)
+static void settings_read_callback(u16 sender_id, u8 len,
+                                   const msg_settings_read_req_t *msg,
+                                   void *context)
 {
   sbp_zmq_tx_ctx_t *tx_ctx = (sbp_zmq_tx_ctx_t *)context;
 
@@ -223,7 +1355,7 @@ static void settings_read_callback(u16 sender_id, u8 len, u8 msg[], void *contex
     return;
   }
 
-  if (msg[len-1] != '\0') {
+  if (msg->setting[len-1] != '\0') {
     piksi_log(LOG_WARNING, "Error in settings read message");
     return;
   }
@@ -231,13 +1363,13 @@ static void settings_read_callback(u16 sender_id, u8 len, u8 msg[], void *contex
   /* Extract parameters from message:
    * 2 null terminated strings: section, and setting
    */
-  section = (const char *)msg;
+  section = msg->setting;
   for (int i = 0, tok = 0; i < len; i++) {
-    if (msg[i] == '\0') {
+    if (msg->setting[i] == '\0') {
       tok++;
       switch (tok) {
       case 1:
-        setting = (const char *)&msg[i+1];
+        setting = &msg->setting[i+1];
         break;
       case 2:
         if (i == len-1)
@@ -260,7 +1392,29 @@ static void settings_read_callback(u16 sender_id, u8 len, u8 msg[], void *contex
   return;
 }
 
-static void settings_read_by_index_callback(u16 sender_id, u8 len, u8 msg[], void *context)
+/* Append a read by index response for the setting at index to the batch */
+static void settings_read_by_index_append(sbp_zmq_tx_ctx_t *tx_ctx, u16 index)
+{
+  char buf[256];
+  u8 buflen = 0;
+
+  /* build and send reply */
+  buf[buflen++] = index & 0xff;
+  buf[buflen++] = index >> 8;
+  buflen += settings_format_setting(settings_index[index], buf + buflen,
+                                    sizeof(buf) - buflen, true);
+  sbp_zmq_tx_batch_append(tx_ctx, SBP_MSG_SETTINGS_READ_BY_INDEX_RESP,
+                          buflen, (u8 *)buf);
+}
+
+/* A request is either a single u16 index, answered with one response or
+ * DONE, or a settings_read_by_index_range_t. A range is answered with up to
+ * SETTINGS_READ_BY_INDEX_COUNT_MAX responses back to back, followed by DONE
+ * if the range reaches the end. DONE carries the number of settings. The client requests the next range once the
+ * last response arrives, which bounds the data in flight. */
+static void settings_read_by_index_callback(
+    u16 sender_id, u8 len, const msg_settings_read_by_index_req_t *msg,
+    void *context)
 {
   sbp_zmq_tx_ctx_t *tx_ctx = (sbp_zmq_tx_ctx_t *)context;
 
@@ -269,73 +1423,179 @@ static void settings_read_by_index_callback(u16 sender_id, u8 len, u8 msg[], voi
     return;
   }
 
-  struct setting *s = settings_head;
-  char buf[256];
-  u8 buflen = 0;
-
-  if (len != 2) {
+  u16 index = msg->index;
+  u16 count;
+  if (len == sizeof(*msg)) {
+    count = 1;
+  } else if (len == sizeof(settings_read_by_index_range_t)) {
+    count = ((const settings_read_by_index_range_t *)msg)->count;
+    if (count > SETTINGS_READ_BY_INDEX_COUNT_MAX) {
+      count = SETTINGS_READ_BY_INDEX_COUNT_MAX;
+    }
+  } else {
     piksi_log(LOG_WARNING, "Invalid length for settings read by index!");
     return;
   }
-  u16 index = (msg[1] << 8) | msg[0];
 
-  for (int i = 0; (i < index) && s; i++, s = s->next)
-    ;
+  sbp_zmq_tx_batch_begin(tx_ctx);
+  u32 end = (u32)index + count;
+  for (u32 i = index; (i < end) && (i < settings_count); i++) {
+    settings_read_by_index_append(tx_ctx, i);
+  }
+  bool done = (index >= settings_count) ||
+              ((len != sizeof(*msg)) && (end >= settings_count));
+  if (done) {
+    settings_read_by_index_done_t done_msg = {
+      .count = settings_count
+    };
+    sbp_zmq_tx_batch_append(tx_ctx, SBP_MSG_SETTINGS_READ_BY_INDEX_DONE,
+                            sizeof(done_msg), (u8 *)&done_msg);
+  }
+  sbp_zmq_tx_batch_flush(tx_ctx);
 
-  if (s == NULL) {
-    sbp_zmq_tx_send(tx_ctx, SBP_MSG_SETTINGS_READ_BY_INDEX_DONE, 0, NULL);
-    return;
+  /* A complete read by index has seen every registered setting */
+  if (done && (settings_memory_reported != settings_count)) {
+    settings_memory_report();
+    settings_memory_reported = settings_count;
   }
+}
 
-  /* build and send reply */
-  buf[buflen++] = msg[0];
-  buf[buflen++] = msg[1];
-  buflen += settings_format_setting(s, buf + buflen, sizeof(buf) - buflen, true);
-  sbp_zmq_tx_send(tx_ctx, SBP_MSG_SETTINGS_READ_BY_INDEX_RESP, buflen, (void*)buf);
+static void settings_save_section(FILE *f, const char *section, bool *header)
+{
+  if (!*header) {
+    fprintf(f, "[%s]\n", section);
+    *header = true;
+  }
 }
 
-static void settings_save_callback(u16 sender_id, u8 len, u8 msg[], void *context)
+/* Write unregistered config file entries of a section */
+static void settings_save_config_entries(FILE *f, const char *section,
+                                         bool *header)
 {
-  (void)sender_id; (void)context; (void)len; (void)msg;
+  for (u32 i = 0; i < config_count; i++) {
+    struct config_entry *e = &config_entries[i];
+    if (e->registered || e->saved || (e->section != section)) {
+      continue;
+    }
+    settings_save_section(f, section, header);
+    fprintf(f, "%s=%s\n", e->name, e->value);
+    e->saved = true;
+  }
+}
+
+static bool settings_save_write(FILE *f)
+{
+  for (u32 i = 0; i < config_count; i++) {
+    config_entries[i].saved = false;
+  }
+
+  /* Registered sections, in index order */
+  u32 pos = 0;
+  for (u32 sec = 0; sec < sections_count; sec++) {
+    const char *section = sections[sec].name;
+    bool header = false;
+    for (u32 i = pos; i < pos + sections[sec].count; i++) {
+      struct setting *s = settings_index[i];
+      /* Skip unchanged parameters */
+      if (!s->dirty)
+        continue;
+
+      settings_save_section(f, section, &header);
+      fprintf(f, "%s=%s\n", s->name, s->value);
+    }
+    pos += sections[sec].count;
+
+    settings_save_config_entries(f, section, &header);
+  }
+
+  /* Sections with no registered settings */
+  for (u32 i = 0; i < config_count; i++) {
+    struct config_entry *e = &config_entries[i];
+    if (!e->registered && !e->saved) {
+      bool header = false;
+      settings_save_config_entries(f, e->section, &header);
+    }
+  }
 
-  FILE *f = fopen(SETTINGS_FILE, "w");
-  const char *sec;
+  return (fflush(f) == 0) && (ferror(f) == 0) && (fsync(fileno(f)) == 0);
+}
 
+/* Write to a temporary file and rename it over the config file, so that
+ * the config file is always either the old or the new version */
+static bool settings_save(void)
+{
+  FILE *f = fopen(SETTINGS_FILE_TMP, "w");
   if (f == NULL) {
     piksi_log(LOG_ERR, "Error opening config file!");
-    return;
+    return false;
   }
 
-  for (struct setting *s = settings_head; s; s = s->next) {
-    /* Skip unchanged parameters */
-    if (!s->dirty)
-      continue;
+  bool success = settings_save_write(f);
+  if (fclose(f) != 0) {
+    success = false;
+  }
 
-    if ((sec == NULL) || (strcmp(s->section, sec) != 0)) {
-      /* New section, write section header */
-      sec = s->section;
-      fprintf(f, "[%s]\n", sec);
-    }
+  if (!success || (rename(SETTINGS_FILE_TMP, SETTINGS_FILE) != 0)) {
+    piksi_log(LOG_ERR, "Error writing config file!");
+    unlink(SETTINGS_FILE_TMP);
+    return false;
+  }
 
-    /* Write setting */
-    fprintf(f, "%s=%s\n", s->name, s->value);
+  /* Persist the rename */
+  int dir_fd = open(SETTINGS_DIR, O_RDONLY | O_DIRECTORY);
+  if (dir_fd >= 0) {
+    fsync(dir_fd);
+    close(dir_fd);
   }
 
-  fclose(f);
+  return true;
 }
 
-void settings_setup(sbp_zmq_rx_ctx_t *rx_ctx, sbp_zmq_tx_ctx_t *tx_ctx)
+static void settings_save_callback(u16 sender_id, u8 len, u8 msg[], void *context)
+{
+  (void)sender_id; (void)context; (void)len; (void)msg;
+
+  if (!settings_modified) {
+    /* Config file is up to date */
+    return;
+  }
+
+  if (settings_save()) {
+    settings_modified = false;
+  }
+}
+
+void settings_setup(sbp_zmq_rx_ctx_t *rx_ctx, sbp_zmq_tx_ctx_t *tx_ctx,
+                    zloop_t *zloop)
 {
+  config_load();
+
+  timer_wheel = timer_wheel_create(zloop, TIMER_RESOLUTION_ms);
+  if (timer_wheel == NULL) {
+    piksi_log(LOG_ERR, "Error creating settings timer wheel");
+  } else {
+    snapshot.timer = timer_wheel_timer_create(timer_wheel,
+                                              snapshot_import_timeout, NULL);
+  }
+  settings_watch_setup();
+  settings_write_setup();
+
+  sbp_zmq_rx_settings_write_register(rx_ctx, settings_write_callback, NULL,
+                                     NULL);
   sbp_zmq_rx_callback_register(rx_ctx, SBP_MSG_SETTINGS_SAVE,
                                settings_save_callback, tx_ctx, NULL);
-  sbp_zmq_rx_callback_register(rx_ctx, SBP_MSG_SETTINGS_READ_RESP,
-                               settings_read_reply_callback, tx_ctx, NULL);
-  sbp_zmq_rx_callback_register(rx_ctx, SBP_MSG_SETTINGS_READ_REQ,
-                               settings_read_callback, tx_ctx, NULL);
-  sbp_zmq_rx_callback_register(rx_ctx, SBP_MSG_SETTINGS_READ_BY_INDEX_REQ,
-                               settings_read_by_index_callback, tx_ctx, NULL);
-  sbp_zmq_rx_callback_register(rx_ctx, SBP_MSG_SETTINGS_REGISTER,
-                               settings_register_callback, tx_ctx, NULL);
+  sbp_zmq_rx_settings_read_resp_register(rx_ctx, settings_read_reply_callback,
+                                         tx_ctx, NULL);
+  sbp_zmq_rx_settings_read_req_register(rx_ctx, settings_read_callback,
+                                        tx_ctx, NULL);
+  sbp_zmq_rx_settings_read_by_index_req_register(
+      rx_ctx, settings_read_by_index_callback, tx_ctx, NULL);
+  sbp_zmq_rx_settings_register_register(rx_ctx, settings_register_callback,
+                                        tx_ctx, NULL);
+  sbp_zmq_rx_callback_register(rx_ctx, SBP_MSG_SETTINGS_SNAPSHOT_EXPORT_REQ,
+                               settings_snapshot_export_callback, tx_ctx, NULL);
+  sbp_zmq_rx_callback_register(rx_ctx, SBP_MSG_SETTINGS_SNAPSHOT_IMPORT_REQ,
+                               settings_snapshot_import_callback, tx_ctx, NULL);
 }
 
 void settings_reset_defaults(void)
@@ -16,7 +16,8 @@
 #include <libpiksi/sbp_zmq_rx.h>
 #include <libpiksi/sbp_zmq_tx.h>
 
-void settings_setup(sbp_zmq_rx_ctx_t *rx_ctx, sbp_zmq_tx_ctx_t *tx_ctx);
+void settings_setup(sbp_zmq_rx_ctx_t *rx_ctx, sbp_zmq_tx_ctx_t *tx_ctx,
+                    zloop_t *zloop);
 void settings_reset_defaults(void);
 
 #endif  /* SWIFTNAV_SETTINGS_H */
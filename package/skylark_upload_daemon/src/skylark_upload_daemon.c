@@ -17,9 +17,12 @@
 #include <libpiksi/logging.h>
 #include <libnetwork.h>
 
+#define PROGRAM_NAME "skylark_upload_daemon"
+
 static bool debug = false;
 static const char *fifo_file_path = NULL;
 static const char *url = NULL;
+static const char *log_binary_path = NULL;
 
 static void usage(char *command)
 {
@@ -31,6 +34,7 @@ static void usage(char *command)
 
   puts("\nMisc options");
   puts("\t--debug");
+  puts("\t--log-binary <file>");
 }
 
 static int parse_options(int argc, char *argv[])
@@ -39,12 +43,14 @@ static int parse_options(int argc, char *argv[])
     OPT_ID_FILE = 1,
     OPT_ID_URL,
     OPT_ID_DEBUG,
+    OPT_ID_LOG_BINARY,
   };
 
   const struct option long_opts[] = {
-    {"file",  required_argument, 0, OPT_ID_FILE},
-    {"url  ", required_argument, 0, OPT_ID_URL},
-    {"debug", no_argument,       0, OPT_ID_DEBUG},
+    {"file",       required_argument, 0, OPT_ID_FILE},
+    {"url  ",      required_argument, 0, OPT_ID_URL},
+    {"debug",      no_argument,       0, OPT_ID_DEBUG},
+    {"log-binary", required_argument, 0, OPT_ID_LOG_BINARY},
     {0, 0, 0, 0},
   };
 
@@ -66,6 +72,11 @@ static int parse_options(int argc, char *argv[])
       }
       break;
 
+      case OPT_ID_LOG_BINARY: {
+        log_binary_path = optarg;
+      }
+      break;
+
       default: {
         puts("Invalid option");
         return -1;
@@ -89,11 +100,19 @@ static int parse_options(int argc, char *argv[])
 
 int main(int argc, char *argv[])
 {
+  logging_init(PROGRAM_NAME);
+
   if (parse_options(argc, argv) != 0) {
+    piksi_log(LOG_ERR, "invalid arguments");
     usage(argv[0]);
     exit(EXIT_FAILURE);
   }
 
+  if ((log_binary_path != NULL) &&
+      (logging_binary_output_set(log_binary_path) != 0)) {
+    piksi_log(LOG_WARNING, "error opening binary log, using system log");
+  }
+
   int fd = open(fifo_file_path, O_RDONLY);
   if (fd < 0) {
     piksi_log(LOG_ERR, "fifo error (%d) \"%s\"", errno, strerror(errno));
@@ -22,6 +22,7 @@ extern "C"
 {
   #include <libpiksi/settings.h>
   #include <libpiksi/logging.h>
+  #include <libpiksi/sbp_zmq_tx.h>
 }
 
 #include "rotating_logger.h"
@@ -35,6 +36,10 @@ extern "C"
 static int poll_period_s = POLL_PERIOD_DEFAULT_s;
 
 static const char *zmq_sub_endpoint = nullptr;
+static const char *zmq_pub_endpoint = ">tcp://127.0.0.1:43011";
+
+static zsock_t *zmq_pub = nullptr;
+static sbp_zmq_tx_ctx_t *tx_ctx = nullptr;
 
 static RotatingLogger* logger = nullptr;
 
@@ -133,35 +138,12 @@ static void sigchld_handler(int signum) {
   errno = saved_errno;
 }
 
-static void sbp_log(int priority, const char *msg_text)
-{
-  const int NUM_LOG_LEVELS = 8;
-  assert(priority < NUM_LOG_LEVELS);
-  const char *log_args[NUM_LOG_LEVELS] = {"emerg", "alert", "crit",
-                                          "error", "warn", "notice", 
-                                          "info", "debug"};
-  FILE *output;
-  char cmd_buf[256];
-  sprintf(cmd_buf, "sbp_log --%s", log_args[priority]);
-  output = popen (cmd_buf, "w");
-  if (output == nullptr) {
-    piksi_log(LOG_ERR, "couldn't call sbp_log.");
-    return;
-  }
-  fputs((std::string(PROGRAM_NAME) + ": " + msg_text).c_str(), output);
-  if (ferror (output) != 0) {
-    piksi_log(LOG_ERR, "output to sbp_log failed.");
-  }
-  if (pclose (output) != 0) {
-    piksi_log(LOG_ERR, "couldn't close sbp_log call.");
-    return;
-  }
-}
-
 static void process_log_callback(int priority, const char *msg_text)
 {
-  piksi_log(priority, msg_text);
-  sbp_log(priority, msg_text);
+  piksi_log(priority, "%s", msg_text);
+  if (tx_ctx != nullptr) {
+    sbp_log(tx_ctx, priority, "%s: %s", PROGRAM_NAME, msg_text);
+  }
 }
 
 static void stop_logging()
@@ -243,6 +225,18 @@ int main(int argc, char *argv[]) {
     exit(EXIT_FAILURE);
   }
 
+  /* Persistent PUB socket for SBP log messages */
+  zmq_pub = zsock_new_pub(zmq_pub_endpoint);
+  if (zmq_pub == nullptr) {
+    piksi_log(LOG_ERR, "error creating PUB socket");
+    exit(EXIT_FAILURE);
+  }
+  tx_ctx = sbp_zmq_tx_create(zmq_pub);
+  if (tx_ctx == nullptr) {
+    piksi_log(LOG_ERR, "error creating TX context");
+    exit(EXIT_FAILURE);
+  }
+
   zmq_pollitem_t items[2];
 
   zsock_t * zmq_sub = zsock_new_sub(zmq_sub_endpoint, "");
@@ -306,6 +300,8 @@ int main(int argc, char *argv[]) {
 
   zsock_destroy(&zmq_sub);
   settings_destroy(&settings_ctx);
+  sbp_zmq_tx_destroy(&tx_ctx);
+  zsock_destroy(&zmq_pub);
 
   exit(EXIT_SUCCESS);
 }
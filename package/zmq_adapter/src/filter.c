@@ -12,38 +12,85 @@
 
 #include "filter.h"
 
+#include <assert.h>
+
 typedef void (*filter_init_fn_t)(void *state,
                                  const char *filename);
 typedef int (*filter_process_fn_t)(void *state,
                                    const uint8_t *msg,
                                    uint32_t msg_length);
+typedef int (*filter_config_fd_fn_t)(void *state);
+typedef void (*filter_config_reload_fn_t)(void *state);
 
 typedef struct {
   filter_init_fn_t init;
   filter_process_fn_t process;
+  filter_config_fd_fn_t config_fd;
+  filter_config_reload_fn_t config_reload;
 } filter_interface_t;
 
 static const filter_interface_t filter_interfaces[] = {
   [FILTER_NONE] = {
     .init = filter_none_init,
-    .process = filter_none_process
+    .process = filter_none_process,
+    .config_fd = filter_none_config_fd,
+    .config_reload = filter_none_config_reload
   },
   [FILTER_SBP] = {
     .init = filter_sbp_init,
-    .process = filter_sbp_process
+    .process = filter_sbp_process,
+    .config_fd = filter_sbp_config_fd,
+    .config_reload = filter_sbp_config_reload
+  },
+  [FILTER_DEDUP] = {
+    .init = filter_dedup_init,
+    .process = filter_dedup_process,
+    .config_fd = filter_dedup_config_fd,
+    .config_reload = filter_dedup_config_reload
   }
 };
 
-void filter_state_init(filter_state_t *s, filter_t filter,
-                       const char *filename)
+void filter_state_init(filter_state_t *s, const filter_t *filters,
+                       const char * const *filenames, int count)
 {
-  s->filter = filter;
-  filter_interfaces[s->filter].init(&s->impl_filter_state, filename);
+  assert(count <= FILTER_CHAIN_LENGTH_MAX);
+  s->stages_count = count;
+  for (int i = 0; i < count; i++) {
+    filter_stage_t *stage = &s->stages[i];
+    stage->filter = filters[i];
+    filter_interfaces[stage->filter].init(&stage->impl_filter_state,
+                                          filenames[i]);
+  }
 }
 
 int filter_process(filter_state_t *s,
                    const uint8_t *msg, uint32_t msg_length)
 {
-  return filter_interfaces[s->filter].process(&s->impl_filter_state,
-                                              msg, msg_length);
+  for (int i = 0; i < s->stages_count; i++) {
+    filter_stage_t *stage = &s->stages[i];
+    int ret = filter_interfaces[stage->filter].process(
+                  &stage->impl_filter_state, msg, msg_length);
+    if (ret != 0) {
+      return ret;
+    }
+  }
+  return 0;
+}
+
+int filter_config_fd(filter_state_t *s, int stage)
+{
+  if (stage >= s->stages_count) {
+    return -1;
+  }
+  filter_stage_t *st = &s->stages[stage];
+  return filter_interfaces[st->filter].config_fd(&st->impl_filter_state);
+}
+
+void filter_config_reload(filter_state_t *s, int stage)
+{
+  if (stage >= s->stages_count) {
+    return;
+  }
+  filter_stage_t *st = &s->stages[stage];
+  filter_interfaces[st->filter].config_reload(&st->impl_filter_state);
 }
@@ -18,23 +18,37 @@
 
 #include "filter_none.h"
 #include "filter_sbp.h"
+#include "filter_dedup.h"
 
 typedef enum {
   FILTER_NONE,
-  FILTER_SBP
+  FILTER_SBP,
+  FILTER_DEDUP
 } filter_t;
 
+/* Filters of a direction are applied in order, a message is passed only if
+ * every filter passes it */
+#define FILTER_CHAIN_LENGTH_MAX 4
+
 typedef struct {
   filter_t filter;
   union {
     filter_none_state_t filter_none_state;
     filter_sbp_state_t filter_sbp_state;
+    filter_dedup_state_t filter_dedup_state;
   } impl_filter_state;
+} filter_stage_t;
+
+typedef struct {
+  filter_stage_t stages[FILTER_CHAIN_LENGTH_MAX];
+  int stages_count;
 } filter_state_t;
 
-void filter_state_init(filter_state_t *s, filter_t filter,
-                       const char *filename);
+void filter_state_init(filter_state_t *s, const filter_t *filters,
+                       const char * const *filenames, int count);
 int filter_process(filter_state_t *s,
                    const uint8_t *msg, uint32_t msg_length);
+int filter_config_fd(filter_state_t *s, int stage);
+void filter_config_reload(filter_state_t *s, int stage);
 
 #endif /* SWIFTNAV_FILTER_H */
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ * Contact: Jacob McNamee <jacob@swiftnav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include "filter_config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <syslog.h>
+#include <time.h>
+
+uint64_t filter_timestamp_us_get(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+bool filter_config_parse_hex(const char *str, uint32_t *value)
+{
+  char *end;
+  unsigned long v = strtoul(str, &end, 16);
+  if ((end == str) || (*end != '\0') || (v > UINT32_MAX)) {
+    return false;
+  }
+  *value = v;
+  return true;
+}
+
+/* Read the rules of a config file into an array of rule_size byte entries.
+ * Returns the array, which the caller must free, or NULL on error. */
+void * filter_config_load(const char *filename, size_t rule_size,
+                          uint32_t rules_count_init,
+                          filter_config_line_parse_fn_t line_parse,
+                          void *context, uint32_t *rules_count)
+{
+  uint32_t config_count = 0;
+  uint32_t config_buffer_count = rules_count_init;
+
+  /* Allocate buffer for parsed rules */
+  uint8_t *config = malloc(config_buffer_count * rule_size);
+  if (config == NULL) {
+    syslog(LOG_ERR, "error allocating buffer for rules");
+    return NULL;
+  }
+
+  /* Open file */
+  FILE *fp = fopen(filename, "r");
+  if (fp == NULL) {
+    syslog(LOG_ERR, "error opening %s", filename);
+    free(config);
+    return NULL;
+  }
+
+  /* Read lines of file */
+  bool error = false;
+  char line[256];
+  while (fgets(line, sizeof(line), fp) != NULL) {
+
+    /* Reallocate rules buffer if required */
+    if (config_count >= config_buffer_count) {
+      config_buffer_count *= 2;
+      uint8_t *c = realloc(config, config_buffer_count * rule_size);
+      if (c == NULL) {
+        syslog(LOG_ERR, "error reallocating buffer for rules");
+        error = true;
+        break;
+      }
+      config = c;
+    }
+
+    /* Parse rule into the next entry */
+    int ret = line_parse(line, &config[config_count * rule_size], context);
+    if (ret < 0) {
+      syslog(LOG_ERR, "error parsing %s", filename);
+      error = true;
+      break;
+    } else if (ret > 0) {
+      config_count++;
+    }
+  }
+
+  /* Close file */
+  fclose(fp);
+
+  if (error) {
+    free(config);
+    return NULL;
+  }
+
+  *rules_count = config_count;
+  return config;
+}
+
+/* Returns an inotify descriptor which becomes readable when the config file
+ * is rewritten, see filter_config_changed() */
+int filter_config_watch(const char *filename)
+{
+  int config_inotify = inotify_init1(IN_NONBLOCK);
+  int wd = inotify_add_watch(config_inotify, filename, IN_CLOSE_WRITE);
+  if ((config_inotify < 0) || (wd < 0)) {
+    fprintf(stderr, "Error setting up inotify on config file: %s\n", filename);
+  }
+  return config_inotify;
+}
+
+bool filter_config_changed(int config_inotify)
+{
+  /* Drain pending events. Any events on the config file trigger a reload.
+   * We only subscribe to modify events. */
+  char buf[sizeof(struct inotify_event) + NAME_MAX + 1]
+    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  bool changed = false;
+  while (read(config_inotify, buf, sizeof(buf)) > 0) {
+    changed = true;
+  }
+  return changed;
+}
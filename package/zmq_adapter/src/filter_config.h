@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ * Contact: Jacob McNamee <jacob@swiftnav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef SWIFTNAV_FILTER_CONFIG_H
+#define SWIFTNAV_FILTER_CONFIG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Helpers shared by the filters which read their rules from a config file
+ * with one rule per line and reload it when it changes. */
+
+/* Parse one line of a config file into rule. Returns 1 if a rule was
+ * parsed, 0 if the line holds no rule and -1 on error. */
+typedef int (*filter_config_line_parse_fn_t)(char *line, void *rule,
+                                             void *context);
+
+uint64_t filter_timestamp_us_get(void);
+bool filter_config_parse_hex(const char *str, uint32_t *value);
+void * filter_config_load(const char *filename, size_t rule_size,
+                          uint32_t rules_count_init,
+                          filter_config_line_parse_fn_t line_parse,
+                          void *context, uint32_t *rules_count);
+int filter_config_watch(const char *filename);
+bool filter_config_changed(int config_inotify);
+
+#endif /* SWIFTNAV_FILTER_CONFIG_H */
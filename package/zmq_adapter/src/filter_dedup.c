@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ * Contact: Jacob McNamee <jacob@swiftnav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include "filter_dedup.h"
+#include "filter_config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syslog.h>
+
+/* Suppresses SBP messages whose payload is byte-identical to one already
+ * passed for the same msg_type within a configurable window. Messages of
+ * types not listed in the config file always pass.
+ *
+ * Config file format, one rule per line, all values hex:
+ *   <msg_type> <window ms>
+ *
+ * The filter is chained after the sbp filter by giving a second
+ * --filter-out dedup --filter-out-config <file> pair to the adapter, so it
+ * only sees messages the sbp filter has passed.
+ *
+ * Recently passed payloads are remembered in a small direct-mapped cache
+ * keyed by a hash of msg_type and payload. A cache collision only evicts
+ * the older entry, so it can let a duplicate through but never drops a
+ * distinct message unless the 64-bit hashes collide. */
+
+#define SBP_MSG_TYPE_OFFSET     1
+#define SBP_MSG_LENGTH_OFFSET   5
+#define SBP_MSG_PAYLOAD_OFFSET  6
+#define SBP_MSG_SIZE_MIN        6
+
+#define RULES_COUNT_INIT  32
+#define CACHE_BITS        8
+
+#define FNV_OFFSET_BASIS  14695981039346656037ULL
+#define FNV_PRIME         1099511628211ULL
+
+static filter_dedup_table_t * filter_dedup_load_config(filter_dedup_state_t *s);
+
+static uint64_t payload_hash(uint16_t type, const uint8_t *payload,
+                             uint32_t payload_length)
+{
+  /* FNV-1a */
+  uint64_t h = FNV_OFFSET_BASIS;
+  h = (h ^ (type & 0xff)) * FNV_PRIME;
+  h = (h ^ (type >> 8)) * FNV_PRIME;
+  for (uint32_t i = 0; i < payload_length; i++) {
+    h = (h ^ payload[i]) * FNV_PRIME;
+  }
+  return h;
+}
+
+static int rule_compare(const void *a, const void *b)
+{
+  const filter_dedup_rule_t *ra = (const filter_dedup_rule_t *)a;
+  const filter_dedup_rule_t *rb = (const filter_dedup_rule_t *)b;
+  return (int)ra->type - (int)rb->type;
+}
+
+static const filter_dedup_rule_t * rule_lookup(const filter_dedup_table_t *t,
+                                               uint16_t type)
+{
+  filter_dedup_rule_t key = { .type = type };
+  return bsearch(&key, t->rules, t->rules_count,
+                 sizeof(filter_dedup_rule_t), rule_compare);
+}
+
+/* Build the table from the parsed config. The rules and the cache are a
+ * single allocation so that they can be swapped and freed as a unit.
+ * The first rule for a given msg_type takes precedence. */
+static filter_dedup_table_t * table_compile(filter_dedup_rule_t *config,
+                                            uint32_t config_count)
+{
+  uint32_t cache_count = 1u << CACHE_BITS;
+  filter_dedup_table_t *t = malloc(sizeof(filter_dedup_table_t) +
+                                   config_count * sizeof(filter_dedup_rule_t) +
+                                   cache_count * sizeof(filter_dedup_entry_t));
+  if (t == NULL) {
+    syslog(LOG_ERR, "error allocating dedup table");
+    return NULL;
+  }
+
+  t->cache = (filter_dedup_entry_t *)&t[1];
+  t->cache_mask = cache_count - 1;
+  t->rules = (filter_dedup_rule_t *)&t->cache[cache_count];
+  t->rules_count = 0;
+
+  /* Drop duplicate msg_types while copying, then sort for lookup */
+  for (uint32_t i = 0; i < config_count; i++) {
+    bool duplicate = false;
+    for (uint32_t j = 0; j < t->rules_count; j++) {
+      if (t->rules[j].type == config[i].type) {
+        duplicate = true;
+        break;
+      }
+    }
+    if (!duplicate) {
+      t->rules[t->rules_count++] = config[i];
+    }
+  }
+  qsort(t->rules, t->rules_count, sizeof(filter_dedup_rule_t), rule_compare);
+
+  /* A zero timestamp never lies within a window, see process() */
+  memset(t->cache, 0, cache_count * sizeof(filter_dedup_entry_t));
+
+  return t;
+}
+
+/* Parse one line of the config file. Returns 1 if a rule was parsed and
+ * -1 on error. */
+static int config_line_parse(char *line, void *rule_, void *context)
+{
+  (void)context;
+  filter_dedup_rule_t *rule = (filter_dedup_rule_t *)rule_;
+  char *saveptr;
+  const char *delim = " \t\r\n";
+
+  uint32_t msg_type;
+  uint32_t window_ms;
+  char *token = strtok_r(line, delim, &saveptr);
+  if ((token == NULL) || !filter_config_parse_hex(token, &msg_type) ||
+      (msg_type > UINT16_MAX)) {
+    return -1;
+  }
+  token = strtok_r(NULL, delim, &saveptr);
+  if ((token == NULL) || !filter_config_parse_hex(token, &window_ms) ||
+      (strtok_r(NULL, delim, &saveptr) != NULL)) {
+    return -1;
+  }
+
+  rule->type = msg_type;
+  rule->window_us = (uint64_t)window_ms * 1000;
+  return 1;
+}
+
+void filter_dedup_init(void *filter_dedup_state, const char *filename)
+{
+  filter_dedup_state_t *s = (filter_dedup_state_t *)filter_dedup_state;
+  s->config_file = strdup(filename);
+  s->table = filter_dedup_load_config(s);
+  s->config_inotify = filter_config_watch(filename);
+}
+
+static filter_dedup_table_t * filter_dedup_load_config(filter_dedup_state_t *s)
+{
+  uint32_t config_count;
+  filter_dedup_rule_t *config = filter_config_load(s->config_file,
+                                                   sizeof(filter_dedup_rule_t),
+                                                   RULES_COUNT_INIT,
+                                                   config_line_parse, NULL,
+                                                   &config_count);
+  if (config == NULL) {
+    return NULL;
+  }
+
+  /* An empty config passes everything */
+  filter_dedup_table_t *t = NULL;
+  if (config_count > 0) {
+    t = table_compile(config, config_count);
+  }
+
+  free(config);
+  return t;
+}
+
+int filter_dedup_config_fd(void *filter_dedup_state)
+{
+  filter_dedup_state_t *s = (filter_dedup_state_t *)filter_dedup_state;
+  return s->config_inotify;
+}
+
+void filter_dedup_config_reload(void *filter_dedup_state)
+{
+  filter_dedup_state_t *s = (filter_dedup_state_t *)filter_dedup_state;
+
+  if (!filter_config_changed(s->config_inotify)) {
+    return;
+  }
+
+  /* Swap in the new table. The cache starts out empty. */
+  filter_dedup_table_t *t = filter_dedup_load_config(s);
+  if (s->table != NULL) {
+    free(s->table);
+  }
+  s->table = t;
+}
+
+int filter_dedup_process(void *filter_dedup_state,
+                         const uint8_t *msg, uint32_t msg_length)
+{
+  filter_dedup_state_t *s = (filter_dedup_state_t *)filter_dedup_state;
+  filter_dedup_table_t *t = s->table;
+
+  /* Pass everything if no rules are configured */
+  if (t == NULL) {
+    return 0;
+  }
+
+  /* Pass short messages, they are not ours to judge */
+  if (msg_length < SBP_MSG_SIZE_MIN) {
+    return 0;
+  }
+
+  /* Pass messages of types which are not deduplicated */
+  uint16_t msg_type = le16toh(*(uint16_t *)&msg[SBP_MSG_TYPE_OFFSET]);
+  const filter_dedup_rule_t *rule = rule_lookup(t, msg_type);
+  if (rule == NULL) {
+    return 0;
+  }
+
+  uint32_t payload_length = msg[SBP_MSG_LENGTH_OFFSET];
+  if (SBP_MSG_PAYLOAD_OFFSET + payload_length > msg_length) {
+    payload_length = msg_length - SBP_MSG_PAYLOAD_OFFSET;
+  }
+  uint64_t hash = payload_hash(msg_type, &msg[SBP_MSG_PAYLOAD_OFFSET],
+                               payload_length);
+
+  /* Reject if the same payload was passed within the window */
+  uint64_t now_us = filter_timestamp_us_get();
+  filter_dedup_entry_t *entry = &t->cache[hash & t->cache_mask];
+  if ((entry->timestamp_us != 0) && (entry->hash == hash) &&
+      (entry->type == msg_type) &&
+      (now_us - entry->timestamp_us < rule->window_us)) {
+    return 1;
+  }
+
+  /* Remember the payload. The window restarts only when a copy passes. */
+  entry->hash = hash;
+  entry->type = msg_type;
+  entry->timestamp_us = now_us;
+  return 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2016 Swift Navigation Inc.
+ * Contact: Jacob McNamee <jacob@swiftnav.com>
+ *
+ * This source is subject to the license found in the file 'LICENSE' which must
+ * be be distributed together with this source. All other rights reserved.
+ *
+ * THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND,
+ * EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef SWIFTNAV_FILTER_DEDUP_H
+#define SWIFTNAV_FILTER_DEDUP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+  uint16_t type;
+  uint64_t window_us;
+} filter_dedup_rule_t;
+
+typedef struct {
+  uint64_t hash;
+  uint16_t type;
+  uint64_t timestamp_us;
+} filter_dedup_entry_t;
+
+typedef struct {
+  filter_dedup_rule_t *rules;
+  uint32_t rules_count;
+  filter_dedup_entry_t *cache;
+  uint32_t cache_mask;
+} filter_dedup_table_t;
+
+typedef struct {
+  filter_dedup_table_t *table;
+  const char *config_file;
+  int config_inotify;
+} filter_dedup_state_t;
+
+void filter_dedup_init(void *filter_dedup_state, const char *filename);
+int filter_dedup_process(void *filter_dedup_state,
+                         const uint8_t *msg, uint32_t msg_length);
+int filter_dedup_config_fd(void *filter_dedup_state);
+void filter_dedup_config_reload(void *filter_dedup_state);
+
+#endif /* SWIFTNAV_FILTER_DEDUP_H */
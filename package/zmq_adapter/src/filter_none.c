@@ -22,3 +22,13 @@ int filter_none_process(void *filter_none_state,
 {
   return 0;
 }
+
+int filter_none_config_fd(void *filter_none_state)
+{
+  return -1;
+}
+
+void filter_none_config_reload(void *filter_none_state)
+{
+
+}
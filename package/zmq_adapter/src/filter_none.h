@@ -23,5 +23,7 @@ typedef struct {
 void filter_none_init(void *filter_none_state, const char *filename);
 int filter_none_process(void *filter_none_state,
                         const uint8_t *msg, uint32_t msg_length);
+int filter_none_config_fd(void *filter_none_state);
+void filter_none_config_reload(void *filter_none_state);
 
 #endif /* SWIFTNAV_FILTER_NONE_H */
@@ -11,22 +11,66 @@
  */
 
 #include "filter_sbp.h"
+#include "filter_config.h"
 
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
-#include <sys/inotify.h>
-#include <fcntl.h>
-#include <limits.h>
 #include <syslog.h>
 
-#define SBP_MSG_TYPE_OFFSET 1
-#define SBP_MSG_SIZE_MIN    6
+#define SBP_MSG_TYPE_OFFSET     1
+#define SBP_MSG_SENDER_OFFSET   3
+#define SBP_MSG_LENGTH_OFFSET   5
+#define SBP_MSG_PAYLOAD_OFFSET  6
+#define SBP_MSG_SIZE_MIN        6
 
 #define RULES_COUNT_INIT  256
 
-static void filter_sbp_load_config(filter_sbp_state_t *s);
+#define SLOT_EMPTY        UINT32_MAX
+#define LIMIT_NONE        UINT32_MAX
+#define RULE_NONE         UINT32_MAX
+
+#define PROG_LENGTH_MAX   32
+
+#define SBP_FRAME_SIZE_MAX 264
+
+/* Token buckets allow a burst of up to BUCKET_BURST_us worth of their rate,
+ * and always enough for one message or one maximum size frame. Tokens are
+ * scaled by TOKEN_SCALE so that they accrue as rate * elapsed microseconds. */
+#define BUCKET_BURST_us   250000
+#define TOKEN_SCALE       1000000ULL
+
+/* Rules may carry a predicate on the sender ID and payload fields. Each
+ * predicate compiles to a short sequence of instructions operating on a
+ * single accumulator; a rule matches when its program runs to the end.
+ *
+ *   OP_LD_SENDER        A = sender ID
+ *   OP_LD_U8/16/32 k    A = payload field at offset k, little endian.
+ *                       No match if the payload is too short.
+ *   OP_AND k            A &= k
+ *   OP_EQ k             no match unless A == k
+ *   OP_NE k             no match unless A != k
+ */
+enum {
+  OP_LD_SENDER,
+  OP_LD_U8,
+  OP_LD_U16,
+  OP_LD_U32,
+  OP_AND,
+  OP_EQ,
+  OP_NE
+};
+
+typedef struct {
+  uint16_t type;
+  uint8_t divisor;
+  uint32_t max_msgs_per_s;
+  uint32_t max_bytes_per_s;
+  filter_sbp_insn_t prog[PROG_LENGTH_MAX];
+  uint32_t prog_length;
+} rule_config_t;
+
+static filter_sbp_table_t * filter_sbp_load_config(filter_sbp_state_t *s);
 
 static int process_rule(filter_sbp_rule_t *rule)
 {
@@ -45,102 +89,450 @@ static int process_rule(filter_sbp_rule_t *rule)
   return 1;
 }
 
-void filter_sbp_init(void *filter_sbp_state, const char *filename)
+static void bucket_init(filter_sbp_bucket_t *b, uint32_t rate, uint32_t cost_max)
 {
-  filter_sbp_state_t *s = (filter_sbp_state_t *)filter_sbp_state;
-  s->config_file = strdup(filename);
-  filter_sbp_load_config(s);
-  s->config_inotify = inotify_init1(IN_NONBLOCK);
-  int wd = inotify_add_watch(s->config_inotify, filename, IN_CLOSE_WRITE);
-  if ((s->config_inotify < 0) || (wd < 0)) {
-    fprintf(stderr, "Error setting up inotify on config file: %s\n", filename);
+  uint64_t burst = (uint64_t)rate * BUCKET_BURST_us;
+  uint64_t cost = (uint64_t)cost_max * TOKEN_SCALE;
+  b->rate = rate;
+  b->capacity = burst > cost ? burst : cost;
+  b->tokens = b->capacity;
+  b->timestamp_us = filter_timestamp_us_get();
+}
+
+/* Refill a bucket and check whether it holds enough tokens for cost.
+ * A rate of zero means unlimited. */
+static bool bucket_check(filter_sbp_bucket_t *b, uint64_t now_us, uint32_t cost)
+{
+  if (b->rate == 0) {
+    return true;
+  }
+
+  uint64_t elapsed_us = now_us - b->timestamp_us;
+  b->timestamp_us = now_us;
+  if (elapsed_us >= b->capacity / b->rate) {
+    b->tokens = b->capacity;
+  } else {
+    b->tokens += elapsed_us * b->rate;
+    if (b->tokens > b->capacity) {
+      b->tokens = b->capacity;
+    }
   }
+
+  return b->tokens >= (uint64_t)cost * TOKEN_SCALE;
 }
 
-static void filter_sbp_load_config(filter_sbp_state_t *s)
+static void bucket_consume(filter_sbp_bucket_t *b, uint32_t cost)
 {
-  s->rules_count = 0;
-  uint32_t rules_buffer_count = RULES_COUNT_INIT;
+  if (b->rate != 0) {
+    b->tokens -= (uint64_t)cost * TOKEN_SCALE;
+  }
+}
 
-  /* Allocate buffer for rules */
-  s->rules = malloc(rules_buffer_count * sizeof(filter_sbp_rule_t));
-  if (s->rules  == NULL) {
-    syslog(LOG_ERR, "error allocating buffer for rules");
-    rules_buffer_count = 0;
-    return;
+static int process_limits(filter_sbp_table_t *t, filter_sbp_limit_t *limit,
+                          uint32_t msg_length)
+{
+  if ((limit == NULL) && (t->budget.rate == 0)) {
+    return 0;
   }
 
-  /* Open file */
-  FILE *fp = fopen(s->config_file, "r");
-  if (fp == NULL) {
-    syslog(LOG_ERR, "error opening %s", s->config_file);
-    return;
+  /* Refill every bucket involved before deciding */
+  uint64_t now_us = filter_timestamp_us_get();
+  bool pass = bucket_check(&t->budget, now_us, msg_length);
+  if (limit != NULL) {
+    pass = bucket_check(&limit->msgs, now_us, 1) && pass;
+    pass = bucket_check(&limit->bytes, now_us, msg_length) && pass;
+  }
+
+  /* Reject if any bucket is exhausted */
+  if (!pass) {
+    return 1;
   }
 
-  /* Read lines of file */
-  bool error = false;
-  char line[256];
-  while (fgets(line, sizeof(line), fp) != NULL) {
+  bucket_consume(&t->budget, msg_length);
+  if (limit != NULL) {
+    bucket_consume(&limit->msgs, 1);
+    bucket_consume(&limit->bytes, msg_length);
+  }
+
+  return 0;
+}
 
-    /* Expected format: <msg_type> <divisor> */
-    unsigned int msg_type;
-    unsigned int divisor;
-    if (sscanf(line, "%x %x", &msg_type, &divisor) != 2) {
-      syslog(LOG_ERR, "error parsing %s", s->config_file);
-      error = true;
+static uint32_t slot_hash(const filter_sbp_table_t *t, uint16_t type)
+{
+  /* Fibonacci hashing, top bits select the slot */
+  return ((uint32_t)type * 2654435769u) >> t->slots_shift;
+}
+
+static bool prog_run(const filter_sbp_insn_t *prog, uint32_t prog_length,
+                     const uint8_t *msg, uint32_t msg_length)
+{
+  const uint8_t *payload = &msg[SBP_MSG_PAYLOAD_OFFSET];
+  uint32_t payload_length = msg[SBP_MSG_LENGTH_OFFSET];
+  if (SBP_MSG_PAYLOAD_OFFSET + payload_length > msg_length) {
+    payload_length = msg_length - SBP_MSG_PAYLOAD_OFFSET;
+  }
+
+  uint32_t a = 0;
+  for (uint32_t pc = 0; pc < prog_length; pc++) {
+    const filter_sbp_insn_t *insn = &prog[pc];
+    switch (insn->op) {
+    case OP_LD_SENDER:
+      a = msg[SBP_MSG_SENDER_OFFSET] |
+          ((uint32_t)msg[SBP_MSG_SENDER_OFFSET + 1] << 8);
+      break;
+    case OP_LD_U8:
+      if (insn->k + 1 > payload_length) {
+        return false;
+      }
+      a = payload[insn->k];
       break;
+    case OP_LD_U16:
+      if (insn->k + 2 > payload_length) {
+        return false;
+      }
+      a = payload[insn->k] | ((uint32_t)payload[insn->k + 1] << 8);
+      break;
+    case OP_LD_U32:
+      if (insn->k + 4 > payload_length) {
+        return false;
+      }
+      a = payload[insn->k] |
+          ((uint32_t)payload[insn->k + 1] << 8) |
+          ((uint32_t)payload[insn->k + 2] << 16) |
+          ((uint32_t)payload[insn->k + 3] << 24);
+      break;
+    case OP_AND:
+      a &= insn->k;
+      break;
+    case OP_EQ:
+      if (a != insn->k) {
+        return false;
+      }
+      break;
+    case OP_NE:
+      if (a == insn->k) {
+        return false;
+      }
+      break;
+    default:
+      return false;
     }
+  }
 
-    /* Reallocate rules buffer if required */
-    if (s->rules_count >= rules_buffer_count) {
-      rules_buffer_count *= 2;
-      s->rules = realloc(s->rules,
-                         rules_buffer_count * sizeof(filter_sbp_rule_t));
-      if (s->rules  == NULL) {
-        syslog(LOG_ERR, "error reallocating buffer for rules");
-        rules_buffer_count = 0;
-        error = true;
-        break;
-      }
+  return true;
+}
+
+static filter_sbp_rule_t * rule_lookup(filter_sbp_table_t *t, uint16_t type)
+{
+  uint32_t i = slot_hash(t, type);
+  while (1) {
+    const filter_sbp_slot_t *slot = &t->slots[i];
+    if (slot->rule_index == SLOT_EMPTY) {
+      return NULL;
+    }
+    if (slot->type == type) {
+      return &t->rules[slot->rule_index];
+    }
+    i = (i + 1) & t->slots_mask;
+  }
+}
+
+/* Build the rule table and the msg_type index from the parsed config.
+ * The table is a single allocation so that it can be swapped and freed as
+ * a unit. Rules for the same msg_type are chained in file order and the
+ * first one whose predicate matches applies. */
+static filter_sbp_table_t * table_compile(const rule_config_t *config,
+                                          uint32_t config_count,
+                                          uint32_t budget)
+{
+  /* Size the index for a load factor of at most 1/2 */
+  uint32_t slots_bits = 1;
+  while ((1u << slots_bits) < 2 * config_count) {
+    slots_bits++;
+  }
+  uint32_t slots_count = 1u << slots_bits;
+
+  uint32_t limits_count = 0;
+  uint32_t prog_count = 0;
+  for (uint32_t i = 0; i < config_count; i++) {
+    if ((config[i].max_msgs_per_s != 0) || (config[i].max_bytes_per_s != 0)) {
+      limits_count++;
+    }
+    prog_count += config[i].prog_length;
+  }
+
+  filter_sbp_table_t *t = malloc(sizeof(filter_sbp_table_t) +
+                                 limits_count * sizeof(filter_sbp_limit_t) +
+                                 slots_count * sizeof(filter_sbp_slot_t) +
+                                 config_count * sizeof(filter_sbp_rule_t) +
+                                 prog_count * sizeof(filter_sbp_insn_t));
+  if (t == NULL) {
+    syslog(LOG_ERR, "error allocating rule table");
+    return NULL;
+  }
+
+  t->limits = (filter_sbp_limit_t *)&t[1];
+  t->limits_count = 0;
+  t->slots = (filter_sbp_slot_t *)&t->limits[limits_count];
+  t->slots_mask = slots_count - 1;
+  t->slots_shift = 32 - slots_bits;
+  t->rules = (filter_sbp_rule_t *)&t->slots[slots_count];
+  t->rules_count = 0;
+  t->prog = (filter_sbp_insn_t *)&t->rules[config_count];
+  t->prog_count = 0;
+  bucket_init(&t->budget, budget, SBP_FRAME_SIZE_MAX);
+
+  for (uint32_t i = 0; i < slots_count; i++) {
+    t->slots[i].rule_index = SLOT_EMPTY;
+  }
+
+  for (uint32_t i = 0; i < config_count; i++) {
+    uint32_t slot_index = slot_hash(t, config[i].type);
+    while ((t->slots[slot_index].rule_index != SLOT_EMPTY) &&
+           (t->slots[slot_index].type != config[i].type)) {
+      slot_index = (slot_index + 1) & t->slots_mask;
     }
 
-    /* Set rule */
-    filter_sbp_rule_t *rule = &s->rules[s->rules_count++];
-    rule->type = msg_type;
-    rule->divisor = divisor;
+    filter_sbp_rule_t *rule = &t->rules[t->rules_count];
+    rule->divisor = config[i].divisor;
     rule->counter = 0;
+    rule->limit_index = LIMIT_NONE;
+    rule->next_index = RULE_NONE;
+    rule->prog_index = t->prog_count;
+    rule->prog_length = config[i].prog_length;
+    memcpy(&t->prog[t->prog_count], config[i].prog,
+           config[i].prog_length * sizeof(filter_sbp_insn_t));
+    t->prog_count += config[i].prog_length;
+
+    if ((config[i].max_msgs_per_s != 0) || (config[i].max_bytes_per_s != 0)) {
+      filter_sbp_limit_t *limit = &t->limits[t->limits_count];
+      bucket_init(&limit->msgs, config[i].max_msgs_per_s, 1);
+      bucket_init(&limit->bytes, config[i].max_bytes_per_s, SBP_FRAME_SIZE_MAX);
+      rule->limit_index = t->limits_count++;
+    }
+
+    filter_sbp_slot_t *slot = &t->slots[slot_index];
+    if (slot->rule_index == SLOT_EMPTY) {
+      slot->type = config[i].type;
+      slot->rule_index = t->rules_count++;
+      continue;
+    }
+
+    /* Append to the chain for an existing msg_type */
+    filter_sbp_rule_t *tail = &t->rules[slot->rule_index];
+    while (tail->next_index != RULE_NONE) {
+      tail = &t->rules[tail->next_index];
+    }
+    tail->next_index = t->rules_count++;
   }
 
-  /* Close file */
-  fclose(fp);
+  return t;
+}
 
-  /* Clear rules if an error occurred */
-  if (error) {
-    s->rules_count = 0;
+static bool prog_emit(rule_config_t *rule, uint8_t op, uint32_t k)
+{
+  if (rule->prog_length >= PROG_LENGTH_MAX) {
+    return false;
   }
+  rule->prog[rule->prog_length++] = (filter_sbp_insn_t) { .op = op, .k = k };
+  return true;
 }
 
-int filter_sbp_process(void *filter_sbp_state,
-                       const uint8_t *msg, uint32_t msg_length)
+/* Compile a predicate token into the rule program. Expected format:
+ *   sender=<id> | sender!=<id>
+ *   u8[<offset>]=<value>, optionally with &<mask> after the offset and
+ *   != in place of =. Likewise u16 and u32. */
+static bool predicate_parse(char *token, rule_config_t *rule)
 {
-  filter_sbp_state_t *s = (filter_sbp_state_t *)filter_sbp_state;
+  uint8_t op_load;
+  char *field;
+  if (strncmp(token, "sender", 6) == 0) {
+    op_load = OP_LD_SENDER;
+    field = &token[6];
+  } else if (strncmp(token, "u8[", 3) == 0) {
+    op_load = OP_LD_U8;
+    field = &token[3];
+  } else if (strncmp(token, "u16[", 4) == 0) {
+    op_load = OP_LD_U16;
+    field = &token[4];
+  } else if (strncmp(token, "u32[", 4) == 0) {
+    op_load = OP_LD_U32;
+    field = &token[4];
+  } else {
+    return false;
+  }
+
+  /* Split off the comparison */
+  uint8_t op_cmp = OP_EQ;
+  char *cmp = strchr(field, '=');
+  if (cmp == NULL) {
+    return false;
+  }
+  char *value = &cmp[1];
+  if ((cmp > field) && (cmp[-1] == '!')) {
+    op_cmp = OP_NE;
+    cmp--;
+  }
+  *cmp = '\0';
+
+  /* Split off the mask */
+  char *mask = strchr(field, '&');
+  if (mask != NULL) {
+    *mask++ = '\0';
+  }
+
+  uint32_t offset = 0;
+  if (op_load == OP_LD_SENDER) {
+    if (field[0] != '\0') {
+      return false;
+    }
+  } else {
+    size_t len = strlen(field);
+    if ((len < 2) || (field[len - 1] != ']')) {
+      return false;
+    }
+    field[len - 1] = '\0';
+    if (!filter_config_parse_hex(field, &offset)) {
+      return false;
+    }
+  }
+
+  uint32_t k;
+  if (!filter_config_parse_hex(value, &k) || !prog_emit(rule, op_load, offset)) {
+    return false;
+  }
+  if (mask != NULL) {
+    uint32_t m;
+    if (!filter_config_parse_hex(mask, &m) || !prog_emit(rule, OP_AND, m)) {
+      return false;
+    }
+  }
+  return prog_emit(rule, op_cmp, k);
+}
+
+/* Parse one line of the config file. All values are hex.
+ *
+ * Expected format, one of:
+ *   <msg_type> <divisor> [hz=<max msgs/s>] [bps=<max bytes/s>] [predicate]...
+ *   budget <max bytes/s for all messages>
+ *
+ * Returns 1 if a rule was parsed, 0 for a budget line, -1 on error. */
+static int config_line_parse(char *line, void *rule_, void *context)
+{
+  rule_config_t *rule = (rule_config_t *)rule_;
+  uint32_t *budget = (uint32_t *)context;
+  char *saveptr;
+  const char *delim = " \t\r\n";
+  char *token = strtok_r(line, delim, &saveptr);
+  if (token == NULL) {
+    return -1;
+  }
 
-  /* Reload config if changed */
-  char buf[sizeof(struct inotify_event) + NAME_MAX + 1]
-    __attribute__ ((aligned(__alignof__(struct inotify_event))));
-  if (read(s->config_inotify, buf, sizeof(buf)) > 0) {
-    /* Any events on the config file trigger a reload.
-     * We only subscribe to modify events. */
-    if (s->rules) {
-      free(s->rules);
-      s->rules = NULL;
-      s->rules_count = 0;
+  if (strcmp(token, "budget") == 0) {
+    token = strtok_r(NULL, delim, &saveptr);
+    if ((token == NULL) || !filter_config_parse_hex(token, budget) ||
+        (strtok_r(NULL, delim, &saveptr) != NULL)) {
+      return -1;
     }
-    filter_sbp_load_config(s);
+    return 0;
+  }
+
+  uint32_t msg_type;
+  uint32_t divisor;
+  if (!filter_config_parse_hex(token, &msg_type) || (msg_type > UINT16_MAX)) {
+    return -1;
+  }
+  token = strtok_r(NULL, delim, &saveptr);
+  if ((token == NULL) || !filter_config_parse_hex(token, &divisor)) {
+    return -1;
+  }
+
+  *rule = (rule_config_t) {
+    .type = msg_type,
+    .divisor = divisor,
+    .max_msgs_per_s = 0,
+    .max_bytes_per_s = 0,
+    .prog_length = 0
+  };
+
+  while ((token = strtok_r(NULL, delim, &saveptr)) != NULL) {
+    if (strncmp(token, "hz=", 3) == 0) {
+      if (!filter_config_parse_hex(&token[3], &rule->max_msgs_per_s)) {
+        return -1;
+      }
+    } else if (strncmp(token, "bps=", 4) == 0) {
+      if (!filter_config_parse_hex(&token[4], &rule->max_bytes_per_s)) {
+        return -1;
+      }
+    } else if (!predicate_parse(token, rule)) {
+      return -1;
+    }
+  }
+
+  return 1;
+}
+
+void filter_sbp_init(void *filter_sbp_state, const char *filename)
+{
+  filter_sbp_state_t *s = (filter_sbp_state_t *)filter_sbp_state;
+  s->config_file = strdup(filename);
+  s->table = filter_sbp_load_config(s);
+  s->config_inotify = filter_config_watch(filename);
+}
+
+static filter_sbp_table_t * filter_sbp_load_config(filter_sbp_state_t *s)
+{
+  uint32_t budget = 0;
+  uint32_t config_count;
+  rule_config_t *config = filter_config_load(s->config_file,
+                                             sizeof(rule_config_t),
+                                             RULES_COUNT_INIT,
+                                             config_line_parse, &budget,
+                                             &config_count);
+  if (config == NULL) {
+    return NULL;
+  }
+
+  /* An empty config passes everything */
+  filter_sbp_table_t *t = NULL;
+  if ((config_count > 0) || (budget > 0)) {
+    t = table_compile(config, config_count, budget);
+  }
+
+  free(config);
+  return t;
+}
+
+int filter_sbp_config_fd(void *filter_sbp_state)
+{
+  filter_sbp_state_t *s = (filter_sbp_state_t *)filter_sbp_state;
+  return s->config_inotify;
+}
+
+void filter_sbp_config_reload(void *filter_sbp_state)
+{
+  filter_sbp_state_t *s = (filter_sbp_state_t *)filter_sbp_state;
+
+  if (!filter_config_changed(s->config_inotify)) {
+    return;
   }
 
+  /* Swap in the new table. Rule counters restart from zero. */
+  filter_sbp_table_t *t = filter_sbp_load_config(s);
+  if (s->table != NULL) {
+    free(s->table);
+  }
+  s->table = t;
+}
+
+int filter_sbp_process(void *filter_sbp_state,
+                       const uint8_t *msg, uint32_t msg_length)
+{
+  filter_sbp_state_t *s = (filter_sbp_state_t *)filter_sbp_state;
+  filter_sbp_table_t *t = s->table;
+
   /* Pass everything if no rules are configured */
-  if (s->rules_count == 0) {
+  if (t == NULL) {
     return 0;
   }
 
@@ -149,16 +541,30 @@ int filter_sbp_process(void *filter_sbp_state,
     return 1;
   }
 
-  /* Search for corresponding rule */
+  /* Without rules only the budget applies */
+  if (t->rules_count == 0) {
+    return process_limits(t, NULL, msg_length);
+  }
+
+  /* Look up corresponding rule, the first with a matching predicate */
   uint16_t msg_type = le16toh(*(uint16_t *)&msg[SBP_MSG_TYPE_OFFSET]);
-  uint32_t i;
-  for (i = 0; i < s->rules_count; i++) {
-    filter_sbp_rule_t *rule = &s->rules[i];
-    if (rule->type == msg_type) {
-      return process_rule(rule);
-    }
+  filter_sbp_rule_t *rule = rule_lookup(t, msg_type);
+  while ((rule != NULL) &&
+         !prog_run(&t->prog[rule->prog_index], rule->prog_length,
+                   msg, msg_length)) {
+    rule = (rule->next_index == RULE_NONE) ?
+               NULL : &t->rules[rule->next_index];
+  }
+  if (rule == NULL) {
+    /* Reject message if no matching rule was found */
+    return 1;
   }
 
-  /* Reject message if no matching rule was found */
-  return 1;
+  if (process_rule(rule) != 0) {
+    return 1;
+  }
+
+  return process_limits(t, rule->limit_index == LIMIT_NONE ?
+                               NULL : &t->limits[rule->limit_index],
+                        msg_length);
 }
@@ -19,14 +19,52 @@
 #include <libsbp/sbp.h>
 
 typedef struct {
-  uint16_t type;
+  uint32_t rate;
+  uint64_t capacity;
+  uint64_t tokens;
+  uint64_t timestamp_us;
+} filter_sbp_bucket_t;
+
+typedef struct {
+  filter_sbp_bucket_t msgs;
+  filter_sbp_bucket_t bytes;
+} filter_sbp_limit_t;
+
+/* Predicate bytecode, see filter_sbp.c */
+typedef struct {
+  uint8_t op;
+  uint32_t k;
+} filter_sbp_insn_t;
+
+typedef struct {
   uint8_t divisor;
   uint8_t counter;
+  uint32_t limit_index;
+  uint32_t next_index;
+  uint32_t prog_index;
+  uint32_t prog_length;
 } filter_sbp_rule_t;
 
+typedef struct {
+  uint16_t type;
+  uint32_t rule_index;
+} filter_sbp_slot_t;
+
 typedef struct {
   filter_sbp_rule_t *rules;
   uint32_t rules_count;
+  filter_sbp_slot_t *slots;
+  uint32_t slots_mask;
+  uint32_t slots_shift;
+  filter_sbp_limit_t *limits;
+  uint32_t limits_count;
+  filter_sbp_insn_t *prog;
+  uint32_t prog_count;
+  filter_sbp_bucket_t budget;
+} filter_sbp_table_t;
+
+typedef struct {
+  filter_sbp_table_t *table;
   const char *config_file;
   int config_inotify;
 } filter_sbp_state_t;
@@ -34,5 +72,7 @@ typedef struct {
 void filter_sbp_init(void *filter_sbp_state, const char *filename);
 int filter_sbp_process(void *filter_sbp_state,
                        const uint8_t *msg, uint32_t msg_length);
+int filter_sbp_config_fd(void *filter_sbp_state);
+void filter_sbp_config_reload(void *filter_sbp_state);
 
 #endif /* SWIFTNAV_FILTER_SBP_H */
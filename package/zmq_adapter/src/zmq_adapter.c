@@ -57,10 +57,14 @@ static bool debug = false;
 static io_mode_t io_mode = IO_INVALID;
 static zsock_mode_t zsock_mode = ZSOCK_INVALID;
 static framer_t framer = FRAMER_NONE;
-static filter_t filter_in = FILTER_NONE;
-static filter_t filter_out = FILTER_NONE;
-const char *filter_in_config = NULL;
-const char *filter_out_config = NULL;
+static filter_t filter_in[FILTER_CHAIN_LENGTH_MAX];
+static filter_t filter_out[FILTER_CHAIN_LENGTH_MAX];
+static const char *filter_in_config[FILTER_CHAIN_LENGTH_MAX];
+static const char *filter_out_config[FILTER_CHAIN_LENGTH_MAX];
+static int filter_in_count = 0;
+static int filter_out_count = 0;
+static int filter_in_config_count = 0;
+static int filter_out_config_count = 0;
 static int rep_timeout_ms = REP_TIMEOUT_DEFAULT_ms;
 static int startup_delay_ms = STARTUP_DELAY_DEFAULT_ms;
 
@@ -104,10 +108,15 @@ static void usage(char *command)
   fprintf(stderr, "\nFilter Mode - optional\n");
   fprintf(stderr, "\t--filter-in <filter>\n");
   fprintf(stderr, "\t--filter-out <filter>\n");
-  fprintf(stderr, "\t\tavailable filters: sbp\n");
+  fprintf(stderr, "\t\tavailable filters: sbp, dedup\n");
   fprintf(stderr, "\t--filter-in-config <file>\n");
   fprintf(stderr, "\t--filter-out-config <file>\n");
   fprintf(stderr, "\t\tfilter configuration file\n");
+  fprintf(stderr, "\t\tmay be repeated to chain filters, each filter is "
+                  "given the config\n"
+                  "\t\tfile at the same position\n");
+  fprintf(stderr, "\t\tdedup: one '<msg_type> <window ms>' rule per line, "
+                  "in hex\n");
 
   fprintf(stderr, "\nIO Modes - select one\n");
   fprintf(stderr, "\t--stdio\n");
@@ -122,6 +131,33 @@ static void usage(char *command)
   fprintf(stderr, "\t--debug\n");
 }
 
+static int filter_parse(const char *arg, filter_t *filters, int *count)
+{
+  if (*count >= FILTER_CHAIN_LENGTH_MAX) {
+    return -1;
+  }
+
+  if (strcasecmp(arg, "SBP") == 0) {
+    filters[(*count)++] = FILTER_SBP;
+  } else if (strcasecmp(arg, "DEDUP") == 0) {
+    filters[(*count)++] = FILTER_DEDUP;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+static int filter_config_parse(const char *arg, const char **configs,
+                               int *count)
+{
+  if (*count >= FILTER_CHAIN_LENGTH_MAX) {
+    return -1;
+  }
+
+  configs[(*count)++] = arg;
+  return 0;
+}
+
 static int parse_options(int argc, char *argv[])
 {
   enum {
@@ -189,9 +225,7 @@ static int parse_options(int argc, char *argv[])
       break;
 
       case OPT_ID_FILTER_IN: {
-        if (strcasecmp(optarg, "SBP") == 0) {
-          filter_in = FILTER_SBP;
-        } else {
+        if (filter_parse(optarg, filter_in, &filter_in_count) != 0) {
           fprintf(stderr, "invalid input filter\n");
           return -1;
         }
@@ -199,9 +233,7 @@ static int parse_options(int argc, char *argv[])
       break;
 
       case OPT_ID_FILTER_OUT: {
-        if (strcasecmp(optarg, "SBP") == 0) {
-          filter_out = FILTER_SBP;
-        } else {
+        if (filter_parse(optarg, filter_out, &filter_out_count) != 0) {
           fprintf(stderr, "invalid output filter\n");
           return -1;
         }
@@ -209,12 +241,20 @@ static int parse_options(int argc, char *argv[])
       break;
 
       case OPT_ID_FILTER_IN_CONFIG: {
-        filter_in_config = optarg;
+        if (filter_config_parse(optarg, filter_in_config,
+                                &filter_in_config_count) != 0) {
+          fprintf(stderr, "invalid input filter config\n");
+          return -1;
+        }
       }
       break;
 
       case OPT_ID_FILTER_OUT_CONFIG: {
-        filter_out_config = optarg;
+        if (filter_config_parse(optarg, filter_out_config,
+                                &filter_out_config_count) != 0) {
+          fprintf(stderr, "invalid output filter config\n");
+          return -1;
+        }
       }
       break;
 
@@ -277,12 +317,12 @@ static int parse_options(int argc, char *argv[])
     return -1;
   }
 
-  if ((filter_in == FILTER_NONE) != (filter_in_config == NULL)) {
+  if (filter_in_count != filter_in_config_count) {
     fprintf(stderr, "invalid input filter settings\n");
     return -1;
   }
 
-  if ((filter_out == FILTER_NONE) != (filter_out_config == NULL)) {
+  if (filter_out_count != filter_out_config_count) {
     fprintf(stderr, "invalid output filter settings\n");
     return -1;
   }
@@ -318,6 +358,30 @@ static zmq_pollitem_t handle_to_pollitem(const handle_t *handle, short events)
   return pollitem;
 }
 
+static void filter_to_pollitems(filter_state_t *filter_state,
+                                zmq_pollitem_t *pollitems, short events)
+{
+  for (int i = 0; i < FILTER_CHAIN_LENGTH_MAX; i++) {
+    int fd = filter_config_fd(filter_state, i);
+    pollitems[i] = (zmq_pollitem_t) {
+      .socket = NULL,
+      .fd = fd,
+      .events = fd < 0 ? 0 : events
+    };
+  }
+}
+
+static void filter_pollitems_check(filter_state_t *filter_state,
+                                   const zmq_pollitem_t *pollitems)
+{
+  for (int i = 0; i < FILTER_CHAIN_LENGTH_MAX; i++) {
+    if (pollitems[i].revents & ZMQ_POLLIN) {
+      debug_printf("reloading filter config\n");
+      filter_config_reload(filter_state, i);
+    }
+  }
+}
+
 static zsock_t * zsock_start(int type)
 {
   zsock_t *zsock = zsock_new(type);
@@ -626,6 +690,35 @@ static void io_loop_pubsub(handle_t *read_handle, handle_t *write_handle)
   debug_printf("io loop begin\n");
 
   while (1) {
+    enum {
+      POLLITEM_READ,
+      POLLITEM_FILTER,
+      POLLITEM__COUNT = POLLITEM_FILTER + FILTER_CHAIN_LENGTH_MAX
+    };
+
+    zmq_pollitem_t pollitems[POLLITEM__COUNT] = {
+      [POLLITEM_READ] = handle_to_pollitem(read_handle, ZMQ_POLLIN),
+    };
+    filter_to_pollitems(&write_handle->filter_state,
+                        &pollitems[POLLITEM_FILTER], ZMQ_POLLIN);
+
+    int poll_ret = zmq_poll(pollitems, POLLITEM__COUNT, -1);
+    if ((poll_ret == -1) && (errno == EINTR)) {
+      /* Retry if interrupted */
+      continue;
+    } else if (poll_ret < 0) {
+      /* Break on error */
+      break;
+    }
+
+    /* Check filter configs */
+    filter_pollitems_check(&write_handle->filter_state,
+                           &pollitems[POLLITEM_FILTER]);
+
+    if (!(pollitems[POLLITEM_READ].revents & ZMQ_POLLIN)) {
+      continue;
+    }
+
     /* Read from read_handle */
     uint8_t buffer[READ_BUFFER_SIZE];
     ssize_t read_count = handle_read(read_handle, buffer, sizeof(buffer));
@@ -661,13 +754,19 @@ static void io_loop_reqrep(handle_t *req_handle, handle_t *rep_handle)
     enum {
       POLLITEM_REQ,
       POLLITEM_REP,
-      POLLITEM__COUNT
+      POLLITEM_REQ_FILTER,
+      POLLITEM_REP_FILTER = POLLITEM_REQ_FILTER + FILTER_CHAIN_LENGTH_MAX,
+      POLLITEM__COUNT = POLLITEM_REP_FILTER + FILTER_CHAIN_LENGTH_MAX
     };
 
-    zmq_pollitem_t pollitems[] = {
+    zmq_pollitem_t pollitems[POLLITEM__COUNT] = {
       [POLLITEM_REQ] = handle_to_pollitem(req_handle, ZMQ_POLLIN),
       [POLLITEM_REP] = handle_to_pollitem(rep_handle, ZMQ_POLLIN),
     };
+    filter_to_pollitems(&req_handle->filter_state,
+                        &pollitems[POLLITEM_REQ_FILTER], ZMQ_POLLIN);
+    filter_to_pollitems(&rep_handle->filter_state,
+                        &pollitems[POLLITEM_REP_FILTER], ZMQ_POLLIN);
 
     int poll_ret = zmq_poll(pollitems, POLLITEM__COUNT, poll_timeout_ms);
     if ((poll_ret == -1) && (errno == EINTR)) {
@@ -693,6 +792,12 @@ static void io_loop_reqrep(handle_t *req_handle, handle_t *rep_handle)
       continue;
     }
 
+    /* Check filter configs */
+    filter_pollitems_check(&req_handle->filter_state,
+                           &pollitems[POLLITEM_REQ_FILTER]);
+    filter_pollitems_check(&rep_handle->filter_state,
+                           &pollitems[POLLITEM_REP_FILTER]);
+
     /* Check req_handle */
     if (pollitems[POLLITEM_REQ].revents & ZMQ_POLLIN) {
       if (!reply_pending) {
@@ -767,14 +872,13 @@ void io_loop_start(int read_fd, int write_fd)
               .zsock = pub, .read_fd = -1, .write_fd = -1
             };
             framer_state_init(&pub_handle.framer_state, framer);
-            filter_state_init(&pub_handle.filter_state,
-                              filter_in, filter_in_config);
+            filter_state_init(&pub_handle.filter_state, filter_in,
+                              filter_in_config, filter_in_count);
             handle_t fd_handle = {
               .zsock = NULL, .read_fd = read_fd, .write_fd = -1
             };
             framer_state_init(&fd_handle.framer_state, FRAMER_NONE);
-            filter_state_init(&fd_handle.filter_state,
-                              FILTER_NONE, NULL);
+            filter_state_init(&fd_handle.filter_state, NULL, NULL, 0);
             io_loop_pubsub(&fd_handle, &pub_handle);
             zsock_destroy(&pub);
             assert(pub == NULL);
@@ -793,14 +897,13 @@ void io_loop_start(int read_fd, int write_fd)
               .zsock = sub, .read_fd = -1, .write_fd = -1
             };
             framer_state_init(&sub_handle.framer_state, FRAMER_NONE);
-            filter_state_init(&sub_handle.filter_state,
-                              FILTER_NONE, NULL);
+            filter_state_init(&sub_handle.filter_state, NULL, NULL, 0);
             handle_t fd_handle = {
               .zsock = NULL, .read_fd = -1, .write_fd = write_fd
             };
             framer_state_init(&fd_handle.framer_state, FRAMER_NONE);
-            filter_state_init(&fd_handle.filter_state,
-                              filter_out, filter_out_config);
+            filter_state_init(&fd_handle.filter_state, filter_out,
+                              filter_out_config, filter_out_count);
             io_loop_pubsub(&sub_handle, &fd_handle);
             zsock_destroy(&sub);
             assert(sub == NULL);
@@ -822,14 +925,14 @@ void io_loop_start(int read_fd, int write_fd)
             .zsock = req, .read_fd = -1, .write_fd = -1
           };
           framer_state_init(&req_handle.framer_state, framer);
-          filter_state_init(&req_handle.filter_state,
-                            filter_in, filter_in_config);
+          filter_state_init(&req_handle.filter_state, filter_in,
+                            filter_in_config, filter_in_count);
           handle_t fd_handle = {
             .zsock = NULL, .read_fd = read_fd, write_fd = write_fd
           };
           framer_state_init(&fd_handle.framer_state, FRAMER_NONE);
-          filter_state_init(&fd_handle.filter_state,
-                            filter_out, filter_out_config);
+          filter_state_init(&fd_handle.filter_state, filter_out,
+                            filter_out_config, filter_out_count);
           io_loop_reqrep(&req_handle, &fd_handle);
           zsock_destroy(&req);
           assert(req == NULL);
@@ -850,14 +953,14 @@ void io_loop_start(int read_fd, int write_fd)
             .zsock = rep, .read_fd = -1, .write_fd = -1
           };
           framer_state_init(&rep_handle.framer_state, framer);
-          filter_state_init(&rep_handle.filter_state,
-                            filter_in, filter_in_config);
+          filter_state_init(&rep_handle.filter_state, filter_in,
+                            filter_in_config, filter_in_count);
           handle_t fd_handle = {
             .zsock = NULL, .read_fd = read_fd, write_fd = write_fd
           };
           framer_state_init(&fd_handle.framer_state, FRAMER_NONE);
-          filter_state_init(&fd_handle.filter_state,
-                            filter_out, filter_out_config);
+          filter_state_init(&fd_handle.filter_state, filter_out,
+                            filter_out_config, filter_out_count);
           io_loop_reqrep(&fd_handle, &rep_handle);
           zsock_destroy(&rep);
           assert(rep == NULL);
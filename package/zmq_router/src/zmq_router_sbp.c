@@ -107,7 +107,8 @@ static port_t ports_sbp[] = {
         &(forwarding_rule_t){
           .dst_port = &ports_sbp[SBP_PORT_SETTINGS_CLIENT],
           .filters = (const filter_t *[]) {
-            &FILTER_ACCEPT(0x55, 0xA0, 0x00), /* Settings Write */
+            &FILTER_ACCEPT(0x55, 0xA7, 0x00), /* Settings read by index response */
+            &FILTER_ACCEPT(0x55, 0xA6, 0x00), /* Settings read by index done */
             &FILTER_REJECT(),
             NULL
           }
@@ -162,7 +163,8 @@ static port_t ports_sbp[] = {
         &(forwarding_rule_t){
           .dst_port = &ports_sbp[SBP_PORT_SETTINGS_CLIENT],
           .filters = (const filter_t *[]) {
-            &FILTER_ACCEPT(0x55, 0xA0, 0x00), /* Settings Write */
+            &FILTER_ACCEPT(0x55, 0xA0, 0x02), /* Settings typed write */
+            &FILTER_ACCEPT(0x55, 0xA4, 0x02), /* Settings typed read request */
             &FILTER_REJECT(),
             NULL
           }
@@ -236,6 +238,7 @@ static port_t ports_sbp[] = {
           .dst_port = &ports_sbp[SBP_PORT_EXTERNAL],
           .filters = (const filter_t *[]) {
             &FILTER_ACCEPT(0x55, 0xA5, 0x00), /* Settings read response */
+            &FILTER_ACCEPT(0x55, 0xA5, 0x02), /* Settings typed read response */
             &FILTER_REJECT(),
             NULL
           }